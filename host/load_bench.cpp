@@ -0,0 +1,80 @@
+/*
+   Host build: fleet-scale benchmark of the controllers on simulated backends
+   Usage: load_bench [--loads 1,64,4096] [--ops 20000] [--seed 1] [--nvs bench] [--no-nvs] [--out report.json]
+   Prints a JSON array with one loadBenchJSON() report per number of loads
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reLoadBench.h"
+#include "host_shims.h"
+
+static void usage(const char* name)
+{
+  fprintf(stderr, "Usage: %s [--loads 1,64,4096] [--ops 20000] [--seed 1] [--nvs bench] [--no-nvs] [--out report.json]\n", name);
+}
+
+int main(int argc, char* argv[])
+{
+  const char* loads = "1,64,4096";
+  const char* nvs_space = "bench";
+  const char* out = nullptr;
+  uint32_t ops = 20000;
+  uint32_t seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if ((strcmp(argv[i], "--loads") == 0) && has_value) {
+      loads = argv[++i];
+    } else if ((strcmp(argv[i], "--ops") == 0) && has_value) {
+      ops = strtoul(argv[++i], nullptr, 10);
+    } else if ((strcmp(argv[i], "--seed") == 0) && has_value) {
+      seed = strtoul(argv[++i], nullptr, 10);
+    } else if ((strcmp(argv[i], "--nvs") == 0) && has_value) {
+      nvs_space = argv[++i];
+    } else if (strcmp(argv[i], "--no-nvs") == 0) {
+      nvs_space = nullptr;
+    } else if ((strcmp(argv[i], "--out") == 0) && has_value) {
+      out = argv[++i];
+    } else {
+      usage(argv[0]);
+      return 2;
+    };
+  };
+
+  FILE* f = out ? fopen(out, "w") : stdout;
+  if (f == nullptr) {
+    perror(out);
+    return 1;
+  };
+
+  bool ok = true;
+  fprintf(f, "[");
+  const char* item = loads;
+  while (item && *item) {
+    unsigned long count = strtoul(item, nullptr, 10);
+    if ((count == 0) || (count > UINT16_MAX)) {
+      fprintf(stderr, "Invalid number of loads: %s\n", item);
+      ok = false;
+      break;
+    };
+    re_load_bench_report_t report;
+    hostNvsClear();
+    if (!loadBenchRun((uint16_t)count, ops, seed, nvs_space, &report) || (report.loads != count)) {
+      fprintf(stderr, "Benchmark failed for %lu loads (%d created)\n", count, report.loads);
+      ok = false;
+    };
+    char* json = loadBenchJSON(&report);
+    if (json) {
+      fprintf(f, "%s%s", item == loads ? "" : ",", json);
+      free(json);
+    };
+    item = strchr(item, ',');
+    if (item) item++;
+  };
+  fprintf(f, "]\n");
+
+  if (out) fclose(f);
+  return ok ? 0 : 1;
+}
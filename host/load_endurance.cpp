@@ -0,0 +1,114 @@
+/*
+   Host build: NVS endurance of the counters store
+   Every load stores its counters with loadCountersNvsStore() at a fixed interval, the counters change between stores.
+   The simulated flash reports the bytes written and the erase cycles of every page (flash sector) of the partition.
+
+   load_endurance [--loads 16] [--interval 300] [--days 365] [--pages 6] [--cycles 100000]
+   Prints a JSON report; fails if a store fails
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "reLoadCtrl.h"
+#include "rStrings.h"
+#include "host_shims.h"
+
+// 1 January 2024 00:00:00 UTC
+#define ENDURANCE_START 1704067200
+
+static time_t _enduranceTime = ENDURANCE_START;
+
+static int64_t enduranceClockMono()
+{
+  return (int64_t)(_enduranceTime - ENDURANCE_START + 1) * 1000000;
+}
+
+static time_t enduranceClockTime()
+{
+  return _enduranceTime;
+}
+
+int main(int argc, char* argv[])
+{
+  uint32_t loads = 16;
+  uint32_t interval = 300;
+  uint32_t days = 365;
+  uint32_t pages = 6;
+  uint32_t cycles = 100000;
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if ((strcmp(argv[i], "--loads") == 0) && has_value) {
+      loads = strtoul(argv[++i], nullptr, 10);
+    } else if ((strcmp(argv[i], "--interval") == 0) && has_value) {
+      interval = strtoul(argv[++i], nullptr, 10);
+    } else if ((strcmp(argv[i], "--days") == 0) && has_value) {
+      days = strtoul(argv[++i], nullptr, 10);
+    } else if ((strcmp(argv[i], "--pages") == 0) && has_value) {
+      pages = strtoul(argv[++i], nullptr, 10);
+    } else if ((strcmp(argv[i], "--cycles") == 0) && has_value) {
+      cycles = strtoul(argv[++i], nullptr, 10);
+    } else {
+      fprintf(stderr, "Usage: %s [--loads 16] [--interval 300] [--days 365] [--pages 6] [--cycles 100000]\n", argv[0]);
+      return 2;
+    };
+  };
+  if ((loads == 0) || (loads > 1000) || (interval == 0) || (days == 0) || (pages < 2)) {
+    fprintf(stderr, "Invalid options\n");
+    return 2;
+  };
+
+  hostNvsPages(pages);
+  loadClockSet(enduranceClockMono, enduranceClockTime);
+
+  std::vector<re_load_counters_t> counters(loads);
+  std::vector<re_load_durations_t> durations(loads);
+  std::vector<uint32_t> seq(loads, 0);
+  std::vector<char*> spaces(loads);
+  for (uint32_t i = 0; i < loads; i++) {
+    memset((void*)&durations[i], 0, sizeof(re_load_durations_t));
+    spaces[i] = malloc_stringf("load%u", i);
+  };
+
+  uint64_t stores = 0;
+  uint32_t failed = 0;
+  const time_t end = ENDURANCE_START + (time_t)days * 86400;
+  for (_enduranceTime = ENDURANCE_START + interval; _enduranceTime <= end; _enduranceTime += interval) {
+    for (uint32_t i = 0; i < loads; i++) {
+      // A switching and a few seconds of work per interval
+      loadCountersIncrement(&counters[i]);
+      durations[i].durLast = 1 + (uint32_t)((_enduranceTime / interval + i) % 60);
+      durations[i].durTotal += durations[i].durLast;
+      durations[i].durToday += durations[i].durLast;
+      if (!loadCountersNvsStore(spaces[i], &counters[i], &durations[i], &seq[i])) failed++;
+      stores++;
+    };
+  };
+
+  host_nvs_stats_t stats;
+  hostNvsStats(&stats);
+  std::vector<uint32_t> erases(pages);
+  hostNvsErases(erases.data(), pages);
+  uint32_t erase_max = 0;
+  uint32_t erase_min = UINT32_MAX;
+  printf("{\"loads\":%u,\"interval\":%u,\"days\":%u,\"pages\":%u,\"stores\":%llu,\"failed\":%u,",
+    loads, interval, days, pages, (unsigned long long)stores, failed);
+  printf("\"bytes_per_store\":{\"estimated\":%u,\"written\":%.1f},",
+    loadCountersNvsStoreSize(), stores ? (double)stats.flashEntries * 32 / stores : 0.0);
+  printf("\"bytes_per_day_per_load\":%.0f,\"erases_per_sector\":[", (double)stats.flashEntries * 32 / days / loads);
+  for (uint32_t i = 0; i < pages; i++) {
+    printf("%s%u", i > 0 ? "," : "", erases[i]);
+    if (erases[i] > erase_max) erase_max = erases[i];
+    if (erases[i] < erase_min) erase_min = erases[i];
+  };
+  // Lifetime of the partition at this rate, until the most erased page reaches the rated number of cycles
+  double years = erase_max > 0 ? (double)cycles / erase_max * days / 365.0 : 0.0;
+  printf("],\"erases_min\":%u,\"erases_max\":%u,\"years_to_%u_cycles\":%.1f}\n", erase_min, erase_max, cycles, years);
+
+  for (uint32_t i = 0; i < loads; i++) {
+    free(spaces[i]);
+  };
+  loadClockSet(nullptr, nullptr);
+  return failed == 0 ? 0 : 1;
+}
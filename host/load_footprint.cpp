@@ -0,0 +1,85 @@
+/*
+   Host build: memory taken by one load, rLoadGroup against separate rLoadGpioController objects
+   The heap is measured after the loads are created, initialized and given MQTT topics, so it includes the objects,
+   their timers and topics; sizes are of the host ABI (the target is 32-bit, pointers and time_t are smaller there).
+
+   load_footprint [--loads 32]
+   Prints a JSON report; fails if the group does not take less memory per load than the controllers
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <vector>
+#include "reLoadCtrl.h"
+#include "reLoadGroup.h"
+#include "host_shims.h"
+
+#define FOOTPRINT_PIN_FIRST 4
+
+static size_t footprintHeap()
+{
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks;
+}
+
+static size_t footprintControllers(uint8_t loads)
+{
+  size_t heap = footprintHeap();
+  std::vector<rLoadController*> ctrls;
+  ctrls.reserve(loads);
+  size_t vector = footprintHeap() - heap;
+  char topic[16];
+  for (uint8_t i = 0; i < loads; i++) {
+    rLoadController* ctrl = new rLoadGpioController(FOOTPRINT_PIN_FIRST + i, 1, true, nullptr);
+    ctrl->loadInit(false);
+    snprintf(topic, sizeof(topic), "load%d", i);
+    ctrl->mqttTopicCreate(true, false, topic, nullptr, nullptr);
+    ctrls.push_back(ctrl);
+  };
+  size_t used = footprintHeap() - heap - vector;
+  for (rLoadController* ctrl: ctrls) {
+    delete ctrl;
+  };
+  return used;
+}
+
+static size_t footprintGroup(uint8_t loads)
+{
+  size_t heap = footprintHeap();
+  rLoadGroup* group = new rLoadGroup(loads, nullptr, nullptr, nullptr, TI_MILLISECONDS, nullptr, nullptr, nullptr, nullptr);
+  for (uint8_t i = 0; i < loads; i++) {
+    group->loadAttach(i, FOOTPRINT_PIN_FIRST + i, 1);
+  };
+  group->loadInitAll(false);
+  group->mqttTopicCreate(true, false, "loads", nullptr, nullptr);
+  size_t used = footprintHeap() - heap;
+  delete group;
+  return used;
+}
+
+int main(int argc, char* argv[])
+{
+  uint32_t loads = 32;
+  for (int i = 1; i < argc; i++) {
+    if ((strcmp(argv[i], "--loads") == 0) && (i + 1 < argc)) {
+      loads = strtoul(argv[++i], nullptr, 10);
+    } else {
+      fprintf(stderr, "Usage: %s [--loads 32]\n", argv[0]);
+      return 2;
+    };
+  };
+  if ((loads == 0) || (loads > UINT8_MAX - FOOTPRINT_PIN_FIRST)) {
+    fprintf(stderr, "Invalid number of loads\n");
+    return 2;
+  };
+
+  size_t ctrl_heap = footprintControllers((uint8_t)loads);
+  size_t group_heap = footprintGroup((uint8_t)loads);
+  printf("{\"loads\":%u,\"pointer\":%zu,\"time_t\":%zu,", loads, sizeof(void*), sizeof(time_t));
+  printf("\"sizeof\":{\"controller\":%zu,\"group\":%zu,\"group_item\":%zu,\"counters\":%zu,\"durations\":%zu},",
+    sizeof(rLoadGpioController), sizeof(rLoadGroup), sizeof(re_load_group_item_t), sizeof(re_load_counters_t), sizeof(re_load_durations_t));
+  printf("\"bytes_per_load\":{\"controller\":%.1f,\"group\":%.1f}}\n", (double)ctrl_heap / loads, (double)group_heap / loads);
+  return group_heap < ctrl_heap ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+/*
+   Host build: fuzz and property-test harness for the calendar catch-up of stored counters
+   Each case is checked twice against the reference model (loadCatchUpReference):
+   - directly, by loadCatchUpCheck();
+   - through the simulated NVS: loadCountersNvsStore() on the day of the store, loadCountersNvsRestore() on the day of the restore.
+   The first byte of a fuzzer input selects the time zone, the rest is a re_load_catchup_case_t.
+
+   load_fuzz [--iterations 20000] [--seed 1]      random cases in every time zone
+   load_fuzz FILE... | -                          replays inputs (AFL: load_fuzz @@), a divergence aborts
+   load_fuzz_libfuzzer [libFuzzer options]        coverage-guided, built with -DLOADCTRL_LIBFUZZER=ON and clang
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include "reLoadFuzz.h"
+#include "host_shims.h"
+
+#define FUZZ_NVS_SPACE "fuzz"
+
+// POSIX rules, so that the harness does not depend on the tz database of the host
+static const char* _fuzzZones[] = {
+  "UTC0",
+  "MSK-3",
+  "EST5EDT,M3.2.0,M11.1.0",
+  "NZST-12NZDT,M9.5.0,M4.1.0/3",
+  "LHST-10:30LHDT-11,M10.1.0,M4.1.0",
+  "<-11>11",
+};
+#define FUZZ_ZONES (sizeof(_fuzzZones) / sizeof(_fuzzZones[0]))
+
+static time_t _fuzzTime = 0;
+
+static int64_t fuzzClockMono()
+{
+  return 1000000;
+}
+
+static time_t fuzzClockTime()
+{
+  return _fuzzTime;
+}
+
+static void fuzzZoneSet(uint8_t zone)
+{
+  setenv("TZ", _fuzzZones[zone % FUZZ_ZONES], 1);
+  tzset();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------- Store and restore ---------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static bool fuzzCountersEqual(re_load_counters_t* a, re_load_counters_t* b)
+{
+  return (a->cntTotal == b->cntTotal) && (a->cntOverflow == b->cntOverflow)
+      && (a->cntToday == b->cntToday) && (a->cntYesterday == b->cntYesterday)
+      && (a->cntWeekCurr == b->cntWeekCurr) && (a->cntWeekPrev == b->cntWeekPrev)
+      && (a->cntMonthCurr == b->cntMonthCurr) && (a->cntMonthPrev == b->cntMonthPrev)
+      && (a->cntPeriodCurr == b->cntPeriodCurr) && (a->cntPeriodPrev == b->cntPeriodPrev)
+      && (a->cntYearCurr == b->cntYearCurr) && (a->cntYearPrev == b->cntYearPrev);
+}
+
+static bool fuzzNvsCheck(re_load_catchup_case_t* data, uint32_t seconds)
+{
+  // Nothing is stored for a load that has never been switched on
+  if (data->counters.cntTotal == 0) data->counters.cntTotal = 1;
+
+  hostNvsClear();
+  _fuzzTime = (time_t)data->daysNvs * 86400 + seconds % 86400;
+  re_load_counters_t counters = data->counters;
+  re_load_durations_t durations = data->durations;
+  uint32_t seq = 0;
+  if (!loadCountersNvsStore(FUZZ_NVS_SPACE, &counters, &durations, &seq)) {
+    fprintf(stderr, "Store failed on day %u\n", data->daysNvs);
+    return false;
+  };
+
+  _fuzzTime = (time_t)data->daysNow * 86400 + (seconds >> 15) % 86400;
+  uint8_t period_start = data->period_start;
+  re_load_counters_t cntReal = {}, cntRef = {};
+  re_load_durations_t durReal = {}, durRef = {};
+  seq = 0;
+  loadCountersNvsRestore(FUZZ_NVS_SPACE, &period_start, &cntReal, &durReal, &seq);
+  loadCatchUpReference(data, &cntRef, &durRef);
+
+  if (!fuzzCountersEqual(&cntReal, &cntRef) || (memcmp(&durReal, &durRef, sizeof(re_load_durations_t)) != 0)) {
+    fprintf(stderr, "NVS round trip diverged: stored on day %u, restored on day %u, period start %u, TZ %s\n",
+      data->daysNvs, data->daysNow, data->period_start, getenv("TZ"));
+    return false;
+  };
+  return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Fuzz input -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static int fuzzOne(const uint8_t* data, size_t size)
+{
+  if (size < 1 + sizeof(re_load_catchup_case_t)) return 0;
+  fuzzZoneSet(data[0]);
+  // Divergence of the direct check aborts inside
+  loadCatchUpFuzz(data + 1, size - 1);
+
+  // The same decoding as loadCatchUpFuzz()
+  re_load_catchup_case_t fuzz;
+  memcpy((void*)&fuzz, data + 1, sizeof(re_load_catchup_case_t));
+  fuzz.daysNvs = fuzz.daysNvs % LOAD_FUZZ_DAYS_MAX;
+  fuzz.daysNow = fuzz.daysNow % LOAD_FUZZ_DAYS_MAX;
+  // Restoring data from the future is not a catch-up
+  if (fuzz.daysNow < fuzz.daysNvs) return 0;
+  uint32_t seconds = 0;
+  if (size >= 1 + sizeof(re_load_catchup_case_t) + sizeof(uint32_t)) {
+    memcpy(&seconds, data + 1 + sizeof(re_load_catchup_case_t), sizeof(uint32_t));
+  };
+  if (!fuzzNvsCheck(&fuzz, seconds)) {
+    abort();
+  };
+  return 0;
+}
+
+static void fuzzInit()
+{
+  loadClockSet(fuzzClockMono, fuzzClockTime);
+}
+
+#if LOADCTRL_LIBFUZZER
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv)
+{
+  fuzzInit();
+  return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+  return fuzzOne(data, size);
+}
+
+#else
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Standalone -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static uint32_t fuzzRandom(uint32_t* state)
+{
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+static bool fuzzFile(const char* name)
+{
+  FILE* f = strcmp(name, "-") == 0 ? stdin : fopen(name, "rb");
+  if (f == nullptr) {
+    perror(name);
+    return false;
+  };
+  std::vector<uint8_t> data;
+  uint8_t buf[4096];
+  size_t len;
+  while ((len = fread(buf, 1, sizeof(buf), f)) > 0) {
+    data.insert(data.end(), buf, buf + len);
+  };
+  if (f != stdin) fclose(f);
+  fuzzOne(data.data(), data.size());
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  uint32_t iterations = 20000;
+  uint32_t seed = 1;
+  std::vector<const char*> files;
+  for (int i = 1; i < argc; i++) {
+    if ((strcmp(argv[i], "--iterations") == 0) && (i + 1 < argc)) {
+      iterations = strtoul(argv[++i], nullptr, 10);
+    } else if ((strcmp(argv[i], "--seed") == 0) && (i + 1 < argc)) {
+      seed = strtoul(argv[++i], nullptr, 10);
+    } else if ((argv[i][0] == '-') && (argv[i][1] != 0)) {
+      fprintf(stderr, "Usage: %s [--iterations 20000] [--seed 1] | FILE... | -\n", argv[0]);
+      return 2;
+    } else {
+      files.push_back(argv[i]);
+    };
+  };
+
+  fuzzInit();
+  if (!files.empty()) {
+    for (const char* name: files) {
+      if (!fuzzFile(name)) return 1;
+    };
+    return 0;
+  };
+
+  uint32_t failed = 0;
+  clock_t start = clock();
+  for (uint8_t zone = 0; zone < FUZZ_ZONES; zone++) {
+    fuzzZoneSet(zone);
+    // Direct catch-up against the reference model
+    failed += loadCatchUpSelfTest(iterations, seed + zone);
+    // Round trip through the simulated NVS, the same generator as the self-test
+    uint32_t state = seed + zone;
+    for (uint32_t i = 0; i < iterations / 10; i++) {
+      re_load_catchup_case_t data;
+      memset((void*)&data, 0, sizeof(re_load_catchup_case_t));
+      data.daysNvs = 1 + fuzzRandom(&state) % (LOAD_FUZZ_DAYS_MAX - 800);
+      data.daysNow = data.daysNvs + fuzzRandom(&state) % 800;
+      data.period_start = fuzzRandom(&state) % 32;
+      uint32_t* cnt = (uint32_t*)&data.counters;
+      for (size_t j = 0; j < sizeof(re_load_counters_t) / sizeof(uint32_t); j++) {
+        cnt[j] = fuzzRandom(&state);
+      };
+      uint32_t* dur = (uint32_t*)&data.durations;
+      for (size_t j = 0; j < sizeof(re_load_durations_t) / sizeof(uint32_t); j++) {
+        dur[j] = fuzzRandom(&state);
+      };
+      if (!fuzzNvsCheck(&data, fuzzRandom(&state))) failed++;
+    };
+  };
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  uint32_t total = (uint32_t)FUZZ_ZONES * (iterations + iterations / 10);
+  printf("{\"cases\":%u,\"failed\":%u,\"cases_per_sec\":%.0f}\n", total, failed, seconds > 0 ? total / seconds : 0.0);
+  return failed == 0 ? 0 : 1;
+}
+
+#endif // LOADCTRL_LIBFUZZER
@@ -0,0 +1,198 @@
+/*
+   Host build: offline replay of recorded switching logs through the real controllers (rLoadReplay)
+
+   load_replay [options] FILE | -
+     --loads N           number of loads, by default the largest load index in the log + 1
+     --period-start D    day of month at the beginning of the billing period, 0 - not used
+     --checkpoint S      checkpoint interval of on-intervals, seconds, 0 - disabled
+     --start T           wall-clock time of the first boot (UNIX time), by default the time of the first event
+     --tz RULE           time zone (POSIX TZ), by default the TZ of the environment
+     --nvs PREFIX        prefix of the simulated NVS namespaces
+   load_replay [options] --synthetic N [--seed S]
+     replays N random events instead of a file, to measure the throughput of the accounting
+
+   Log: one event per line "time load event", separated by spaces or commas, '#' starts a comment.
+   time is UNIX time, load is the index of the load, event is on, off, store, reboot or the LOAD_REPLAY_xxx number.
+   Output: JSON with the status of every load (as published by the controller) and the replay statistics.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include "reLoadReplay.h"
+#include "host_shims.h"
+
+static const char* _replayTypes[] = { "off", "on", "store", "reboot" };
+
+static bool replayParseType(const char* text, uint8_t* type)
+{
+  for (uint8_t i = 0; i < sizeof(_replayTypes) / sizeof(_replayTypes[0]); i++) {
+    if (strcasecmp(text, _replayTypes[i]) == 0) {
+      *type = i;
+      return true;
+    };
+  };
+  char* end;
+  unsigned long value = strtoul(text, &end, 10);
+  if ((*end == 0) && (value <= LOAD_REPLAY_REBOOT)) {
+    *type = (uint8_t)value;
+    return true;
+  };
+  return false;
+}
+
+static bool replayRead(const char* name, std::vector<re_load_replay_event_t>& events)
+{
+  FILE* f = strcmp(name, "-") == 0 ? stdin : fopen(name, "r");
+  if (f == nullptr) {
+    perror(name);
+    return false;
+  };
+  bool ret = true;
+  char line[256];
+  uint32_t line_no = 0;
+  while (fgets(line, sizeof(line), f)) {
+    line_no++;
+    char* comment = strchr(line, '#');
+    if (comment) *comment = 0;
+    char* fields[3];
+    uint8_t count = 0;
+    for (char* token = strtok(line, " \t,;\r\n"); token && (count < 3); token = strtok(nullptr, " \t,;\r\n")) {
+      fields[count++] = token;
+    };
+    if (count == 0) continue;
+    re_load_replay_event_t event;
+    char* end_time;
+    char* end_load;
+    unsigned long long time = (count == 3) ? strtoull(fields[0], &end_time, 10) : 0;
+    unsigned long load = (count == 3) ? strtoul(fields[1], &end_load, 10) : 0;
+    if ((count != 3) || (*end_time != 0) || (*end_load != 0) || (time > UINT32_MAX) || (load > UINT8_MAX)
+     || !replayParseType(fields[2], &event.type)) {
+      fprintf(stderr, "%s:%u: expected \"time load on|off|store|reboot\"\n", name, line_no);
+      ret = false;
+      break;
+    };
+    event.time = (uint32_t)time;
+    event.load = (uint8_t)load;
+    events.push_back(event);
+  };
+  if (f != stdin) fclose(f);
+  return ret;
+}
+
+static void replaySynthetic(uint32_t count, uint8_t loads, uint32_t start, uint32_t seed, std::vector<re_load_replay_event_t>& events)
+{
+  // Random switching every few minutes, occasional stores and rare reboots
+  uint32_t state = seed ? seed : 1;
+  uint32_t time = start;
+  std::vector<bool> on(loads, false);
+  events.reserve(count);
+  for (uint32_t i = 0; i < count; i++) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    time += state % 600;
+    re_load_replay_event_t event;
+    event.time = time;
+    event.load = (uint8_t)((state >> 10) % loads);
+    uint32_t kind = (state >> 20) % 1000;
+    if (kind == 0) {
+      event.type = LOAD_REPLAY_REBOOT;
+      on.assign(loads, false);
+    } else if (kind < 20) {
+      event.type = LOAD_REPLAY_STORE;
+    } else {
+      on[event.load] = !on[event.load];
+      event.type = on[event.load] ? LOAD_REPLAY_ON : LOAD_REPLAY_OFF;
+    };
+    events.push_back(event);
+  };
+}
+
+static void usage(const char* name)
+{
+  fprintf(stderr, "Usage: %s [--loads N] [--period-start D] [--checkpoint S] [--start T] [--tz RULE] [--nvs PREFIX] FILE | - | --synthetic N [--seed S]\n", name);
+}
+
+int main(int argc, char* argv[])
+{
+  uint32_t loads = 0;
+  uint8_t period_start = 0;
+  uint32_t checkpoint = 0;
+  uint32_t start = 0;
+  uint32_t synthetic = 0;
+  uint32_t seed = 1;
+  const char* nvs_prefix = "replay";
+  const char* file = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if ((strcmp(argv[i], "--loads") == 0) && has_value) {
+      loads = strtoul(argv[++i], nullptr, 10);
+    } else if ((strcmp(argv[i], "--period-start") == 0) && has_value) {
+      period_start = (uint8_t)strtoul(argv[++i], nullptr, 10);
+    } else if ((strcmp(argv[i], "--checkpoint") == 0) && has_value) {
+      checkpoint = strtoul(argv[++i], nullptr, 10);
+    } else if ((strcmp(argv[i], "--start") == 0) && has_value) {
+      start = strtoul(argv[++i], nullptr, 10);
+    } else if ((strcmp(argv[i], "--tz") == 0) && has_value) {
+      setenv("TZ", argv[++i], 1);
+    } else if ((strcmp(argv[i], "--nvs") == 0) && has_value) {
+      nvs_prefix = argv[++i];
+    } else if ((strcmp(argv[i], "--synthetic") == 0) && has_value) {
+      synthetic = strtoul(argv[++i], nullptr, 10);
+    } else if ((strcmp(argv[i], "--seed") == 0) && has_value) {
+      seed = strtoul(argv[++i], nullptr, 10);
+    } else if ((file == nullptr) && ((argv[i][0] != '-') || (argv[i][1] == 0))) {
+      file = argv[i];
+    } else {
+      usage(argv[0]);
+      return 2;
+    };
+  };
+  if ((file == nullptr) == (synthetic == 0)) {
+    usage(argv[0]);
+    return 2;
+  };
+  tzset();
+
+  std::vector<re_load_replay_event_t> events;
+  if (synthetic > 0) {
+    if (loads == 0) loads = 16;
+    if (loads > UINT8_MAX) loads = UINT8_MAX;
+    replaySynthetic(synthetic, (uint8_t)loads, start ? start : 1672531200, seed, events);
+  } else {
+    if (!replayRead(file, events)) return 1;
+    if (loads == 0) {
+      for (const re_load_replay_event_t& event: events) {
+        if (event.load + 1u > loads) loads = event.load + 1u;
+      };
+    };
+  };
+  if (events.empty() || (loads == 0) || (loads > UINT8_MAX)) {
+    fprintf(stderr, "Nothing to replay\n");
+    return 1;
+  };
+  if (start == 0) start = events[0].time;
+
+  rLoadReplay* replay = new rLoadReplay((uint8_t)loads, &period_start, nvs_prefix, checkpoint);
+  bool ok = replay->reset(start) && replay->process(events.data(), (uint32_t)events.size());
+  if (!ok) {
+    fprintf(stderr, "Replay stopped after %u events\n", replay->getStats().events);
+  };
+
+  printf("{\"loads\":[");
+  for (uint32_t i = 0; i < loads; i++) {
+    char* json = replay->getJSON((uint8_t)i);
+    printf("%s{\"load\":%u,\"status\":%s}", i > 0 ? "," : "", i, json ? json : "null");
+    if (json) free(json);
+  };
+  char* stats = replay->getStatsJSON();
+  printf("],\"stats\":%s}\n", stats ? stats : "null");
+  if (stats) free(stats);
+
+  delete replay;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+/*
+   Host build: simulation of light-sleep intervals of a device with several loads in pulse mode
+   The CPU sleeps until the nearest timer deadline or wake window; every distinct deadline is one wake-up.
+   The same schedule is simulated in the normal and in the low-power mode.
+
+   load_sleep [--loads 8] [--hours 1] [--window 60]
+   Prints a JSON array with the wake-up statistics of both modes; fails if the low-power mode does not wake less often
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "reLoadCtrl.h"
+#include "host_shims.h"
+
+#define SLEEP_PIN_FIRST 8
+
+typedef struct {
+  uint32_t wakeups;                             // Distinct wake-up instants
+  uint32_t callbacks;                           // Timer callbacks of the controllers
+  uint32_t shared;                              // Callbacks that shared the wake-up with another controller
+  uint32_t toggles;                             // GPIO changes seen at the wake-ups
+  int64_t  sleepMin;                            // Shortest sleep, us
+  int64_t  sleepMax;                            // Longest sleep, us
+  int64_t  sleepSum;                            // Total sleep, us
+} sleep_stats_t;
+
+static void sleepRun(bool low_power, uint32_t loads, uint32_t hours, uint32_t window, sleep_stats_t* stats)
+{
+  memset(stats, 0, sizeof(sleep_stats_t));
+  stats->sleepMin = INT64_MAX;
+
+  // Pulses of different lengths, not aligned to each other: 700..2300 ms on, 900..3700 ms off
+  std::vector<uint32_t> durations(loads), intervals(loads);
+  std::vector<rLoadController*> ctrls(loads);
+  std::vector<int> levels(loads);
+  for (uint32_t i = 0; i < loads; i++) {
+    durations[i] = 700 + (i * 530) % 1700;
+    intervals[i] = 900 + (i * 770) % 2900;
+    ctrls[i] = new rLoadGpioController(SLEEP_PIN_FIRST + i, 1, false, nullptr,
+      &durations[i], &intervals[i], TI_MILLISECONDS, nullptr, nullptr, nullptr, nullptr);
+    ctrls[i]->loadInit(false);
+    ctrls[i]->setLowPower(low_power);
+  };
+  for (uint32_t i = 0; i < loads; i++) {
+    ctrls[i]->loadSetState(true, false, false);
+    levels[i] = hostGpioLevel(SLEEP_PIN_FIRST + i);
+  };
+
+  const int64_t window_us = (int64_t)window * 1000000;
+  int64_t now = esp_timer_get_time();
+  int64_t end = now + (int64_t)hours * 3600 * 1000000;
+  int64_t next_window = (now / window_us + 1) * window_us;
+  while (now < end) {
+    int64_t wake = hostTimerNext();
+    bool is_window = low_power && ((wake < 0) || (wake >= next_window));
+    if (is_window) wake = next_window;
+    if (wake > end) break;
+    int64_t sleep = wake - now;
+    if (sleep > 0) {
+      if (sleep < stats->sleepMin) stats->sleepMin = sleep;
+      if (sleep > stats->sleepMax) stats->sleepMax = sleep;
+      stats->sleepSum += sleep;
+      stats->wakeups++;
+    };
+    // Every timer that is due at this instant runs in the same wake-up
+    hostTimerAdvance(wake - now);
+    now = wake;
+    if (is_window) {
+      rLoadController::lowPowerWindow();
+      next_window += window_us;
+    };
+    for (uint32_t i = 0; i < loads; i++) {
+      int level = hostGpioLevel(SLEEP_PIN_FIRST + i);
+      if (level != levels[i]) {
+        levels[i] = level;
+        stats->toggles++;
+      };
+    };
+  };
+
+  for (uint32_t i = 0; i < loads; i++) {
+    re_load_lowpower_stats_t lp = ctrls[i]->getLowPowerStats();
+    stats->callbacks += lp.wakeups;
+    stats->shared += lp.wakeupsShared;
+    ctrls[i]->setLowPower(false);
+    ctrls[i]->loadSetState(false, false, false);
+    delete ctrls[i];
+  };
+  if (stats->wakeups == 0) stats->sleepMin = 0;
+}
+
+static void sleepPrint(const char* mode, sleep_stats_t* stats, bool last)
+{
+  printf("{\"mode\":\"%s\",\"wakeups\":%u,\"callbacks\":%u,\"shared\":%u,\"toggles\":%u,\"sleep_ms\":{\"min\":%.1f,\"avg\":%.1f,\"max\":%.1f}}%s\n",
+    mode, stats->wakeups, stats->callbacks, stats->shared, stats->toggles,
+    stats->sleepMin / 1000.0, stats->wakeups ? stats->sleepSum / 1000.0 / stats->wakeups : 0.0, stats->sleepMax / 1000.0,
+    last ? "" : ",");
+}
+
+int main(int argc, char* argv[])
+{
+  uint32_t loads = 8;
+  uint32_t hours = 1;
+  uint32_t window = 60;
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if ((strcmp(argv[i], "--loads") == 0) && has_value) {
+      loads = strtoul(argv[++i], nullptr, 10);
+    } else if ((strcmp(argv[i], "--hours") == 0) && has_value) {
+      hours = strtoul(argv[++i], nullptr, 10);
+    } else if ((strcmp(argv[i], "--window") == 0) && has_value) {
+      window = strtoul(argv[++i], nullptr, 10);
+    } else {
+      fprintf(stderr, "Usage: %s [--loads 8] [--hours 1] [--window 60]\n", argv[0]);
+      return 2;
+    };
+  };
+  if ((loads == 0) || (loads > 32) || (hours == 0) || (window == 0)) {
+    fprintf(stderr, "Invalid options\n");
+    return 2;
+  };
+
+  hostTimerVirtual(true);
+  sleep_stats_t normal, low_power;
+  sleepRun(false, loads, hours, window, &normal);
+  sleepRun(true, loads, hours, window, &low_power);
+
+  printf("[\n");
+  sleepPrint("normal", &normal, false);
+  sleepPrint("lowpower", &low_power, true);
+  printf("]\n");
+
+  // The loads keep switching, but wake-ups are shared and no sleep is shorter than a slot
+  bool ok = (low_power.wakeups < normal.wakeups) && (low_power.toggles > 0)
+         && (low_power.sleepMin >= (int64_t)CONFIG_LOADCTRL_LOWPOWER_SLOT * 1000);
+  if (!ok) fprintf(stderr, "Low-power mode does not reduce wake-ups\n");
+  return ok ? 0 : 1;
+}
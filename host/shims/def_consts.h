@@ -0,0 +1,5 @@
+/* 
+   Host build: stand-in for the project-wide constants header
+*/
+
+#pragma once
@@ -0,0 +1,34 @@
+/* 
+   Host build: stand-in for the ESP-IDF header of the same name, levels are kept in memory
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef int gpio_num_t;
+
+typedef enum { 
+  GPIO_MODE_DISABLE = 0,
+  GPIO_MODE_INPUT = 1,
+  GPIO_MODE_OUTPUT = 2, 
+  GPIO_MODE_INPUT_OUTPUT = 3 
+} gpio_mode_t;
+
+#define GPIO_NUM_MAX 64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num);
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode);
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level);
+int gpio_get_level(gpio_num_t gpio_num);
+esp_err_t gpio_hold_en(gpio_num_t gpio_num);
+esp_err_t gpio_hold_dis(gpio_num_t gpio_num);
+
+#ifdef __cplusplus
+}
+#endif
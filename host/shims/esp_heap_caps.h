@@ -0,0 +1,32 @@
+/* 
+   Host build: stand-in for the ESP-IDF header of the same name, backed by glibc mallinfo2()
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+typedef struct { 
+  size_t total_free_bytes; 
+  size_t total_allocated_bytes; 
+  size_t largest_free_block; 
+  size_t minimum_free_bytes; 
+  size_t allocated_blocks; 
+  size_t free_blocks; 
+  size_t total_blocks; 
+} multi_heap_info_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_minimum_free_size(uint32_t caps);
+void heap_caps_get_info(multi_heap_info_t* info, uint32_t caps);
+
+#ifdef __cplusplus
+}
+#endif
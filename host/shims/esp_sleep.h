@@ -0,0 +1,7 @@
+/* 
+   Host build: stand-in for the ESP-IDF header of the same name (light sleep is simulated by advancing the timer clock)
+*/
+
+#pragma once
+
+#include "esp_err.h"
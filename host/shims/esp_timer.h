@@ -0,0 +1,41 @@
+/* 
+   Host build: stand-in for the ESP-IDF header of the same name
+   Timer callbacks are dispatched by hostTimerAdvance() / hostTimerProcess() in the calling thread (see host_shims.h)
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef struct esp_timer* esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void* arg);
+
+typedef enum { 
+  ESP_TIMER_TASK 
+} esp_timer_dispatch_t;
+
+typedef struct { 
+  esp_timer_cb_t callback; 
+  void* arg; 
+  esp_timer_dispatch_t dispatch_method; 
+  const char* name; 
+  bool skip_unhandled_events; 
+} esp_timer_create_args_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+bool esp_timer_is_active(esp_timer_handle_t timer);
+int64_t esp_timer_get_time(void);
+
+#ifdef __cplusplus
+}
+#endif
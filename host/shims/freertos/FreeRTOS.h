@@ -0,0 +1,39 @@
+/* 
+   Host build: stand-in for the FreeRTOS header of the same name (host_rtos.cpp), one tick is one millisecond
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+typedef int BaseType_t; 
+typedef unsigned int UBaseType_t; 
+typedef uint32_t TickType_t;
+
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+#define portMAX_DELAY           (TickType_t)0xffffffffUL
+#define portTICK_PERIOD_MS      1
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms))
+
+// Critical sections of all spinlocks are served by one host mutex (they disable the scheduler on the target anyway)
+typedef struct { 
+  uint32_t owner; 
+  uint32_t count; 
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0, 0 }
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void portMUX_INITIALIZE(portMUX_TYPE* mux);
+void portENTER_CRITICAL(portMUX_TYPE* mux);
+void portEXIT_CRITICAL(portMUX_TYPE* mux);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,23 @@
+/* 
+   Host build: stand-in for the FreeRTOS header of the same name, tasks are detached threads
+*/
+
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct HostTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* arg);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+BaseType_t xTaskCreate(TaskFunction_t task_code, const char* name, uint32_t stack_depth, void* arg, UBaseType_t priority, TaskHandle_t* created_task);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+#ifdef __cplusplus
+}
+#endif
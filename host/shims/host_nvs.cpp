@@ -0,0 +1,340 @@
+/*
+   Host build: NVS simulated in memory
+   Keeps the limits of the target that matter for the library: 15-character names, typed entries, read-only handles.
+   A flash model counts what the target would write: pages of 126 entries of 32 bytes filled like a log,
+   a changed value is written anew and its old entries are marked erased, one page is kept free for
+   the garbage collection, which moves the live entries of the most erased page and erases that page.
+*/
+
+#include "nvs.h"
+#include "reNvs.h"
+#include "host_shims.h"
+#include <string.h>
+#include <mutex>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#define HOST_NVS_PAGES 6                        // Pages in the default partition of 0x6000 bytes
+#define HOST_NVS_PAGE_ENTRIES 126               // Entries in a page of 4096 bytes
+#define HOST_NVS_ENTRY_SIZE 32
+
+typedef enum {
+  HOST_NVS_U32,
+  HOST_NVS_U64,
+  HOST_NVS_BLOB
+} host_nvs_type_t;
+
+typedef struct {
+  host_nvs_type_t type;
+  std::vector<uint8_t> data;
+} host_nvs_entry_t;
+
+typedef std::map<std::string, host_nvs_entry_t> host_nvs_space_t;
+
+typedef struct {
+  std::string space;
+  nvs_open_mode_t mode;
+} host_nvs_handle_t;
+
+static std::mutex _nvsLock;
+static std::map<std::string, host_nvs_space_t> _nvsData;
+static std::map<nvs_handle_t, host_nvs_handle_t> _nvsHandles;
+static nvs_handle_t _nvsNextHandle = 1;
+static host_nvs_stats_t _nvsStats;
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ----------------------------------------------------- Flash model -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+typedef struct {
+  uint32_t used;                                // Entries written since the last erase
+  uint32_t live;                                // Entries holding current values
+  uint32_t erases;                              // Erase cycles
+} host_nvs_page_t;
+
+typedef struct {
+  uint32_t page;
+  uint32_t entries;
+} host_nvs_place_t;
+
+static std::vector<host_nvs_page_t> _flashPages(HOST_NVS_PAGES);
+static std::deque<uint32_t> _flashFree;         // Erased pages, in the order they are taken
+static uint32_t _flashActive = 0;
+// Namespace + '/' + key, or '/' + namespace for the namespace entry
+static std::map<std::string, host_nvs_place_t> _flashPlaced;
+
+static void hostFlashReset(uint32_t pages)
+{
+  _flashPages.assign(pages, host_nvs_page_t{0, 0, 0});
+  _flashFree.clear();
+  for (uint32_t i = 1; i < pages; i++) {
+    _flashFree.push_back(i);
+  };
+  _flashActive = 0;
+  _flashPlaced.clear();
+}
+
+static void hostFlashRemove(const std::string& id)
+{
+  auto placed = _flashPlaced.find(id);
+  if (placed != _flashPlaced.end()) {
+    _flashPages[placed->second.page].live -= placed->second.entries;
+    _flashPlaced.erase(placed);
+  };
+}
+
+// Takes the next free page as active, collects garbage when only the reserved page is left
+static bool hostFlashNextPage()
+{
+  if (_flashFree.size() > 1) {
+    _flashActive = _flashFree.front();
+    _flashFree.pop_front();
+    return true;
+  };
+  if (_flashFree.empty()) return false;
+  uint32_t victim = UINT32_MAX;
+  for (uint32_t i = 0; i < _flashPages.size(); i++) {
+    host_nvs_page_t& page = _flashPages[i];
+    if ((page.used > 0) && ((victim == UINT32_MAX)
+     || (page.used - page.live > _flashPages[victim].used - _flashPages[victim].live))) {
+      victim = i;
+    };
+  };
+  if ((victim == UINT32_MAX) || (_flashPages[victim].used == _flashPages[victim].live)) return false;
+  _flashActive = _flashFree.front();
+  _flashFree.pop_front();
+  host_nvs_page_t& active = _flashPages[_flashActive];
+  for (auto& placed: _flashPlaced) {
+    if (placed.second.page == victim) {
+      placed.second.page = _flashActive;
+      active.used += placed.second.entries;
+      active.live += placed.second.entries;
+      _nvsStats.flashEntries += placed.second.entries;
+    };
+  };
+  _flashPages[victim].used = 0;
+  _flashPages[victim].live = 0;
+  _flashPages[victim].erases++;
+  _nvsStats.flashErases++;
+  _flashFree.push_back(victim);
+  return true;
+}
+
+static bool hostFlashWrite(const std::string& id, uint32_t entries)
+{
+  if (entries > HOST_NVS_PAGE_ENTRIES) return false;
+  hostFlashRemove(id);
+  while (_flashPages[_flashActive].used + entries > HOST_NVS_PAGE_ENTRIES) {
+    if (!hostFlashNextPage()) return false;
+  };
+  _flashPages[_flashActive].used += entries;
+  _flashPages[_flashActive].live += entries;
+  _flashPlaced[id] = { _flashActive, entries };
+  _nvsStats.flashEntries += entries;
+  return true;
+}
+
+// Primitive values take one entry, blobs take a header and data entries plus an index entry
+static uint32_t hostFlashEntries(host_nvs_type_t type, size_t length)
+{
+  return type == HOST_NVS_BLOB ? 2 + (uint32_t)((length + HOST_NVS_ENTRY_SIZE - 1) / HOST_NVS_ENTRY_SIZE) : 1;
+}
+
+static bool hostNvsNameValid(const char* name)
+{
+  return name && (strlen(name) > 0) && (strlen(name) < NVS_KEY_NAME_MAX_SIZE);
+}
+
+// Checks the handle and the key, returns the namespace
+static esp_err_t hostNvsSpace(nvs_handle_t handle, const char* key, bool write, host_nvs_space_t** space)
+{
+  auto h = _nvsHandles.find(handle);
+  if (h == _nvsHandles.end()) return ESP_ERR_NVS_INVALID_HANDLE;
+  if (write && (h->second.mode == NVS_READONLY)) return ESP_ERR_NVS_READ_ONLY;
+  if (key) {
+    if (strlen(key) == 0) return ESP_ERR_NVS_INVALID_NAME;
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) return ESP_ERR_NVS_KEY_TOO_LONG;
+  };
+  *space = &_nvsData[h->second.space];
+  return ESP_OK;
+}
+
+static esp_err_t hostNvsSet(nvs_handle_t handle, const char* key, host_nvs_type_t type, const void* value, size_t length)
+{
+  std::lock_guard<std::mutex> guard(_nvsLock);
+  host_nvs_space_t* space;
+  esp_err_t err = hostNvsSpace(handle, key, true, &space);
+  if (err != ESP_OK) return err;
+  const uint8_t* data = (const uint8_t*)value;
+  auto found = space->find(key);
+  // Like on the target: an unchanged value is not written to flash again
+  bool same = (found != space->end()) && (found->second.type == type)
+           && (found->second.data.size() == length) && (memcmp(found->second.data.data(), data, length) == 0);
+  if (!same && !hostFlashWrite(_nvsHandles[handle].space + "/" + key, hostFlashEntries(type, length))) {
+    return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+  };
+  host_nvs_entry_t& entry = (*space)[key];
+  entry.type = type;
+  entry.data.assign(data, data + length);
+  _nvsStats.writes++;
+  _nvsStats.bytes += length;
+  return ESP_OK;
+}
+
+static esp_err_t hostNvsGet(nvs_handle_t handle, const char* key, host_nvs_type_t type, void* value, size_t* length)
+{
+  std::lock_guard<std::mutex> guard(_nvsLock);
+  host_nvs_space_t* space;
+  esp_err_t err = hostNvsSpace(handle, key, false, &space);
+  if (err != ESP_OK) return err;
+  auto entry = space->find(key);
+  if (entry == space->end()) return ESP_ERR_NVS_NOT_FOUND;
+  if (entry->second.type != type) return ESP_ERR_NVS_TYPE_MISMATCH;
+  if (type == HOST_NVS_BLOB) {
+    // Like on the target: without a buffer only the length is returned, a short buffer is an error
+    if (value == nullptr) {
+      *length = entry->second.data.size();
+      return ESP_OK;
+    };
+    if (*length < entry->second.data.size()) return ESP_ERR_NVS_INVALID_LENGTH;
+    *length = entry->second.data.size();
+  };
+  memcpy(value, entry->second.data.data(), entry->second.data.size());
+  return ESP_OK;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------------- NVS ---------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+esp_err_t nvs_open(const char* namespace_name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle)
+{
+  if (!hostNvsNameValid(namespace_name)) return ESP_ERR_NVS_INVALID_NAME;
+  std::lock_guard<std::mutex> guard(_nvsLock);
+  if (_nvsData.find(namespace_name) == _nvsData.end()) {
+    if (open_mode == NVS_READONLY) return ESP_ERR_NVS_NOT_FOUND;
+    // A new namespace takes an entry of its own
+    if (!hostFlashWrite(std::string("/") + namespace_name, 1)) return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+  };
+  _nvsData[namespace_name];
+  *out_handle = _nvsNextHandle++;
+  _nvsHandles[*out_handle] = { namespace_name, open_mode };
+  return ESP_OK;
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char* key, uint32_t* out_value)
+{
+  return hostNvsGet(handle, key, HOST_NVS_U32, out_value, nullptr);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char* key, uint32_t value)
+{
+  return hostNvsSet(handle, key, HOST_NVS_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u64(nvs_handle_t handle, const char* key, uint64_t* out_value)
+{
+  return hostNvsGet(handle, key, HOST_NVS_U64, out_value, nullptr);
+}
+
+esp_err_t nvs_set_u64(nvs_handle_t handle, const char* key, uint64_t value)
+{
+  return hostNvsSet(handle, key, HOST_NVS_U64, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length)
+{
+  if (length == nullptr) return ESP_ERR_INVALID_ARG;
+  return hostNvsGet(handle, key, HOST_NVS_BLOB, out_value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length)
+{
+  return hostNvsSet(handle, key, HOST_NVS_BLOB, value, length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key)
+{
+  std::lock_guard<std::mutex> guard(_nvsLock);
+  host_nvs_space_t* space;
+  esp_err_t err = hostNvsSpace(handle, key, true, &space);
+  if (err != ESP_OK) return err;
+  if (space->erase(key) == 0) return ESP_ERR_NVS_NOT_FOUND;
+  hostFlashRemove(_nvsHandles[handle].space + "/" + key);
+  _nvsStats.writes++;
+  return ESP_OK;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+  std::lock_guard<std::mutex> guard(_nvsLock);
+  host_nvs_space_t* space;
+  esp_err_t err = hostNvsSpace(handle, nullptr, true, &space);
+  if (err != ESP_OK) return err;
+  for (auto& entry: *space) {
+    hostFlashRemove(_nvsHandles[handle].space + "/" + entry.first);
+  };
+  space->clear();
+  _nvsStats.writes++;
+  return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+  std::lock_guard<std::mutex> guard(_nvsLock);
+  if (_nvsHandles.find(handle) == _nvsHandles.end()) return ESP_ERR_NVS_INVALID_HANDLE;
+  _nvsStats.commits++;
+  return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+  std::lock_guard<std::mutex> guard(_nvsLock);
+  _nvsHandles.erase(handle);
+}
+
+bool nvsOpen(const char* name_group, nvs_open_mode_t open_mode, nvs_handle_t* nvs_handle)
+{
+  return nvs_open(name_group, open_mode, nvs_handle) == ESP_OK;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ----------------------------------------------------- Host control ----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+void hostNvsClear(void)
+{
+  std::lock_guard<std::mutex> guard(_nvsLock);
+  _nvsData.clear();
+  memset(&_nvsStats, 0, sizeof(_nvsStats));
+  hostFlashReset((uint32_t)_flashPages.size());
+}
+
+void hostNvsPages(uint32_t pages)
+{
+  std::lock_guard<std::mutex> guard(_nvsLock);
+  _nvsData.clear();
+  memset(&_nvsStats, 0, sizeof(_nvsStats));
+  hostFlashReset(pages < 2 ? 2 : pages);
+}
+
+uint32_t hostNvsErases(uint32_t* erases, uint32_t count)
+{
+  std::lock_guard<std::mutex> guard(_nvsLock);
+  for (uint32_t i = 0; (i < count) && (i < _flashPages.size()); i++) {
+    erases[i] = _flashPages[i].erases;
+  };
+  return (uint32_t)_flashPages.size();
+}
+
+void hostNvsStats(host_nvs_stats_t* stats)
+{
+  std::lock_guard<std::mutex> guard(_nvsLock);
+  *stats = _nvsStats;
+  stats->entries = 0;
+  for (auto& space: _nvsData) {
+    stats->entries += space.second.size();
+  };
+}
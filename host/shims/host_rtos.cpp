@@ -0,0 +1,242 @@
+/*
+   Host build: FreeRTOS primitives used by the library on std::thread
+*/
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <string.h>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+// Waits on the condition for the given number of ticks (one tick = 1 ms), forever for portMAX_DELAY
+template <typename Predicate>
+static bool hostWait(std::condition_variable& cv, std::unique_lock<std::mutex>& lock, TickType_t ticks, Predicate ready)
+{
+  if (ticks == portMAX_DELAY) {
+    cv.wait(lock, ready);
+    return true;
+  };
+  return cv.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------- Critical sections --------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static std::recursive_mutex _hostCritical;
+
+void portMUX_INITIALIZE(portMUX_TYPE* mux)
+{
+  mux->owner = 0;
+  mux->count = 0;
+}
+
+void portENTER_CRITICAL(portMUX_TYPE* mux)
+{
+  _hostCritical.lock();
+  mux->count++;
+}
+
+void portEXIT_CRITICAL(portMUX_TYPE* mux)
+{
+  mux->count--;
+  _hostCritical.unlock();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- Queues --------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+struct QueueDefinition {
+  std::mutex lock;
+  std::condition_variable changed;
+  std::deque<std::vector<uint8_t>> items;
+  UBaseType_t length;
+  UBaseType_t item_size;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+  QueueDefinition* queue = new QueueDefinition();
+  queue->length = length;
+  queue->item_size = item_size;
+  return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks_to_wait)
+{
+  std::unique_lock<std::mutex> lock(queue->lock);
+  if (!hostWait(queue->changed, lock, ticks_to_wait, [queue] { return queue->items.size() < queue->length; })) {
+    return pdFALSE;
+  };
+  const uint8_t* data = (const uint8_t*)item;
+  queue->items.emplace_back(data, data + queue->item_size);
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* buffer, TickType_t ticks_to_wait)
+{
+  std::unique_lock<std::mutex> lock(queue->lock);
+  if (!hostWait(queue->changed, lock, ticks_to_wait, [queue] { return !queue->items.empty(); })) {
+    return pdFALSE;
+  };
+  memcpy(buffer, queue->items.front().data(), queue->item_size);
+  queue->items.pop_front();
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+  std::lock_guard<std::mutex> lock(queue->lock);
+  return (UBaseType_t)queue->items.size();
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+  delete queue;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ----------------------------------------------------- Semaphores ------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+struct HostSemaphore {
+  std::mutex lock;
+  std::condition_variable changed;
+  uint32_t count;
+  // Recursive mutex
+  bool recursive;
+  std::thread::id owner;
+  uint32_t depth;
+};
+
+static SemaphoreHandle_t hostSemaphoreCreate(uint32_t count, bool recursive)
+{
+  HostSemaphore* sem = new HostSemaphore();
+  sem->count = count;
+  sem->recursive = recursive;
+  sem->depth = 0;
+  return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+  return hostSemaphoreCreate(0, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+  return hostSemaphoreCreate(1, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+  return hostSemaphoreCreate(1, true);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks_to_wait)
+{
+  std::unique_lock<std::mutex> lock(sem->lock);
+  if (!hostWait(sem->changed, lock, ticks_to_wait, [sem] { return sem->count > 0; })) {
+    return pdFALSE;
+  };
+  sem->count--;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+  std::lock_guard<std::mutex> lock(sem->lock);
+  if (sem->count > 0) return pdFALSE;
+  sem->count++;
+  sem->changed.notify_one();
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t mutex, TickType_t ticks_to_wait)
+{
+  std::unique_lock<std::mutex> lock(mutex->lock);
+  std::thread::id self = std::this_thread::get_id();
+  if ((mutex->depth > 0) && (mutex->owner == self)) {
+    mutex->depth++;
+    return pdTRUE;
+  };
+  if (!hostWait(mutex->changed, lock, ticks_to_wait, [mutex] { return mutex->depth == 0; })) {
+    return pdFALSE;
+  };
+  mutex->owner = self;
+  mutex->depth = 1;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t mutex)
+{
+  std::lock_guard<std::mutex> lock(mutex->lock);
+  if ((mutex->depth == 0) || (mutex->owner != std::this_thread::get_id())) return pdFALSE;
+  if (--mutex->depth == 0) {
+    mutex->owner = std::thread::id();
+    mutex->changed.notify_one();
+  };
+  return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+  delete sem;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Tasks --------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+struct HostTask {
+  TaskFunction_t code;
+  void* arg;
+};
+
+// Thrown by vTaskDelete(nullptr) to leave the task function, as the task never returns on the target
+struct HostTaskExit {};
+
+static HostTask _hostMainTask = { nullptr, nullptr };
+static thread_local HostTask* _hostCurrentTask = &_hostMainTask;
+
+BaseType_t xTaskCreate(TaskFunction_t task_code, const char* name, uint32_t stack_depth, void* arg, UBaseType_t priority, TaskHandle_t* created_task)
+{
+  HostTask* task = new HostTask{task_code, arg};
+  if (created_task) *created_task = task;
+  std::thread([task] {
+    _hostCurrentTask = task;
+    try {
+      task->code(task->arg);
+    } catch (HostTaskExit&) {
+    };
+    delete task;
+  }).detach();
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+  // Only self-deletion is supported: a thread cannot be stopped from outside
+  if ((task == nullptr) || (task == _hostCurrentTask)) {
+    throw HostTaskExit();
+  };
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+  return _hostCurrentTask;
+}
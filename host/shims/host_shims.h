@@ -0,0 +1,54 @@
+/* 
+   Host build: control of the simulated ESP-IDF environment from the host programs
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ---------------------------------------------------------------- esp_timer
+// Real clock (default): esp_timer_get_time() follows CLOCK_MONOTONIC, due timers are fired by hostTimerProcess()
+// Virtual clock: time stands still and moves only by hostTimerAdvance(), which fires the timers in deadline order
+void hostTimerVirtual(bool enabled);
+// Advances the clock by the given number of microseconds, firing every timer that becomes due; returns fired callbacks
+uint32_t hostTimerAdvance(int64_t us);
+// Fires the timers that are already due; returns fired callbacks
+uint32_t hostTimerProcess(void);
+// Deadline of the nearest active timer, us since boot, or -1 if none is active
+int64_t hostTimerNext(void);
+// Active timers
+uint32_t hostTimerActive(void);
+
+// ---------------------------------------------------------------- NVS
+// Simulated NVS statistics since the last hostNvsClear()
+typedef struct {
+  uint32_t writes;                              // Successful set/erase operations
+  uint64_t bytes;                               // Data written by set operations, bytes
+  uint32_t commits;                             // nvs_commit() calls
+  uint32_t entries;                             // Keys currently stored
+  uint64_t flashEntries;                        // 32-byte entries written to flash, moves by the garbage collection included
+  uint32_t flashErases;                         // Page erases by the garbage collection
+} host_nvs_stats_t;
+
+// Removes all namespaces and resets the statistics
+void hostNvsClear(void);
+void hostNvsStats(host_nvs_stats_t* stats);
+// Size of the simulated partition in 4096-byte pages (6 by default); clears the NVS
+void hostNvsPages(uint32_t pages);
+// Erase cycles of every page; returns the number of pages
+uint32_t hostNvsErases(uint32_t* erases, uint32_t count);
+
+// ---------------------------------------------------------------- GPIO
+// Level last written to the pin, -1 if the pin was never set
+int hostGpioLevel(int pin);
+bool hostGpioHeld(int pin);
+
+#ifdef __cplusplus
+}
+#endif
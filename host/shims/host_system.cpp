@@ -0,0 +1,267 @@
+/*
+   Host build: GPIO, heap, CRC and the string helpers of the support libraries
+*/
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "driver/gpio.h"
+#include "host_shims.h"
+#include "rStrings.h"
+#include "reMqtt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <malloc.h>
+#include <atomic>
+
+// Heap size reported by heap_caps_get_free_size(): large enough for thousands of controllers, unlike the target
+#define HOST_HEAP_SIZE (64 * 1024 * 1024)
+
+const char* esp_err_to_name(esp_err_t code)
+{
+  switch (code) {
+    case ESP_OK:                return "ESP_OK";
+    case ESP_FAIL:              return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:   return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:  return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:     return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:       return "ESP_ERR_TIMEOUT";
+    default:                    return "UNKNOWN ERROR";
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------------- GPIO --------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static int _gpioLevel[GPIO_NUM_MAX];
+static bool _gpioHold[GPIO_NUM_MAX];
+static bool _gpioInit = false;
+
+static bool hostGpioCheck(gpio_num_t gpio_num)
+{
+  if (!_gpioInit) {
+    for (int i = 0; i < GPIO_NUM_MAX; i++) _gpioLevel[i] = -1;
+    _gpioInit = true;
+  };
+  return (gpio_num >= 0) && (gpio_num < GPIO_NUM_MAX);
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num)
+{
+  if (!hostGpioCheck(gpio_num)) return ESP_ERR_INVALID_ARG;
+  _gpioLevel[gpio_num] = -1;
+  _gpioHold[gpio_num] = false;
+  return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+  return hostGpioCheck(gpio_num) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+  if (!hostGpioCheck(gpio_num)) return ESP_ERR_INVALID_ARG;
+  // A held pin keeps its level, as on the target
+  if (!_gpioHold[gpio_num]) _gpioLevel[gpio_num] = level ? 1 : 0;
+  return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+  if (!hostGpioCheck(gpio_num)) return 0;
+  return _gpioLevel[gpio_num] > 0 ? 1 : 0;
+}
+
+esp_err_t gpio_hold_en(gpio_num_t gpio_num)
+{
+  if (!hostGpioCheck(gpio_num)) return ESP_ERR_INVALID_ARG;
+  _gpioHold[gpio_num] = true;
+  return ESP_OK;
+}
+
+esp_err_t gpio_hold_dis(gpio_num_t gpio_num)
+{
+  if (!hostGpioCheck(gpio_num)) return ESP_ERR_INVALID_ARG;
+  _gpioHold[gpio_num] = false;
+  return ESP_OK;
+}
+
+int hostGpioLevel(int pin)
+{
+  return hostGpioCheck(pin) ? _gpioLevel[pin] : -1;
+}
+
+bool hostGpioHeld(int pin)
+{
+  return hostGpioCheck(pin) && _gpioHold[pin];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------------- Heap --------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// glibc does not count allocated blocks, so the allocator entry points are wrapped
+static std::atomic<size_t> _heapBlocks(0);
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+
+void* malloc(size_t size)
+{
+  void* ret = __libc_malloc(size);
+  if (ret) _heapBlocks++;
+  return ret;
+}
+
+void* calloc(size_t count, size_t size)
+{
+  void* ret = __libc_calloc(count, size);
+  if (ret) _heapBlocks++;
+  return ret;
+}
+
+void* realloc(void* ptr, size_t size)
+{
+  if ((ptr != nullptr) && (size == 0)) {
+    free(ptr);
+    return nullptr;
+  };
+  void* ret = __libc_realloc(ptr, size);
+  if (ret && (ptr == nullptr)) _heapBlocks++;
+  return ret;
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+  void* ret = __libc_memalign(alignment, size);
+  if (ret) _heapBlocks++;
+  return ret;
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+  return memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+  *ptr = memalign(alignment, size);
+  return *ptr ? 0 : 12; // ENOMEM
+}
+
+void free(void* ptr)
+{
+  if (ptr) {
+    _heapBlocks--;
+    __libc_free(ptr);
+  };
+}
+
+} // extern "C"
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks < HOST_HEAP_SIZE ? HOST_HEAP_SIZE - info.uordblks : 0;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+  return heap_caps_get_free_size(caps);
+}
+
+void heap_caps_get_info(multi_heap_info_t* info, uint32_t caps)
+{
+  struct mallinfo2 mi = mallinfo2();
+  memset(info, 0, sizeof(multi_heap_info_t));
+  info->total_allocated_bytes = mi.uordblks;
+  info->total_free_bytes = heap_caps_get_free_size(caps);
+  info->largest_free_block = info->total_free_bytes;
+  info->minimum_free_bytes = info->total_free_bytes;
+  info->allocated_blocks = _heapBlocks;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------------- CRC ---------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const* buf, uint32_t len)
+{
+  // CRC-32 (IEEE 802.3), reflected, with the same pre- and post-inversion as the ROM function
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; i++) {
+    crc ^= buf[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    };
+  };
+  return ~crc;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- Strings -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+char* malloc_string(const char* source)
+{
+  return source ? strdup(source) : nullptr;
+}
+
+char* malloc_stringf(const char* format, ...)
+{
+  char* ret = nullptr;
+  va_list args;
+  va_start(args, format);
+  if (vasprintf(&ret, format, args) < 0) ret = nullptr;
+  va_end(args);
+  return ret;
+}
+
+char* concat_strings(char* str1, char* str2)
+{
+  if (str1 == nullptr) return str2;
+  if (str2 == nullptr) return str1;
+  char* ret = malloc_stringf("%s%s", str1, str2);
+  free(str1);
+  free(str2);
+  return ret;
+}
+
+char* malloc_timespan_hms(time_t value)
+{
+  return malloc_stringf("%.2d:%.2d:%.2d", (int)(value / 3600), (int)(value % 3600 / 60), (int)(value % 60));
+}
+
+void time2str_empty(const char* format, time_t* value, char* buffer, size_t buffer_size)
+{
+  memset(buffer, 0, buffer_size);
+  if (*value > 0) {
+    struct tm tm_value;
+    localtime_r(value, &tm_value);
+    strftime(buffer, buffer_size, format, &tm_value);
+  };
+}
+
+char* mqttGetTopicDevice(bool primary, bool local, const char* topic1, const char* topic2, const char* topic3)
+{
+  char* ret = malloc_string("host");
+  const char* segments[] = { topic1, topic2, topic3 };
+  for (const char* segment: segments) {
+    if (segment) {
+      ret = concat_strings(ret, malloc_stringf("/%s", segment));
+    };
+  };
+  return ret;
+}
@@ -0,0 +1,205 @@
+/*
+   Host build: esp_timer on a switchable real / virtual clock
+   Callbacks are called in the thread that advances or processes the clock, which plays the role of the esp_timer task
+*/
+
+#include "esp_timer.h"
+#include "host_shims.h"
+#include <time.h>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+struct esp_timer {
+  esp_timer_cb_t callback;
+  void* arg;
+  const char* name;
+  int64_t deadline;
+  uint64_t period;
+  bool active;
+};
+
+static std::mutex _timerLock;
+static std::vector<esp_timer*> _timers;
+static bool _timerVirtual = false;
+// The clock starts one second after "boot", so that zero is never a valid timestamp
+static int64_t _timerOffset = 1000000;
+static int64_t _timerReal0 = -1;
+
+static int64_t hostTimerReal()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  int64_t now = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  if (_timerReal0 < 0) _timerReal0 = now;
+  return now - _timerReal0;
+}
+
+static int64_t hostTimerNow()
+{
+  return _timerVirtual ? _timerOffset : _timerOffset + hostTimerReal();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ esp_timer ------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle)
+{
+  if ((create_args == nullptr) || (create_args->callback == nullptr) || (out_handle == nullptr)) return ESP_ERR_INVALID_ARG;
+  esp_timer* timer = new esp_timer{create_args->callback, create_args->arg, create_args->name, 0, 0, false};
+  std::lock_guard<std::mutex> guard(_timerLock);
+  _timers.push_back(timer);
+  *out_handle = timer;
+  return ESP_OK;
+}
+
+static esp_err_t hostTimerStart(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period)
+{
+  if (timer == nullptr) return ESP_ERR_INVALID_ARG;
+  std::lock_guard<std::mutex> guard(_timerLock);
+  if (timer->active) return ESP_ERR_INVALID_STATE;
+  timer->deadline = hostTimerNow() + (int64_t)timeout_us;
+  timer->period = period;
+  timer->active = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+  return hostTimerStart(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+  if (period == 0) return ESP_ERR_INVALID_ARG;
+  return hostTimerStart(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+  if (timer == nullptr) return ESP_ERR_INVALID_ARG;
+  std::lock_guard<std::mutex> guard(_timerLock);
+  if (!timer->active) return ESP_ERR_INVALID_STATE;
+  timer->active = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+  if (timer == nullptr) return ESP_ERR_INVALID_ARG;
+  std::lock_guard<std::mutex> guard(_timerLock);
+  if (timer->active) return ESP_ERR_INVALID_STATE;
+  _timers.erase(std::remove(_timers.begin(), _timers.end(), timer), _timers.end());
+  delete timer;
+  return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+  if (timer == nullptr) return false;
+  std::lock_guard<std::mutex> guard(_timerLock);
+  return timer->active;
+}
+
+int64_t esp_timer_get_time(void)
+{
+  std::lock_guard<std::mutex> guard(_timerLock);
+  return hostTimerNow();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Dispatch -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Takes the earliest timer due by the limit; the lock is not held while the callback runs, so it may restart or delete its timer
+static bool hostTimerFireNext(int64_t limit)
+{
+  esp_timer_cb_t callback = nullptr;
+  void* arg = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(_timerLock);
+    esp_timer* next = nullptr;
+    for (esp_timer* timer: _timers) {
+      if (timer->active && (timer->deadline <= limit) && ((next == nullptr) || (timer->deadline < next->deadline))) {
+        next = timer;
+      };
+    };
+    if (next == nullptr) return false;
+    if (_timerVirtual && (next->deadline > _timerOffset)) {
+      _timerOffset = next->deadline;
+    };
+    if (next->period > 0) {
+      next->deadline += (int64_t)next->period;
+    } else {
+      next->active = false;
+    };
+    callback = next->callback;
+    arg = next->arg;
+  };
+  callback(arg);
+  return true;
+}
+
+void hostTimerVirtual(bool enabled)
+{
+  std::lock_guard<std::mutex> guard(_timerLock);
+  if (enabled != _timerVirtual) {
+    if (enabled) {
+      _timerOffset = _timerOffset + hostTimerReal();
+    } else {
+      _timerOffset = _timerOffset - hostTimerReal();
+    };
+    _timerVirtual = enabled;
+  };
+}
+
+uint32_t hostTimerAdvance(int64_t us)
+{
+  int64_t target;
+  {
+    std::lock_guard<std::mutex> guard(_timerLock);
+    target = hostTimerNow() + us;
+    if (!_timerVirtual) _timerOffset += us;
+  };
+  uint32_t fired = 0;
+  while (hostTimerFireNext(target)) {
+    fired++;
+  };
+  std::lock_guard<std::mutex> guard(_timerLock);
+  if (_timerVirtual && (_timerOffset < target)) {
+    _timerOffset = target;
+  };
+  return fired;
+}
+
+uint32_t hostTimerProcess(void)
+{
+  uint32_t fired = 0;
+  while (hostTimerFireNext(esp_timer_get_time())) {
+    fired++;
+  };
+  return fired;
+}
+
+int64_t hostTimerNext(void)
+{
+  std::lock_guard<std::mutex> guard(_timerLock);
+  int64_t next = -1;
+  for (esp_timer* timer: _timers) {
+    if (timer->active && ((next < 0) || (timer->deadline < next))) {
+      next = timer->deadline;
+    };
+  };
+  return next;
+}
+
+uint32_t hostTimerActive(void)
+{
+  std::lock_guard<std::mutex> guard(_timerLock);
+  uint32_t count = 0;
+  for (esp_timer* timer: _timers) {
+    if (timer->active) count++;
+  };
+  return count;
+}
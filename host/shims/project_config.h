@@ -0,0 +1,34 @@
+/* 
+   Host build: project configuration for the host targets
+   Feature switches (CONFIG_LOADCTRL_xxx_ENABLED) are set by host/CMakeLists.txt per target
+*/
+
+#pragma once
+
+#define CONFIG_LOADCTRL_TIMESTAMP_ENABLED   1
+#define CONFIG_LOADCTRL_COUNTERS_ENABLED    1
+#define CONFIG_LOADCTRL_DURATIONS_ENABLED   1
+
+#define CONFIG_LOADCTRL_TIMESTAMP_BUF_SIZE  20
+#define CONFIG_LOADCTRL_TIMESTAMP_FORMAT    "%d.%m.%Y %H:%M:%S"
+
+#define CONFIG_LOADCTRL_ON                  "on"
+#define CONFIG_LOADCTRL_OFF                 "off"
+#define CONFIG_LOADCTRL_STATUS              "status"
+#define CONFIG_LOADCTRL_CYCLES              "cycles"
+#define CONFIG_LOADCTRL_TIMESTAMP           "timestamp"
+#define CONFIG_LOADCTRL_DURATIONS           "durations"
+#define CONFIG_LOADCTRL_COUNTERS            "counters"
+#define CONFIG_LOADCTRL_LAST                "last"
+#define CONFIG_LOADCTRL_DAYS                "days"
+#define CONFIG_LOADCTRL_TOTAL               "total"
+#define CONFIG_LOADCTRL_TODAY               "today"
+#define CONFIG_LOADCTRL_YESTERDAY           "yesterday"
+#define CONFIG_LOADCTRL_WEEK_CURR           "week"
+#define CONFIG_LOADCTRL_WEEK_PREV           "week_prev"
+#define CONFIG_LOADCTRL_MONTH_CURR          "month"
+#define CONFIG_LOADCTRL_MONTH_PREV          "month_prev"
+#define CONFIG_LOADCTRL_PERIOD_CURR         "period"
+#define CONFIG_LOADCTRL_PERIOD_PREV         "period_prev"
+#define CONFIG_LOADCTRL_YEAR_CURR           "year"
+#define CONFIG_LOADCTRL_YEAR_PREV           "year_prev"
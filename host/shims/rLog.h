@@ -0,0 +1,16 @@
+/* 
+   Host build: stand-in for the rLog library header, messages are printed only when LOADCTRL_HOST_LOG is set
+*/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define rlog_host(level, tag, fmt, ...) do { if (getenv("LOADCTRL_HOST_LOG")) fprintf(stderr, level " (%s) " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+
+#define rlog_e(tag, fmt, ...) rlog_host("E", tag, fmt, ##__VA_ARGS__)
+#define rlog_w(tag, fmt, ...) rlog_host("W", tag, fmt, ##__VA_ARGS__)
+#define rlog_i(tag, fmt, ...) rlog_host("I", tag, fmt, ##__VA_ARGS__)
+#define rlog_d(tag, fmt, ...) rlog_host("D", tag, fmt, ##__VA_ARGS__)
+#define rlog_v(tag, fmt, ...) rlog_host("V", tag, fmt, ##__VA_ARGS__)
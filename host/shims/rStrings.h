@@ -0,0 +1,17 @@
+/* 
+   Host build: stand-in for the rStrings library header
+*/
+
+#pragma once
+
+#include <time.h>
+#include <stdint.h>
+#include <stddef.h>
+
+char* malloc_string(const char* source);
+char* malloc_stringf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+// Concatenates the strings into a new one, both arguments are freed
+char* concat_strings(char* str1, char* str2);
+char* malloc_timespan_hms(time_t value);
+// Formats local time, an empty string for zero time
+void time2str_empty(const char* format, time_t* value, char* buffer, size_t buffer_size);
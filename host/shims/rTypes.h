@@ -0,0 +1,13 @@
+/* 
+   Host build: stand-in for the rTypes library header
+*/
+
+#pragma once
+
+typedef enum { 
+  TI_MILLISECONDS = 0, 
+  TI_SECONDS, 
+  TI_MINUTES, 
+  TI_HOURS, 
+  TI_DAYS 
+} timeintv_t;
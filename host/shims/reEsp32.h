@@ -0,0 +1,12 @@
+/* 
+   Host build: stand-in for the reEsp32 library header
+*/
+
+#pragma once
+
+#include <stdlib.h>
+#include "esp_err.h"
+
+#define RE_OK_CHECK(a, action) if ((a) != ESP_OK) { action; };
+#define RE_MEM_CHECK(a, action) if (!(a)) { action; };
+#define RE_ERROR_LOG(a) (a)
@@ -0,0 +1,13 @@
+/* 
+   Host build: stand-in for the reEvents library header (only the time events used by the controllers)
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define RE_TIME_START_OF_DAY    1
+#define RE_TIME_START_OF_WEEK   2
+#define RE_TIME_START_OF_MONTH  3
+#define RE_TIME_START_OF_YEAR   4
+#define RE_TIME_SNTP_SYNC_OK    5
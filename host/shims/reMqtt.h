@@ -0,0 +1,10 @@
+/* 
+   Host build: stand-in for the reMqtt library header
+*/
+
+#pragma once
+
+#include <stdbool.h>
+
+// Topic "host/<topic1>/<topic2>/<topic3>" for the device, the segments may be NULL
+char* mqttGetTopicDevice(bool primary, bool local, const char* topic1, const char* topic2, const char* topic3);
@@ -0,0 +1,10 @@
+/* 
+   Host build: stand-in for the reNvs library header
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include "nvs.h"
+
+bool nvsOpen(const char* name_group, nvs_open_mode_t open_mode, nvs_handle_t* nvs_handle);
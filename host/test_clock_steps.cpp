@@ -0,0 +1,137 @@
+/*
+   Host build: on-interval durations must not depend on steps of the wall clock
+   The monotonic clock is the virtual esp_timer clock, the wall clock is stepped by the test like SNTP does
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "reLoadCtrl.h"
+#include "reEvents.h"
+#include "host_shims.h"
+
+#define SEC 1000000LL
+// 1 March 2024 12:00:00 UTC
+#define WALL_SYNCED 1709294400
+
+static uint32_t _failed = 0;
+static int64_t _wallOffset = 0;                 // Wall clock minus monotonic clock, seconds
+
+#define CHECK(cond, fmt, ...) do { if (!(cond)) { _failed++; printf("FAIL %s:%d: " fmt "\n", __FILE__, __LINE__, ##__VA_ARGS__); } } while (0)
+
+static time_t testWall()
+{
+  return (time_t)(_wallOffset + esp_timer_get_time() / SEC);
+}
+
+// Steps the wall clock to the given time; the controllers are notified as by the SNTP client
+static void wallStep(time_t to, rLoadController* ctrl, bool sync_event)
+{
+  _wallOffset += (int64_t)to - (int64_t)testWall();
+  if (sync_event) ctrl->countersTimeEventHandler(RE_TIME_SNTP_SYNC_OK, nullptr);
+}
+
+static rLoadController* testController()
+{
+  rLoadController* ctrl = new rLoadGpioController(2, 1, false, nullptr);
+  ctrl->loadInit(false);
+  return ctrl;
+}
+
+// The load is turned on before the first synchronization: the wall clock counts from the boot
+static void testFirstSync()
+{
+  _wallOffset = 0;
+  rLoadController* ctrl = testController();
+  hostTimerAdvance(10 * SEC);
+  ctrl->loadSetState(true, false, false);
+  hostTimerAdvance(60 * SEC);
+  wallStep(WALL_SYNCED, ctrl, true);
+  hostTimerAdvance(60 * SEC);
+  ctrl->loadSetState(false, false, false);
+
+  re_load_durations_t dur = ctrl->getDurations();
+  CHECK(dur.durLast == 120, "first sync: durLast %u, expected 120", dur.durLast);
+  CHECK(dur.durToday == 120, "first sync: durToday %u, expected 120", dur.durToday);
+  // The switch-on time is back-attributed by the monotonic clock
+  CHECK(ctrl->getLastOn() == WALL_SYNCED - 60, "first sync: last on %ld, expected %ld", (long)ctrl->getLastOn(), (long)(WALL_SYNCED - 60));
+  CHECK(ctrl->getLastOff() == WALL_SYNCED + 60, "first sync: last off %ld, expected %ld", (long)ctrl->getLastOff(), (long)(WALL_SYNCED + 60));
+  delete ctrl;
+}
+
+// A synchronized clock is corrected backwards while the load is on
+static void testStepBackward()
+{
+  rLoadController* ctrl = testController();
+  wallStep(WALL_SYNCED, ctrl, true);
+  ctrl->loadSetState(true, false, false);
+  hostTimerAdvance(30 * SEC);
+  wallStep(WALL_SYNCED - 3600, ctrl, true);
+  hostTimerAdvance(45 * SEC);
+  ctrl->loadSetState(false, false, false);
+
+  re_load_durations_t dur = ctrl->getDurations();
+  CHECK(dur.durLast == 75, "step backward: durLast %u, expected 75", dur.durLast);
+  CHECK(dur.durTotal == 75, "step backward: durTotal %llu, expected 75", (unsigned long long)dur.durTotal);
+  CHECK(ctrl->getLastOn() == WALL_SYNCED, "step backward: last on %ld, expected %ld", (long)ctrl->getLastOn(), (long)WALL_SYNCED);
+  CHECK(ctrl->getLastOff() == WALL_SYNCED - 3600 + 45, "step backward: last off %ld", (long)ctrl->getLastOff());
+  delete ctrl;
+}
+
+// A synchronized clock jumps forward by a day while the load is on, without a synchronization event (e.g. set by hand)
+static void testStepForward()
+{
+  rLoadController* ctrl = testController();
+  wallStep(WALL_SYNCED, ctrl, true);
+  ctrl->loadSetState(true, false, false);
+  hostTimerAdvance(20 * SEC);
+  wallStep(WALL_SYNCED + 86400, ctrl, false);
+  hostTimerAdvance(20 * SEC);
+  ctrl->loadSetState(false, false, false);
+  // The second interval, after the step
+  ctrl->loadSetState(true, false, false);
+  hostTimerAdvance(5 * SEC);
+  ctrl->loadSetState(false, false, false);
+
+  re_load_durations_t dur = ctrl->getDurations();
+  CHECK(dur.durLast == 5, "step forward: durLast %u, expected 5", dur.durLast);
+  CHECK(dur.durTotal == 45, "step forward: durTotal %llu, expected 45", (unsigned long long)dur.durTotal);
+  re_load_counters_t cnt = ctrl->getCounters();
+  CHECK(cnt.cntTotal == 2, "step forward: cntTotal %llu, expected 2", (unsigned long long)cnt.cntTotal);
+  delete ctrl;
+}
+
+// Several steps in both directions during one interval, the current duration is read while the load is on
+static void testStepsWhileOn()
+{
+  rLoadController* ctrl = testController();
+  wallStep(WALL_SYNCED, ctrl, true);
+  ctrl->loadSetState(true, false, false);
+  static const int32_t steps[] = { 3600, -7200, 59, -1, 86400 * 30, -86400 * 30 };
+  uint32_t expected = 0;
+  for (int32_t step: steps) {
+    hostTimerAdvance(7 * SEC);
+    expected += 7;
+    wallStep(testWall() + step, ctrl, true);
+  };
+  ctrl->loadSetState(false, false, false);
+
+  re_load_durations_t dur = ctrl->getDurations();
+  CHECK(dur.durLast == expected, "steps while on: durLast %u, expected %u", dur.durLast, expected);
+  CHECK(dur.durTotal == expected, "steps while on: durTotal %llu, expected %u", (unsigned long long)dur.durTotal, expected);
+  delete ctrl;
+}
+
+int main()
+{
+  hostTimerVirtual(true);
+  loadClockSet(nullptr, testWall);
+
+  testFirstSync();
+  testStepBackward();
+  testStepForward();
+  testStepsWhileOn();
+
+  loadClockSet(nullptr, nullptr);
+  printf("%s\n", _failed ? "FAILED" : "OK");
+  return _failed ? 1 : 0;
+}
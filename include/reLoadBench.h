@@ -0,0 +1,81 @@
+/*
+   EN: Scalability benchmark of load controllers with a simulated GPIO backend (diagnostics)
+   RU: Нагрузочный тест контроллеров нагрузки с имитацией GPIO (диагностика)
+   --------------------------
+   (с) 2021-2023 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+   --------------------------
+   Страница проекта: https://github.com/kotyara12/reLoadCtrl
+*/
+
+#ifndef __RE_LOADBENCH_H__
+#define __RE_LOADBENCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "project_config.h"
+#include "def_consts.h"
+#include "reLoadCtrl.h"
+
+#if CONFIG_LOADCTRL_BENCHMARK_ENABLED
+
+// Controllers are no longer created when less free heap remains
+#ifndef CONFIG_LOADCTRL_BENCHMARK_HEAP_RESERVE
+#define CONFIG_LOADCTRL_BENCHMARK_HEAP_RESERVE 32768
+#endif // CONFIG_LOADCTRL_BENCHMARK_HEAP_RESERVE
+
+// Version of the JSON report, increases when fields change meaning
+#define LOAD_BENCH_FORMAT         1
+
+// Controllers are placed on simulated 16-pin expanders: the pin number is 8-bit and cannot identify thousands of loads,
+// so each load is identified by its expander and pin in the MQTT topic and by its index in the NVS namespace
+#define LOAD_BENCH_EXPANDER_PINS  16
+
+// Workloads, each operation is applied to a random controller
+typedef enum {
+  LOAD_BENCH_SWITCH = 0,                        // loadSetState(): toggle the state
+  LOAD_BENCH_PULSE,                             // Start of pulse mode, one cycleToggle(), switching off
+  LOAD_BENCH_ROLLOVER,                          // countersTimeEventHandler(): start of day, week, month or year
+  LOAD_BENCH_STORE,                             // countersNvsStore() (only if a namespace is given, writes to flash!)
+  LOAD_BENCH_PUBLISH,                           // mqttPublish() with a callback that only frees the topic and payload
+  LOAD_BENCH_MAX
+} re_load_bench_workload_t;
+
+typedef struct {
+  uint32_t ops;                                 // Performed operations
+  uint64_t time;                                // Total time of operations, us
+  uint32_t p50;                                 // Latency percentiles, us
+  uint32_t p90;
+  uint32_t p99;
+  uint32_t max;
+} re_load_bench_result_t;
+
+typedef struct {
+  uint16_t requested;                           // Requested number of controllers
+  uint16_t loads;                               // Created controllers (less if the heap ran out)
+  uint32_t heap_used;                           // Heap taken by the created controllers, bytes
+  uint32_t heap_blocks;                         // Heap blocks taken by the created controllers
+  uint32_t heap_peak;                           // Maximum heap taken during the run, bytes
+  uint32_t gpio_writes;                         // Writes to the simulated backend
+  re_load_bench_result_t results[LOAD_BENCH_MAX];
+} re_load_bench_report_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Creates controllers, runs all workloads with the given number of operations each and deletes the controllers.
+// Benchmark controllers are temporarily included in the list of all controllers: run it before rLoadController::loadInitAll().
+// Each controller stores its counters to its own namespace: nvs_space followed by 4 hex digits of the index.
+bool loadBenchRun(uint16_t loads, uint32_t ops, uint32_t seed, const char* nvs_space, re_load_bench_report_t* report);
+// Machine-readable report to compare library versions
+char* loadBenchJSON(re_load_bench_report_t* report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONFIG_LOADCTRL_BENCHMARK_ENABLED
+
+#endif // __RE_LOADBENCH_H__
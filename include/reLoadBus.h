@@ -0,0 +1,78 @@
+/*
+   EN: Asynchronous GPIO backend: a worker task that writes load levels to a slow bus (I2C / SPI expanders)
+   RU: Асинхронная запись уровней нагрузок на медленную шину (I2C / SPI расширители) в отдельной задаче
+   --------------------------
+   (с) 2021-2023 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+   --------------------------
+   Страница проекта: https://github.com/kotyara12/reLoadCtrl
+*/
+
+#ifndef __RE_LOADBUS_H__
+#define __RE_LOADBUS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "project_config.h"
+#include "def_consts.h"
+#include "reLoadCtrl.h"
+
+#if CONFIG_LOADCTRL_BUS_ENABLED
+
+#ifndef CONFIG_LOADCTRL_BUS_QUEUE_SIZE
+#define CONFIG_LOADCTRL_BUS_QUEUE_SIZE 32
+#endif // CONFIG_LOADCTRL_BUS_QUEUE_SIZE
+#ifndef CONFIG_LOADCTRL_BUS_STACK_SIZE
+#define CONFIG_LOADCTRL_BUS_STACK_SIZE 3072
+#endif // CONFIG_LOADCTRL_BUS_STACK_SIZE
+
+// Level change request in the worker queue
+typedef struct {
+  rLoadController* ctrl;
+  uint8_t  level;                               // Physical level
+  uint8_t  flags;                               // LOAD_ASYNC_xxx: what to do upon completion
+} re_load_bus_op_t;
+
+// Called before (begin = true) and after (begin = false) each batch of writes, e.g. to take the bus once
+typedef void (*cb_load_bus_batch_t) (void* arg, bool begin);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+class rLoadBusWorker {
+  public:
+    rLoadBusWorker(const char* name, uint8_t priority, cb_load_bus_batch_t cb_batch, void* cb_arg);
+    ~rLoadBusWorker();
+
+    bool start();
+    // Writes and finalizes everything already submitted, then terminates the task
+    void stop();
+    bool submit(rLoadController* ctrl, uint8_t level, uint8_t flags);
+    uint32_t getQueueDepth();
+
+    // Internal task handler
+    void process();
+  private:
+    const char* _name = nullptr;
+    uint8_t     _priority = 0;
+    QueueHandle_t _queue = nullptr;
+    TaskHandle_t _task = nullptr;
+    SemaphoreHandle_t _done = nullptr;           // Given by the task when it has finished
+    volatile bool _stopping = false;
+    cb_load_bus_batch_t _batch = nullptr;
+    void*       _batch_arg = nullptr;
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONFIG_LOADCTRL_BUS_ENABLED
+
+#endif // __RE_LOADBUS_H__
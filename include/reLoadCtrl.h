@@ -21,8 +21,31 @@
 #include "esp_timer.h"
 #include "rTypes.h"
 
+// Wall-clock time is considered valid (synchronized) if it is later than this value
+#define LOAD_TIME_VALID 1000000000
+
+// NVS namespace names are limited to 15 characters; counters use the namespace itself and suffixes ".cnt" / ".dur"
+#define LOAD_NVS_SPACE_MAX        15
+#define LOAD_NVS_SUFFIX_LEN       4
+
+#ifndef CONFIG_LOADCTRL_TOTAL64
+#define CONFIG_LOADCTRL_TOTAL64 "total64"
+#endif // CONFIG_LOADCTRL_TOTAL64
+#ifndef CONFIG_LOADCTRL_OVERFLOW
+#define CONFIG_LOADCTRL_OVERFLOW "overflow"
+#endif // CONFIG_LOADCTRL_OVERFLOW
+
+// Window counters stop at the maximum value instead of wrapping, the flags show which of them have reached it.
+// A flag is cleared when its window starts anew (and its counter is reset), on rollover or on restore from NVS.
+#define LOAD_OVF_DAY              0x01
+#define LOAD_OVF_WEEK             0x02
+#define LOAD_OVF_MONTH            0x04
+#define LOAD_OVF_PERIOD           0x08
+#define LOAD_OVF_YEAR             0x10
+
+// Lifetime total is 64-bit and never wraps
 typedef struct {
-  uint32_t cntTotal       = 0;
+  uint64_t cntTotal       = 0;
   uint32_t cntToday       = 0;
   uint32_t cntYesterday   = 0;
   uint32_t cntWeekCurr    = 0;
@@ -33,12 +56,14 @@ typedef struct {
   uint32_t cntPeriodPrev  = 0;
   uint32_t cntYearCurr    = 0;
   uint32_t cntYearPrev    = 0;
+  uint32_t cntOverflow    = 0;                  // LOAD_OVF_xxx
 } re_load_counters_t;
 
-// Maximum duration for a year: 60 * 60 * 24 * 366 = 31 622 400 = 0x01e28500 < 32bit
+// Maximum duration for a year: 60 * 60 * 24 * 366 = 31 622 400 = 0x01e28500 < 32bit, lifetime total is 64-bit
 typedef struct {
   uint32_t durLast        = 0;
-  uint32_t durTotal       = 0;
+  uint32_t durOverflow    = 0;                  // LOAD_OVF_xxx
+  uint64_t durTotal       = 0;
   uint32_t durToday       = 0;
   uint32_t durYesterday   = 0;
   uint32_t durWeekCurr    = 0;
@@ -51,13 +76,332 @@ typedef struct {
   uint32_t durYearPrev    = 0;
 } re_load_durations_t;
 
+#if CONFIG_LOADCTRL_METRICS_ENABLED
+
+// Timer lateness histogram buckets: < 100 us, < 1 ms, < 10 ms, < 100 ms, < 1 s, >= 1 s
+#define LOAD_METRICS_LATE_BUCKETS 6
+
+// Hot-path statistics of the controller, fixed size, no heap
+typedef struct {
+  uint32_t gpioCount = 0;                       // Writes to GPIO
+  uint32_t gpioFailed = 0;                      // Failed writes to GPIO
+  uint32_t gpioMin = 0;                         // Minimum GPIO write time, us
+  uint32_t gpioMax = 0;                         // Maximum GPIO write time, us
+  uint64_t gpioSum = 0;                         // Total GPIO write time, us
+  uint32_t timerLate[LOAD_METRICS_LATE_BUCKETS] = {0}; // Timer firing lateness histogram
+  uint32_t timerLateMax = 0;                    // Maximum timer firing lateness, us
+  uint32_t cycleRollbacks = 0;                  // Cycle starts rolled back because the timer could not be started
+  uint32_t mqttCount = 0;                       // Publications
+  uint32_t mqttFailed = 0;                      // Failed publications
+  uint32_t verifyMismatch = 0;                  // Read-back level did not match the written level
+  uint32_t verifyRetries = 0;                   // Repeated writes after a mismatch
+  uint32_t verifyFailed = 0;                    // Level could not be set after all retries
+  uint32_t reconcileFixed = 0;                  // Divergences fixed by background reconciliation
+  uint32_t nvsCount = 0;                        // Saving counters to NVS
+  uint32_t nvsMin = 0;                          // Minimum NVS store time, us
+  uint32_t nvsMax = 0;                          // Maximum NVS store time, us
+  uint64_t nvsSum = 0;                          // Total NVS store time, us
+} re_load_metrics_t;
+
+#endif // CONFIG_LOADCTRL_METRICS_ENABLED
+
+#if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+
+// Wake slot of the cycle timers in low-power mode, ms: phases end on a common grid, so that loads switched
+// in the same slot wake the CPU once; each phase is rounded up to a whole number of slots
+#ifndef CONFIG_LOADCTRL_LOWPOWER_SLOT
+#define CONFIG_LOADCTRL_LOWPOWER_SLOT 1000
+#endif // CONFIG_LOADCTRL_LOWPOWER_SLOT
+
+// Wake-up statistics of the controller, to compare the normal and the low-power mode
+typedef struct {
+  uint32_t wakeups = 0;                         // Controller timer callbacks
+  uint32_t wakeupsShared = 0;                   // Callbacks in low-power mode that found the CPU already woken in the same slot
+  uint32_t publishDeferred = 0;                 // Publications postponed to the wake window
+  uint32_t publishBatched = 0;                  // Publications performed in wake windows
+  uint32_t storeDeferred = 0;                   // NVS stores postponed to the wake window
+  uint32_t storeBatched = 0;                    // NVS stores performed in wake windows
+  uint32_t windows = 0;                         // Wake windows that found postponed work for this controller
+} re_load_lowpower_stats_t;
+
+#endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+
+#if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+
+#ifndef CONFIG_LOADCTRL_CHECKPOINT_KEY
+#define CONFIG_LOADCTRL_CHECKPOINT_KEY "chkpt"
+#endif // CONFIG_LOADCTRL_CHECKPOINT_KEY
+
+// Checkpoint of what the last store of counters does not yet cover: a single small NVS blob,
+// so that neither the current on-interval nor the intervals closed since the store are lost on reboot
+typedef struct {
+  uint32_t started;                             // Wall-clock time when the last on-interval began (0 if unknown)
+  uint32_t saved;                               // Wall-clock time of the checkpoint (0 if unknown)
+  uint32_t duration;                            // On-time since the last store of counters, the open interval included, seconds
+  uint32_t last;                                // Duration of the last on-interval at the moment of the checkpoint, seconds
+  uint32_t count;                               // Switch-ons since the last store of counters
+} re_load_checkpoint_t;
+
+#endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+
+#if CONFIG_LOADCTRL_SLOTS_ENABLED
+
+#ifndef CONFIG_LOADCTRL_SLOTS_COUNT
+#define CONFIG_LOADCTRL_SLOTS_COUNT 4
+#endif // CONFIG_LOADCTRL_SLOTS_COUNT
+
+#ifndef CONFIG_LOADCTRL_SLOTS_KEY
+#define CONFIG_LOADCTRL_SLOTS_KEY "snap"
+#endif // CONFIG_LOADCTRL_SLOTS_KEY
+
+// Snapshot of counters in one of the rotating NVS slots: a single blob instead of separate keys.
+// Restore takes the valid slot with the highest sequence number, so a torn write loses at most one interval.
+typedef struct {
+  uint32_t seq;                                 // Sequence number of the store
+  uint32_t days;                                // Day of the store, days since UNIX epoch
+  re_load_counters_t  counters;
+  re_load_durations_t durations;
+  uint32_t crc;                                 // CRC32 of all preceding bytes
+} re_load_snapshot_t;
+
+#endif // CONFIG_LOADCTRL_SLOTS_ENABLED
+
+#if CONFIG_LOADCTRL_WEAR_ENABLED
+
+#ifndef CONFIG_LOADCTRL_WEAR_KEY
+#define CONFIG_LOADCTRL_WEAR_KEY "wear"
+#endif // CONFIG_LOADCTRL_WEAR_KEY
+
+#ifndef CONFIG_LOADCTRL_WEAR
+#define CONFIG_LOADCTRL_WEAR "wear"
+#endif // CONFIG_LOADCTRL_WEAR
+#ifndef CONFIG_LOADCTRL_WEAR_CYCLES
+#define CONFIG_LOADCTRL_WEAR_CYCLES "cycles"
+#endif // CONFIG_LOADCTRL_WEAR_CYCLES
+#ifndef CONFIG_LOADCTRL_WEAR_ON_TIME
+#define CONFIG_LOADCTRL_WEAR_ON_TIME "on_time"
+#endif // CONFIG_LOADCTRL_WEAR_ON_TIME
+#ifndef CONFIG_LOADCTRL_WEAR_REMAINING
+#define CONFIG_LOADCTRL_WEAR_REMAINING "remaining"
+#endif // CONFIG_LOADCTRL_WEAR_REMAINING
+#ifndef CONFIG_LOADCTRL_WEAR_REMAINING_CYCLES
+#define CONFIG_LOADCTRL_WEAR_REMAINING_CYCLES "remaining_cycles"
+#endif // CONFIG_LOADCTRL_WEAR_REMAINING_CYCLES
+#ifndef CONFIG_LOADCTRL_WEAR_REPLACE
+#define CONFIG_LOADCTRL_WEAR_REPLACE "replace"
+#endif // CONFIG_LOADCTRL_WEAR_REPLACE
+
+// What the relay switches: inrush and arcing shorten the contact life compared to a resistive load
+typedef enum {
+  LOAD_WEAR_RESISTIVE = 0,                      // Heaters (x1)
+  LOAD_WEAR_INDUCTIVE,                          // Valves, contactor coils, transformers (x2)
+  LOAD_WEAR_MOTOR,                              // Pumps, fans, compressors (x3)
+  LOAD_WEAR_LAMP                                // Lamps and capacitive power supplies (x5)
+} re_load_wear_type_t;
+
+// Relay life data from the datasheet and the actual load
+typedef struct {
+  uint32_t life_cycles;                         // Electrical life at the rated current on a resistive load, 0 - end of life is not estimated
+  uint32_t life_hours;                          // Life by on-time of the relay, hours, 0 - not used
+  uint16_t rated_current;                       // Rated contact current, mA
+  uint16_t load_current;                        // Actual load current, mA (0 - rated current)
+  uint8_t  type;                                // re_load_wear_type_t
+  uint8_t  warn_percent;                        // Replacement is recommended when less than this part of life remains, %
+} re_load_wear_config_t;
+
+// Accumulated wear, stored in NVS together with the counters
+typedef struct {
+  uint64_t cycles;                              // Switching cycles weighted by load type and current, 1/1000 of a rated cycle
+  uint64_t on_time;                             // Total on-time since the relay was installed, seconds
+} re_load_wear_t;
+
+#endif // CONFIG_LOADCTRL_WEAR_ENABLED
+
+#if CONFIG_LOADCTRL_RESTORE_ENABLED
+
+#ifndef CONFIG_LOADCTRL_STATE_KEY
+#define CONFIG_LOADCTRL_STATE_KEY "state"
+#endif // CONFIG_LOADCTRL_STATE_KEY
+
+// Changes of the state made within this time are written to flash with one blob, ms (0 - write immediately)
+#ifndef CONFIG_LOADCTRL_STATE_DELAY
+#define CONFIG_LOADCTRL_STATE_DELAY 3000
+#endif // CONFIG_LOADCTRL_STATE_DELAY
+
+// Load state after reboot, see rLoadController::loadInitAll()
+typedef enum {
+  LOAD_RESTORE_OFF = 0,                         // Always turn off (default)
+  LOAD_RESTORE_LAST,                            // Last commanded state; loads that were on by timer are turned off
+  LOAD_RESTORE_ON,                              // Always turn on
+  LOAD_RESTORE_TIMER                            // Last commanded state, the timer is resumed with the remaining time
+} re_load_restore_t;
+
+// Header of the NVS blob, followed by the records of all controllers in the order of the list of controllers
+typedef struct {
+  uint16_t count;                               // Number of records
+  uint16_t reserved;
+} re_load_state_hdr_t;
+
+// Saved state of one controller
+typedef struct {
+  uint8_t  pin;                                 // Pin number, to check that the list of controllers has not changed
+  uint8_t  state : 1;                           // Last commanded state
+  uint8_t  timer : 1;                           // The load was turned on by timer
+  uint8_t  reserved : 6;
+  uint16_t cycle_count;                         // Switch-on cycle counter in pulse mode
+  uint32_t timer_end;                           // Wall-clock time when the timer expires (0 if unknown)
+  uint32_t timer_left;                          // Remaining timer time at the moment of saving, ms
+} re_load_state_rec_t;
+
+#endif // CONFIG_LOADCTRL_RESTORE_ENABLED
+
+#if CONFIG_LOADCTRL_REPLAY_ENABLED
+// Virtual clock of an offline replay: monotonic time since boot, us, and wall-clock time
+typedef int64_t (*cb_load_clock_mono_t) ();
+typedef time_t (*cb_load_clock_time_t) ();
+#endif // CONFIG_LOADCTRL_REPLAY_ENABLED
+
+// Shared MQTT topic prefix: a single heap string for many controllers, the full topic is assembled at send time
+typedef struct {
+  char* topic = nullptr;
+} re_load_topic_prefix_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Shared MQTT topic prefix
+bool loadTopicPrefixSet(re_load_topic_prefix_t* prefix, char* topic);
+bool loadTopicPrefixCreate(re_load_topic_prefix_t* prefix, bool primary, bool local, const char* topic1, const char* topic2, const char* topic3);
+void loadTopicPrefixFree(re_load_topic_prefix_t* prefix);
+char* loadTopicMake(const char* prefix, const char* suffix, int32_t index);
+
+#if CONFIG_LOADCTRL_REPLAY_ENABLED
+// Replaces the clock of the accounting (durations, timestamps, days of NVS data) of all controllers; nullptr - system clock.
+// Timers, metrics and low-power scheduling always use the system clock.
+void loadClockSet(cb_load_clock_mono_t cb_mono, cb_load_clock_time_t cb_time);
+#endif // CONFIG_LOADCTRL_REPLAY_ENABLED
+
+// Common functions for calculating and storing counters, shared by rLoadController and rLoadGroup
+uint64_t loadCycleDuration(uint32_t value, timeintv_t type);
+void loadMetricsTime(uint32_t* min, uint32_t* max, uint64_t* sum, uint32_t count, uint32_t value);
+void loadCountersIncrement(re_load_counters_t* counters);
+void loadDurationsIncrement(re_load_durations_t* durations, uint32_t duration);
+uint32_t loadMonoDuration(int64_t mono_start, int64_t mono_end);
+time_t loadMonoToTime(int64_t mono);
+void loadDurationsLive(re_load_durations_t* durations, bool state, uint32_t durCurr, re_load_durations_t* live);
+void loadCountersTimeEvent(re_load_counters_t* counters, re_load_durations_t* durations, uint8_t* period_start, int32_t event_id, void* event_data);
+void loadCountersCatchUp(uint32_t daysNvs, uint32_t daysNow, uint8_t* period_start, re_load_counters_t* nvsCnt, re_load_durations_t* nvsDur, re_load_counters_t* counters, re_load_durations_t* durations);
+// slot_seq caches the sequence number of the newest NVS slot between calls (0 - unknown), may be nullptr
+void loadCountersNvsRestore(const char* nvs_space, uint8_t* period_start, re_load_counters_t* counters, re_load_durations_t* durations, uint32_t* slot_seq);
+bool loadCountersNvsStore(const char* nvs_space, re_load_counters_t* counters, re_load_durations_t* durations, uint32_t* slot_seq);
+uint32_t loadCountersNvsStoreSize();
+#if CONFIG_LOADCTRL_WEAR_ENABLED
+uint32_t loadWearWeight(const re_load_wear_config_t* config);
+uint32_t loadWearConsumed(const re_load_wear_config_t* config, const re_load_wear_t* wear);
+bool loadWearNvsStore(const char* nvs_space, re_load_wear_t* wear);
+bool loadWearNvsRestore(const char* nvs_space, re_load_wear_t* wear);
+#endif // CONFIG_LOADCTRL_WEAR_ENABLED
+#if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+bool loadCheckpointStore(const char* nvs_space, re_load_checkpoint_t* checkpoint);
+bool loadCheckpointRestore(const char* nvs_space, re_load_checkpoint_t* checkpoint);
+bool loadCheckpointClear(const char* nvs_space);
+void loadCheckpointFold(re_load_checkpoint_t* checkpoint, re_load_counters_t* counters, re_load_durations_t* durations);
+#endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+char* loadTimestampsJSON(time_t last_on, time_t last_off);
+char* loadCountersJSON(re_load_counters_t* counters);
+char* loadDurationsJSON(re_load_durations_t* durations, bool state, uint32_t durCurr);
+char* loadStatusJSON(bool state, int32_t cycle_count, time_t last_on, time_t last_off, re_load_counters_t* counters, re_load_durations_t* durations, uint32_t durCurr);
+
+#ifdef __cplusplus
+}
+#endif
 
 class rLoadController;
+class rLoadPowerBudget;
+class rLoadBusWorker;
+class rLoadInterlock;
+
+// Why the switch-on was not performed, see rLoadController::getLastReject()
+typedef enum : uint8_t {
+  LOAD_REJECT_NONE = 0,                         // Switching was performed (or submitted to the bus worker)
+  LOAD_REJECT_INTERLOCK,                        // Another load of the interlock group is on
+  LOAD_REJECT_DEADTIME,                         // Delayed: the dead time of the interlock group has not yet expired
+  LOAD_REJECT_POWER,                            // Delayed: queued by the power budget coordinator
+  LOAD_REJECT_GPIO                              // Failed to set GPIO level
+} re_load_reject_t;
+
+// What to do when an asynchronous GPIO write is completed
+#define LOAD_ASYNC_FINALIZE   0x01              // Update state, counters and publish
+#define LOAD_ASYNC_STATE_ON   0x02              // New state of the load
+#define LOAD_ASYNC_PUBLISH    0x04              // Publish after the state change
+#define LOAD_ASYNC_CYCLE      0x08              // Cycle toggle: start the timer for the next phase
+#define LOAD_ASYNC_CYCLE_ON   0x10              // New cycle state
+#define LOAD_ASYNC_RETRY      0x20              // Repeated write after a failed read-back verification
+
+// Work of a switching that is done after the controller lock is released, see rLoadController::deferredRun()
+#define LOAD_DEFER_PUBLISH    0x01              // Publish the state
+#define LOAD_DEFER_CHANGED    0x02              // Call the state change callback and listeners
+#define LOAD_DEFER_STATE      0x04              // Save the state of all controllers
+#define LOAD_DEFER_CHECKPOINT 0x08              // Save the checkpoint
+
+// Number of deferred works collected under the lock; if the queue is full, the work is done under the lock
+#ifndef CONFIG_LOADCTRL_DEFERRED_MAX
+#define CONFIG_LOADCTRL_DEFERRED_MAX 8
+#endif // CONFIG_LOADCTRL_DEFERRED_MAX
+
+typedef struct {
+  rLoadController* ctrl;                        // Load controller
+  uint8_t  work;                                // LOAD_DEFER_*
+  bool     state;                               // New load state
+  uint8_t  source;                              // What caused the change (listeners)
+  uint32_t duration;                            // Duration of the last on-interval, seconds
+  uint32_t time;                                // Wall-clock time of the change
+  int64_t  timestamp;                           // Moment of the change by the monotonic clock, us since boot
+} re_load_deferred_t;
 
 typedef bool (*cb_load_publish_t) (rLoadController *ctrl, char* topic, char* payload, bool free_topic, bool free_payload);
 typedef void (*cb_load_change_t) (rLoadController *ctrl, bool state, time_t duration);
 typedef bool (*cb_load_gpio_init_t) (rLoadController *ctrl, uint8_t pin, uint8_t level_on);
 typedef bool (*cb_load_gpio_change_t) (rLoadController *ctrl, uint8_t pin, uint8_t physical_level);
+typedef bool (*cb_load_gpio_read_t) (rLoadController *ctrl, uint8_t pin, uint8_t* physical_level);
+typedef bool (*cb_load_port_read_t) (void* port_arg, uint32_t* port_levels);
+
+#if CONFIG_LOADCTRL_LISTENERS_ENABLED
+
+#ifndef CONFIG_LOADCTRL_LISTENERS_MAX
+#define CONFIG_LOADCTRL_LISTENERS_MAX 4
+#endif // CONFIG_LOADCTRL_LISTENERS_MAX
+
+// What caused the change of the load state
+typedef enum {
+  LOAD_SOURCE_COMMAND = 0,                      // loadSetState() / loadSetTimer() called by the application
+  LOAD_SOURCE_TIMER,                            // The load was turned off by its timer
+  LOAD_SOURCE_POWER,                            // Delayed switch-on by the power budget coordinator
+  LOAD_SOURCE_RESTORE,                          // State restored after reboot
+  LOAD_SOURCE_VERIFY,                           // The level did not latch, the state is corrected to the actual one
+  LOAD_SOURCE_INTERLOCK                         // Delayed switch-on after the dead time of the interlock group
+} re_load_source_t;
+
+typedef struct {
+  rLoadController* ctrl;                        // Load controller
+  bool     state;                               // New load state
+  uint8_t  source;                              // What caused the change, see re_load_source_t
+  int64_t  timestamp;                           // Moment of the change by the monotonic clock, us since boot
+  time_t   time;                                // Wall-clock time of the change (may be not yet synchronized)
+  uint32_t duration;                            // Duration of the finished on-interval, seconds (when turned off)
+} re_load_event_t;
+
+// Listeners are called in the context that changed the state (often the esp_timer task) after the controller lock
+// is released, so they may switch loads; they should still return quickly
+typedef void (*cb_load_listener_t) (const re_load_event_t* event, void* arg);
+
+typedef struct {
+  cb_load_listener_t cb;
+  void* arg;
+} re_load_listener_t;
+
+#endif // CONFIG_LOADCTRL_LISTENERS_ENABLED
 
 #ifdef __cplusplus
 extern "C" {
@@ -69,12 +413,20 @@ class rLoadController {
       uint32_t* cycle_duration, uint32_t* cycle_interval, timeintv_t cycle_type,
       cb_load_change_t cb_gpio_before, cb_load_change_t cb_gpio_after, cb_load_change_t cb_state_changed, 
       cb_load_publish_t cb_mqtt_publish);
-    ~rLoadController();
+    virtual ~rLoadController();
 
     // Load switching
     bool loadInit(bool init_value);
     bool loadSetState(bool new_state, bool forced, bool publish);
 
+    #if CONFIG_LOADCTRL_RESTORE_ENABLED
+    // Restoring the state after reboot
+    static bool loadInitAll(const char* nvs_space);
+    void setRestorePolicy(re_load_restore_t policy);
+    re_load_restore_t getRestorePolicy();
+    static bool stateNvsStoreAll();
+    #endif // CONFIG_LOADCTRL_RESTORE_ENABLED
+
     // Timers
     bool timerIsActive();
     bool timerStop();
@@ -82,6 +434,7 @@ class rLoadController {
     bool cycleToggle();
 
     // Get current data
+    uint8_t getPin();
     bool getState();
     time_t getLastOn();
     time_t getLastOff();
@@ -89,16 +442,38 @@ class rLoadController {
     char*  getLastDurationStr();
     re_load_counters_t getCounters();
     re_load_durations_t getDurations();
+    re_load_durations_t getDurationsAt(int64_t mono_now);
     char* getTimestampsJSON();
     char* getCountersJSON();
     char* getDurationsJSON();
+    char* getDurationsJSONAt(int64_t mono_now);
     char* getJSON();
 
+    // Live durations of all controllers, calculated from a single clock sample
+    static uint16_t getDurationsAll(re_load_durations_t* buf, uint16_t size);
+    static char* getDurationsJSONAll();
+
+    #if CONFIG_LOADCTRL_METRICS_ENABLED
+    // Hot-path statistics
+    re_load_metrics_t getMetrics();
+    void metricsReset();
+    char* getMetricsJSON();
+    static char* getMetricsJSONAll();
+    #endif // CONFIG_LOADCTRL_METRICS_ENABLED
+
+    // List of all created controllers
+    static rLoadController* getFirst();
+    rLoadController* getNext();
+
     // MQTT
     void mqttSetCallback(cb_load_publish_t cb_publish);
     char* mqttTopicGet();
     bool mqttTopicSet(char* topic);
     bool mqttTopicCreate(bool primary, bool local, const char* topic1, const char* topic2, const char* topic3);
+    #if CONFIG_LOADCTRL_TOPIC_PREFIX_ENABLED
+    bool mqttTopicSetPrefix(re_load_topic_prefix_t* prefix, const char* suffix);
+    #endif // CONFIG_LOADCTRL_TOPIC_PREFIX_ENABLED
+    char* mqttTopicMake();
     void mqttTopicFree();
     bool mqttPublish();
     
@@ -107,46 +482,217 @@ class rLoadController {
     void countersNvsRestore();
     void countersNvsStore();
 
+    #if CONFIG_LOADCTRL_WEAR_ENABLED
+    // Relay wear and remaining life
+    void wearSetConfig(const re_load_wear_config_t* config);
+    void wearReset();
+    re_load_wear_t getWear();
+    uint8_t getWearRemaining();
+    uint32_t getWearRemainingCycles();
+    char* getWearJSON();
+    #endif // CONFIG_LOADCTRL_WEAR_ENABLED
+
+    #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+    // Checkpoints of the current on-interval
+    bool checkpointSetInterval(uint32_t interval_s);
+    bool checkpointStore();
+    void checkpointTimerEnd();
+    #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+
     // Event handlers
     void countersTimeEventHandler(int32_t event_id, void* event_data);
 
     // Other parameters
     void setPeriodStartDay(uint8_t* mday);
     void setCallbacks(cb_load_change_t cb_gpio_before, cb_load_change_t cb_gpio_after, cb_load_change_t cb_state_changed);
+    re_load_reject_t getLastReject();
+    #if CONFIG_LOADCTRL_POWER_ENABLED
+    void setPowerBudget(rLoadPowerBudget* power);
+    rLoadPowerBudget* getPowerBudget();
+    #endif // CONFIG_LOADCTRL_POWER_ENABLED
+    #if CONFIG_LOADCTRL_BUS_ENABLED
+    void setBusWorker(rLoadBusWorker* bus);
+    #endif // CONFIG_LOADCTRL_BUS_ENABLED
+    #if CONFIG_LOADCTRL_INTERLOCK_ENABLED
+    void setInterlock(rLoadInterlock* interlock);
+    rLoadInterlock* getInterlock();
+    #endif // CONFIG_LOADCTRL_INTERLOCK_ENABLED
+
+    #if CONFIG_LOADCTRL_LISTENERS_ENABLED
+    // Change notifications for several subscribers
+    bool listenerAdd(cb_load_listener_t cb, void* arg);
+    bool listenerRemove(cb_load_listener_t cb, void* arg);
+    #endif // CONFIG_LOADCTRL_LISTENERS_ENABLED
+
+    #if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+    // Low-power mode: GPIO levels are held during light sleep, publications and NVS stores wait for the wake window
+    bool setLowPower(bool enabled);
+    bool getLowPower();
+    static uint32_t lowPowerWindow();
+    re_load_lowpower_stats_t getLowPowerStats();
+    char* getLowPowerJSON();
+    #endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+
+    // Internal timer handlers
+    void timerCycleEnd();
+    void timerOnEnd();
+
+    // Internal handler of the work collected under the lock and done after it is released
+    void deferredRun(const re_load_deferred_t* item);
+
+    #if CONFIG_LOADCTRL_BUS_ENABLED
+    // Internal bus worker handler: write the level and complete the change
+    void loadExecuteGPIO(uint8_t phy_level, uint8_t async_flags);
+    #endif // CONFIG_LOADCTRL_BUS_ENABLED
   protected:
     uint8_t     _pin = 0;                       // Pin number
     uint8_t     _level_on = 0x01;               // Output level at which the load is considered to be on
 
+    #if CONFIG_LOADCTRL_METRICS_ENABLED
+    re_load_metrics_t _metrics;                 // Hot-path statistics
+    #endif // CONFIG_LOADCTRL_METRICS_ENABLED
+
+    #if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+    bool        _low_power = false;             // Low-power mode is enabled
+    virtual bool loadHoldGPIO(bool hold);
+    #endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+
     virtual bool loadInitGPIO() = 0;
     virtual bool loadSetStateGPIO(uint8_t physical_level) = 0; 
+
+    #if CONFIG_LOADCTRL_VERIFY_ENABLED
+    // Repeated writes are serialized with the switching: under the lock or by the bus worker
+    bool loadRetryRequest(uint8_t physical_level);
+    virtual void loadRetryGPIO(uint8_t physical_level);
+    void loadVerifyFailed(bool commanded_state);
+    #endif // CONFIG_LOADCTRL_VERIFY_ENABLED
   private:
     bool        _state = false;                 // Current load state
-    time_t      _last_on = 0;                   // The last time the load was turned on
-    time_t      _last_off = 0;                  // Time of last load disconnection
+    bool        _cycle_state = false;           // Current cycle state
+    bool        _timer_free = true;             // Delete the stop timer after the specified time interval has elapsed
+    re_load_reject_t _reject = LOAD_REJECT_NONE; // Result of the last switching request
+    uint32_t    _last_on = 0;                   // The last time the load was turned on
+    uint32_t    _last_off = 0;                  // Time of last load disconnection
+    int32_t     _cycle_count = -1;              // Switch-on cycle counter in pulse mode
+    timeintv_t  _cycle_type = TI_MILLISECONDS;  // Dimensions of cycle time intervals
+    int64_t     _mono_on = 0;                   // Moment of the last switching on by the monotonic clock, us since boot
     uint8_t*    _period_start = nullptr;        // Day of month at the beginning of the billing period (for example, sending meter readings)
     uint32_t*   _cycle_duration = nullptr;      // If this value is set, the load will turn on not constantly, but with pulses with a given duration
     uint32_t*   _cycle_interval = nullptr;      // If this value is set, the load will turn on not constantly, but with pulses with a given interval
-    int32_t     _cycle_count = -1;              // Switch-on cycle counter in pulse mode
-    timeintv_t  _cycle_type = TI_MILLISECONDS;  // Dimensions of cycle time intervals
-    bool        _cycle_state = false;           // Current cycle state
     re_load_counters_t  _counters;              // Counters of the number of load switching
     re_load_durations_t _durations;             // Load operating time counters
     const char* _nvs_space = nullptr;           // Namespace to store counter values 
+    #if CONFIG_LOADCTRL_SLOTS_ENABLED
+    uint32_t    _slot_seq = 0;                  // Sequence number of the newest NVS slot, 0 - not yet known
+    #endif // CONFIG_LOADCTRL_SLOTS_ENABLED
     char*       _mqtt_topic = nullptr;          // MQTT topic
+    #if CONFIG_LOADCTRL_TOPIC_PREFIX_ENABLED
+    re_load_topic_prefix_t* _mqtt_prefix = nullptr; // Shared MQTT topic prefix (used if _mqtt_topic is not set)
+    const char* _mqtt_suffix = nullptr;         // Last segment of the topic, appended to the shared prefix
+    #endif // CONFIG_LOADCTRL_TOPIC_PREFIX_ENABLED
     esp_timer_handle_t _timer_on = nullptr;     // General timer for switching on the load for a specified time interval
     esp_timer_handle_t _timer_cycle = nullptr;  // Timer for cyclic load switching
-    bool        _timer_free = true;             // Delete the stop timer after the specified time interval has elapsed
 
     cb_load_change_t _gpio_before = nullptr;    // Pointer to the callback function to be called before set physical level to GPIO
     cb_load_change_t _gpio_after = nullptr;     // Pointer to the callback function to be called after set physical level to GPIO
     cb_load_change_t _state_changed = nullptr;  // Pointer to the callback function to be called after load switching
     cb_load_publish_t _mqtt_publish = nullptr;  // Pointer to the publish callback function
 
-    bool loadSetStatePriv(bool new_state);
+    #if CONFIG_LOADCTRL_POWER_ENABLED
+    rLoadPowerBudget* _power = nullptr;         // Coordinator through which switch-on requests go
+    bool        _power_granted = false;         // Switch-on has already been granted by the coordinator
+    friend class rLoadPowerBudget;
+    #endif // CONFIG_LOADCTRL_POWER_ENABLED
+
+    #if CONFIG_LOADCTRL_BUS_ENABLED
+    rLoadBusWorker* _bus = nullptr;             // Worker that writes levels asynchronously
+    uint8_t     _bus_pending = 0;               // Switchings submitted to the worker and not yet completed
+    bool        _bus_target = false;            // State after the last submitted switching
+    #endif // CONFIG_LOADCTRL_BUS_ENABLED
+
+    #if CONFIG_LOADCTRL_INTERLOCK_ENABLED
+    rLoadInterlock* _interlock = nullptr;       // Group of loads that must never be on together
+    friend class rLoadInterlock;
+    #endif // CONFIG_LOADCTRL_INTERLOCK_ENABLED
+
+    rLoadController* _next = nullptr;           // Next controller in the list of all controllers
+
+    #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+    esp_timer_handle_t _timer_checkpoint = nullptr; // Periodic timer for checkpoints of the current on-interval
+    uint32_t    _checkpoint_interval = 0;       // Checkpoint interval, seconds, 0 - disabled
+    bool        _checkpoint_saved = false;      // NVS contains a checkpoint that has not yet been covered by countersNvsStore()
+    int64_t     _checkpoint_mono = 0;           // Moment of the last checkpoint, us since boot
+    uint64_t    _checkpoint_dur = 0;            // Total on-time covered by the last store of counters, seconds
+    uint64_t    _checkpoint_cnt = 0;            // Total switch-ons covered by the last store of counters
+    void checkpointStart();
+    void checkpointStop();
+    void checkpointRefresh();
+    #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+
+    #if CONFIG_LOADCTRL_RESTORE_ENABLED || CONFIG_LOADCTRL_METRICS_ENABLED
+    int64_t     _timer_on_deadline = 0;         // Scheduled firing time of the general timer, us since boot
+    #endif // CONFIG_LOADCTRL_RESTORE_ENABLED || CONFIG_LOADCTRL_METRICS_ENABLED
+
+    #if CONFIG_LOADCTRL_WEAR_ENABLED
+    re_load_wear_config_t _wear_config;         // Relay life data
+    re_load_wear_t _wear;                       // Accumulated wear
+    uint32_t    _wear_weight = 1000;            // Wear of one switching cycle, 1/1000 of a rated cycle
+    #endif // CONFIG_LOADCTRL_WEAR_ENABLED
+
+    #if CONFIG_LOADCTRL_LISTENERS_ENABLED
+    re_load_listener_t _listeners[CONFIG_LOADCTRL_LISTENERS_MAX]; // Subscribers to change notifications
+    uint8_t     _source = LOAD_SOURCE_COMMAND;  // Source of the pending change
+    void listenersNotify(const re_load_deferred_t* item);
+    #endif // CONFIG_LOADCTRL_LISTENERS_ENABLED
+
+    #if CONFIG_LOADCTRL_RESTORE_ENABLED
+    re_load_restore_t _restore = LOAD_RESTORE_OFF; // Load state after reboot
+    void stateNvsStoreRequest();
+    void stateGet(re_load_state_rec_t* rec, int64_t mono_now, time_t now);
+    bool loadInitRestore(re_load_state_rec_t* rec);
+    static re_load_state_hdr_t* stateGetAll(size_t* size);
+    static void stateNvsStoreSchedule();
+    #endif // CONFIG_LOADCTRL_RESTORE_ENABLED
+
+    #if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+    int64_t     _cycle_start = 0;               // Start of the last counted switch-on phase in pulse mode, us since boot
+    bool        _publish_pending = false;       // Publication is postponed to the wake window
+    bool        _store_pending = false;         // Saving counters is postponed to the wake window
+    bool        _state_pending = false;         // Saving the state of controllers is postponed to the wake window
+    re_load_lowpower_stats_t _lowpower;         // Wake-up statistics
+    uint32_t lowPowerFlush();
+    void lowPowerWakeup();
+    #endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+
+    #if CONFIG_LOADCTRL_METRICS_ENABLED
+    int64_t     _timer_cycle_deadline = 0;      // Scheduled firing time of the cycle timer, us since boot
+    void metricsTimerLate(int64_t deadline);
+    #endif // CONFIG_LOADCTRL_METRICS_ENABLED
+
+    bool loadSetStateCmd(bool new_state, bool forced, bool publish);
+    bool loadSetTimerPriv(uint32_t duration_ms, bool publish);
+    bool loadSetStatePriv(bool new_state, uint8_t async_flags);
+    bool loadTargetState();
+    bool loadOnPending();
+    bool loadWriteGPIO(uint8_t phy_level);
+    #if CONFIG_LOADCTRL_BUS_ENABLED
+    void loadCompleteGPIO(bool change_ok, uint8_t async_flags);
+    #endif // CONFIG_LOADCTRL_BUS_ENABLED
+    void loadSetStateFinalize(bool new_state, bool publish);
+    void loadReleaseClaims(bool was_on);
+    bool mqttPublishPriv();
+    void mqttPublishRequest();
+    char* getJSONPriv();
+    void countersNvsStorePriv();
+    int32_t getCycleCount();
+    uint32_t getCurrentDuration(int64_t mono_now);
+    void timestampsRepair();
     
     bool cycleCreate();
     bool cycleFree();
-    bool cycleSetCyclePriv(bool new_state);
+    bool cycleSetCyclePriv(bool new_state, uint8_t async_flags);
+    bool cycleTogglePriv(uint8_t async_flags);
+    bool cycleCommit(bool new_state);
 
     bool timerCreate();
     bool timerFree();
@@ -162,6 +708,9 @@ class rLoadGpioController: public rLoadController {
     rLoadGpioController(uint8_t pin, uint8_t level_on, bool use_timer, const char* nvs_space, 
       cb_load_change_t cb_state_changed, cb_load_publish_t cb_mqtt_publish);
   protected:
+    #if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+    bool loadHoldGPIO(bool hold) override;
+    #endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
     bool loadInitGPIO() override;
     bool loadSetStateGPIO(uint8_t physical_level) override; 
 };
@@ -178,14 +727,64 @@ class rLoadIoExpController: public rLoadController {
     rLoadIoExpController(uint8_t pin, uint8_t level_on, bool use_timer, const char* nvs_space,
       cb_load_gpio_init_t cb_gpio_init, cb_load_gpio_change_t cb_gpio_change,
       cb_load_change_t cb_state_changed, cb_load_publish_t cb_mqtt_publish);
+    #if CONFIG_LOADCTRL_VERIFY_ENABLED
+    ~rLoadIoExpController();
+
+    // Read-back verification
+    void setReadback(cb_load_gpio_read_t cb_gpio_read, uint8_t retries, uint32_t backoff_ms);
+    bool verifyLevel(uint8_t physical_level);
+
+    // Internal timer handler
+    void verifyRetry();
+    #endif // CONFIG_LOADCTRL_VERIFY_ENABLED
   protected:
     bool loadInitGPIO() override;
     bool loadSetStateGPIO(uint8_t physical_level) override; 
+    #if CONFIG_LOADCTRL_VERIFY_ENABLED
+    void loadRetryGPIO(uint8_t physical_level) override;
+    #endif // CONFIG_LOADCTRL_VERIFY_ENABLED
   private:
     cb_load_gpio_init_t _gpio_init = nullptr;
     cb_load_gpio_change_t _gpio_change = nullptr;
+
+    #if CONFIG_LOADCTRL_VERIFY_ENABLED
+    cb_load_gpio_read_t _gpio_read = nullptr;   // Read-back callback, verification is disabled if not set
+    esp_timer_handle_t _verify_timer = nullptr; // Timer for repeated writes after a mismatch
+    uint32_t    _verify_backoff = 0;            // Delay before the first retry, ms; doubled on each retry
+    uint8_t     _verify_retries = 0;            // Maximum number of retries
+    uint8_t     _verify_attempt = 0;            // Current retry
+    bool        _verify_reconcile = false;      // Retries were started by the background reconciliation
+    uint8_t     _level = 0xFF;                  // Last written physical level
+
+    bool verifyCheck();
+    bool verifySchedule();
+    bool verifyLevelPriv(uint8_t physical_level);
+    #endif // CONFIG_LOADCTRL_VERIFY_ENABLED
 };
 
+#if CONFIG_LOADCTRL_VERIFY_ENABLED
+
+class rLoadIoExpPort {
+  public:
+    rLoadIoExpPort(uint8_t max_loads, cb_load_port_read_t cb_port_read, void* port_arg, uint32_t interval_ms);
+    ~rLoadIoExpPort();
+
+    bool loadAdd(rLoadIoExpController* ctrl);
+    bool start();
+    void stop();
+    bool reconcile();
+  private:
+    uint8_t     _count = 0;
+    uint8_t     _max_loads = 0;
+    rLoadIoExpController** _loads = nullptr;
+    cb_load_port_read_t _port_read = nullptr;   // Reads the levels of all pins of the expander in one transaction
+    void*       _port_arg = nullptr;
+    uint32_t    _interval = 0;                  // Reconciliation interval, ms
+    esp_timer_handle_t _timer = nullptr;
+};
+
+#endif // CONFIG_LOADCTRL_VERIFY_ENABLED
+
 #ifdef __cplusplus
 }
 #endif
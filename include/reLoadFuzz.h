@@ -0,0 +1,54 @@
+/*
+   EN: Property checks of the calendar catch-up of counters against a reference model (diagnostics and fuzzing)
+   RU: Проверка восстановления счетчиков по календарю на соответствие эталонной модели (диагностика и фаззинг)
+   --------------------------
+   (с) 2021-2023 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+   --------------------------
+   Страница проекта: https://github.com/kotyara12/reLoadCtrl
+*/
+
+#ifndef __RE_LOADFUZZ_H__
+#define __RE_LOADFUZZ_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "project_config.h"
+#include "def_consts.h"
+#include "reLoadCtrl.h"
+
+#if CONFIG_LOADCTRL_FUZZ_ENABLED
+
+// Largest day for which days * 86400 still fits into a 32-bit time_t, fuzzer inputs are reduced to it
+#define LOAD_FUZZ_DAYS_MAX 24855
+
+// One case of the catch-up: what was stored, when, and when it is restored
+typedef struct {
+  uint32_t daysNvs;                             // Day of the store, days since UNIX epoch
+  uint32_t daysNow;                             // Day of the restore, days since UNIX epoch
+  uint8_t  period_start;                        // Day of month at the beginning of the billing period, 0 - not used
+  re_load_counters_t  counters;                 // Stored counters
+  re_load_durations_t durations;                // Stored durations
+} re_load_catchup_case_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Straightforward reference model of loadCountersCatchUp() (calendar indexes instead of branches)
+void loadCatchUpReference(re_load_catchup_case_t* data, re_load_counters_t* counters, re_load_durations_t* durations);
+// Runs loadCountersCatchUp() and the reference model on the case, returns false on divergence or broken invariants
+bool loadCatchUpCheck(re_load_catchup_case_t* data);
+// Random cases from a deterministic generator, returns the number of failed cases
+uint32_t loadCatchUpSelfTest(uint32_t iterations, uint32_t seed);
+// Entry point for coverage-guided fuzzers (libFuzzer-compatible signature): decodes a case from raw bytes
+int loadCatchUpFuzz(const uint8_t* data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONFIG_LOADCTRL_FUZZ_ENABLED
+
+#endif // __RE_LOADFUZZ_H__
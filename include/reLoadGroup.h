@@ -0,0 +1,149 @@
+/*
+   EN: Compact group of loads with shared configuration (callbacks, cycle settings, publishing) and packed per-load state
+   RU: Компактная группа нагрузок с общими настройками (обработчики, циклы, публикация) и упакованным состоянием каждой нагрузки
+   --------------------------
+   (с) 2021-2023 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+   --------------------------
+   Страница проекта: https://github.com/kotyara12/reLoadCtrl
+*/
+
+#ifndef __RE_LOADGROUP_H__
+#define __RE_LOADGROUP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <esp_err.h>
+#include "project_config.h"
+#include "def_consts.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "rTypes.h"
+#include "reLoadCtrl.h"
+
+// Packed state of one load in the group (fields are ordered so that there is no padding).
+// All configuration is shared by the group, the MQTT topic and NVS namespace are derived from the index on demand.
+// Deadlines are 32-bit, so timer and cycle intervals are limited to ~24 days.
+// Memory per load against rLoadGpioController is measured by host/load_footprint.
+typedef struct {
+  uint8_t  pin;                                 // Pin number
+  uint8_t  level_on : 1;                        // Output level at which the load is considered to be on
+  uint8_t  state : 1;                           // Current load state
+  uint8_t  cycle_state : 1;                     // Current cycle state
+  uint8_t  cycle_active : 1;                    // The load is in pulse mode
+  uint8_t  timer_active : 1;                    // The load will be turned off at deadline_off
+  uint8_t  reserved : 3;
+  uint16_t cycle_count;                         // Switch-on cycle counter in pulse mode
+  uint32_t last_on;                             // The last time the load was turned on
+  uint32_t last_off;                            // Time of last load disconnection
+  uint32_t deadline_off;                        // Off timer deadline (milliseconds since boot, lower 32 bits)
+  uint32_t deadline_cycle;                      // Cycle timer deadline (milliseconds since boot, lower 32 bits)
+  uint32_t mono_last;                           // Moment of the last switching by the monotonic clock, seconds since boot
+  re_load_counters_t  counters;                 // Counters of the number of load switching
+  re_load_durations_t durations;                // Load operating time counters
+} re_load_group_item_t;
+
+class rLoadGroup;
+
+typedef bool (*cb_load_group_publish_t) (rLoadGroup *group, uint8_t index, char* topic, char* payload, bool free_topic, bool free_payload);
+typedef void (*cb_load_group_change_t) (rLoadGroup *group, uint8_t index, bool state, time_t duration);
+typedef bool (*cb_load_group_gpio_init_t) (rLoadGroup *group, uint8_t index, uint8_t pin, uint8_t level_on);
+typedef bool (*cb_load_group_gpio_change_t) (rLoadGroup *group, uint8_t index, uint8_t pin, uint8_t physical_level);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+class rLoadGroup {
+  public:
+    rLoadGroup(uint8_t count, const char* nvs_prefix,
+      uint32_t* cycle_duration, uint32_t* cycle_interval, timeintv_t cycle_type,
+      cb_load_group_gpio_init_t cb_gpio_init, cb_load_group_gpio_change_t cb_gpio_change,
+      cb_load_group_change_t cb_state_changed, cb_load_group_publish_t cb_mqtt_publish);
+    ~rLoadGroup();
+
+    // Load configuration
+    uint8_t getCount();
+    bool loadAttach(uint8_t index, uint8_t pin, uint8_t level_on);
+
+    // Load switching
+    bool loadInit(uint8_t index, bool init_value);
+    bool loadInitAll(bool init_value);
+    bool loadSetState(uint8_t index, bool new_state, bool forced, bool publish);
+
+    // Timers
+    bool timerIsActive(uint8_t index);
+    bool timerStop(uint8_t index);
+    bool loadSetTimer(uint8_t index, uint32_t duration_ms);
+
+    // Get current data
+    bool getState(uint8_t index);
+    uint8_t getPin(uint8_t index);
+    time_t getLastOn(uint8_t index);
+    time_t getLastOff(uint8_t index);
+    re_load_counters_t getCounters(uint8_t index);
+    re_load_durations_t getDurations(uint8_t index);
+    uint16_t getDurationsAll(re_load_durations_t* buf, uint16_t size);
+    char* getJSON(uint8_t index);
+
+    // MQTT
+    void mqttSetCallback(cb_load_group_publish_t cb_publish);
+    char* mqttTopicGet(uint8_t index);
+    bool mqttTopicSet(char* topic_prefix);
+    bool mqttTopicCreate(bool primary, bool local, const char* topic1, const char* topic2, const char* topic3);
+    void mqttTopicFree();
+    bool mqttPublish(uint8_t index);
+    bool mqttPublishAll();
+
+    // Saving the state of counters
+    void countersReset();
+    void countersNvsRestore();
+    void countersNvsStore();
+
+    // Event handlers
+    void countersTimeEventHandler(int32_t event_id, void* event_data);
+
+    // Other parameters
+    void setPeriodStartDay(uint8_t* mday);
+    void setCallbacks(cb_load_group_change_t cb_gpio_before, cb_load_group_change_t cb_gpio_after, cb_load_group_change_t cb_state_changed);
+
+    // Internal timer handler
+    void timerProcess();
+  private:
+    uint8_t     _count = 0;                     // Number of loads in the group
+    re_load_group_item_t* _items = nullptr;     // Packed state of loads
+    uint8_t*    _period_start = nullptr;        // Day of month at the beginning of the billing period
+    uint32_t*   _cycle_duration = nullptr;      // Pulse duration (common to all loads in the group)
+    uint32_t*   _cycle_interval = nullptr;      // Pause duration (common to all loads in the group)
+    timeintv_t  _cycle_type = TI_MILLISECONDS;  // Dimensions of cycle time intervals
+    const char* _nvs_prefix = nullptr;          // Namespace prefix, the load index is appended to it
+    char*       _mqtt_prefix = nullptr;         // MQTT topic prefix, the load index is appended to it
+    esp_timer_handle_t _timer = nullptr;        // Single timer for the earliest deadline of all loads
+    SemaphoreHandle_t _lock = nullptr;          // Serializes the application and the timer task: state bits, deadlines and the timer
+
+    cb_load_group_gpio_init_t _gpio_init = nullptr;
+    cb_load_group_gpio_change_t _gpio_change = nullptr;
+    cb_load_group_change_t _gpio_before = nullptr;
+    cb_load_group_change_t _gpio_after = nullptr;
+    cb_load_group_change_t _state_changed = nullptr;
+    cb_load_group_publish_t _mqtt_publish = nullptr;
+
+    void lock();
+    void unlock();
+    bool cycleEnabled();
+    bool loadSetStatePriv(uint8_t index, bool new_state);
+    bool cycleToggle(uint8_t index);
+    bool timerCreate();
+    void timerArm();
+    void timestampsRepair();
+    uint32_t getCurrentDuration(uint8_t index, uint32_t mono_now);
+    bool nvsSpace(uint8_t index, char* buf, size_t size);
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __RE_LOADGROUP_H__
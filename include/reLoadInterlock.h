@@ -0,0 +1,75 @@
+/*
+   EN: Interlock group: loads that must never be on together, with optional dead time between them
+   RU: Группа взаимной блокировки: нагрузки, которые не могут быть включены одновременно, с паузой между ними
+   --------------------------
+   (с) 2021-2023 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+   --------------------------
+   Страница проекта: https://github.com/kotyara12/reLoadCtrl
+*/
+
+#ifndef __RE_LOADINTERLOCK_H__
+#define __RE_LOADINTERLOCK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+#include "freertos/FreeRTOS.h"
+#include "project_config.h"
+#include "def_consts.h"
+#include "esp_timer.h"
+#include "reLoadCtrl.h"
+
+#if CONFIG_LOADCTRL_INTERLOCK_ENABLED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+class rLoadInterlock {
+  public:
+    rLoadInterlock(uint8_t max_loads, uint32_t dead_time_ms);
+    ~rLoadInterlock();
+
+    // Loads
+    bool loadAdd(rLoadController* ctrl);
+    void loadRemove(rLoadController* ctrl);
+
+    // Parameters
+    void setDeadTime(uint32_t dead_time_ms);
+
+    // Get current data
+    rLoadController* getOwner();
+    bool isPending(rLoadController* ctrl);
+    uint32_t getRejected();
+
+    // Requests from controllers
+    re_load_reject_t requestOn(rLoadController* ctrl, bool publish);
+    void release(rLoadController* ctrl, bool was_on);
+
+    // Internal timer handler
+    void timerProcess();
+  private:
+    uint8_t     _count = 0;
+    uint8_t     _max_loads = 0;
+    rLoadController** _loads = nullptr;         // Members of the group
+    rLoadController* _owner = nullptr;          // Member that is on (or has been granted a switch-on)
+    rLoadController* _pending = nullptr;        // Member waiting for the end of the dead time
+    bool        _pending_publish = false;       // Publish state after a delayed switch-on
+    uint64_t    _dead_time = 0;                 // Pause between turning off one member and turning on another, us
+    int64_t     _released_at = 0;               // Time the last member was turned off, us since boot
+    uint32_t    _rejected = 0;                  // Number of rejected switch-on requests
+    esp_timer_handle_t _timer = nullptr;        // Dead time timer
+    portMUX_TYPE _lock;
+
+    bool isMember(rLoadController* ctrl);
+    void timerArm();
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONFIG_LOADCTRL_INTERLOCK_ENABLED
+
+#endif // __RE_LOADINTERLOCK_H__
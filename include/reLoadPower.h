@@ -0,0 +1,127 @@
+/*
+   EN: Power budget coordinator: limits the total power of simultaneously switched on loads and staggers switch-on
+   RU: Координатор мощности: ограничивает суммарную мощность включенных нагрузок и разносит их включение во времени
+   --------------------------
+   (с) 2021-2023 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+   --------------------------
+   Страница проекта: https://github.com/kotyara12/reLoadCtrl
+*/
+
+#ifndef __RE_LOADPOWER_H__
+#define __RE_LOADPOWER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+#include "freertos/FreeRTOS.h"
+#include "project_config.h"
+#include "def_consts.h"
+#include "esp_timer.h"
+#include "reLoadCtrl.h"
+
+#if CONFIG_LOADCTRL_POWER_ENABLED
+
+#ifndef CONFIG_LOADCTRL_POWER_USED
+#define CONFIG_LOADCTRL_POWER_USED "used"
+#endif // CONFIG_LOADCTRL_POWER_USED
+#ifndef CONFIG_LOADCTRL_POWER_LIMIT
+#define CONFIG_LOADCTRL_POWER_LIMIT "limit"
+#endif // CONFIG_LOADCTRL_POWER_LIMIT
+#ifndef CONFIG_LOADCTRL_POWER_QUEUE
+#define CONFIG_LOADCTRL_POWER_QUEUE "queue"
+#endif // CONFIG_LOADCTRL_POWER_QUEUE
+#ifndef CONFIG_LOADCTRL_POWER_QUEUE_MAX
+#define CONFIG_LOADCTRL_POWER_QUEUE_MAX "queue_max"
+#endif // CONFIG_LOADCTRL_POWER_QUEUE_MAX
+#ifndef CONFIG_LOADCTRL_POWER_REQUESTS
+#define CONFIG_LOADCTRL_POWER_REQUESTS "requests"
+#endif // CONFIG_LOADCTRL_POWER_REQUESTS
+#ifndef CONFIG_LOADCTRL_POWER_DELAYED
+#define CONFIG_LOADCTRL_POWER_DELAYED "delayed"
+#endif // CONFIG_LOADCTRL_POWER_DELAYED
+#ifndef CONFIG_LOADCTRL_POWER_WAIT_AVG
+#define CONFIG_LOADCTRL_POWER_WAIT_AVG "wait_avg"
+#endif // CONFIG_LOADCTRL_POWER_WAIT_AVG
+#ifndef CONFIG_LOADCTRL_POWER_WAIT_MAX
+#define CONFIG_LOADCTRL_POWER_WAIT_MAX "wait_max"
+#endif // CONFIG_LOADCTRL_POWER_WAIT_MAX
+
+typedef struct {
+  uint32_t requests = 0;                        // Switch-on requests
+  uint32_t delayed = 0;                         // Requests that had to wait in the queue
+  uint32_t cancelled = 0;                       // Requests cancelled while waiting
+  uint32_t waitCount = 0;                       // Requests that have completed waiting
+  uint32_t waitLast = 0;                        // Last wait time, ms
+  uint32_t waitMax = 0;                         // Maximum wait time, ms
+  uint64_t waitSum = 0;                         // Total wait time, ms
+  uint8_t  queueDepth = 0;                      // Current number of requests in the queue
+  uint8_t  queueDepthMax = 0;                   // Maximum number of requests in the queue
+} re_load_power_metrics_t;
+
+typedef struct {
+  rLoadController* ctrl;                        // Load controller
+  uint32_t power;                               // Rated power of the load
+  int64_t  queued_at;                           // Time the request was queued, us since boot
+  uint8_t  priority;                            // Queue priority, higher value is served first
+  bool     on;                                  // Power is reserved for the load
+  bool     queued;                              // Switch-on request is waiting in the queue
+  bool     publish;                             // Publish state after a delayed switch-on
+} re_load_power_item_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+class rLoadPowerBudget {
+  public:
+    rLoadPowerBudget(uint8_t max_loads, uint32_t max_power, uint32_t stagger_ms);
+    ~rLoadPowerBudget();
+
+    // Loads
+    bool loadAdd(rLoadController* ctrl, uint32_t power, uint8_t priority);
+    void loadRemove(rLoadController* ctrl);
+
+    // Parameters
+    void setMaxPower(uint32_t max_power);
+    void setStagger(uint32_t stagger_ms);
+
+    // Get current data
+    uint32_t getPowerUsed();
+    uint8_t getQueueDepth();
+    bool isQueued(rLoadController* ctrl);
+    re_load_power_metrics_t getMetrics();
+    char* getJSON();
+
+    // Requests from controllers
+    bool requestOn(rLoadController* ctrl, bool publish);
+    void requestCancel(rLoadController* ctrl);
+    void release(rLoadController* ctrl);
+
+    // Internal timer handler
+    void timerProcess();
+  private:
+    uint8_t     _count = 0;
+    uint8_t     _max_loads = 0;
+    re_load_power_item_t* _items = nullptr;
+    uint32_t    _max_power = 0;                 // Maximum concurrent power, 0 - unlimited
+    uint32_t    _used = 0;                      // Power of switched on loads
+    uint64_t    _stagger = 0;                   // Minimum interval between switch-ons, us
+    int64_t     _last_start = 0;                // Time of the last switch-on, us since boot
+    re_load_power_metrics_t _metrics;
+    esp_timer_handle_t _timer = nullptr;        // Timer for processing the queue
+    portMUX_TYPE _lock;
+
+    re_load_power_item_t* itemFind(rLoadController* ctrl);
+    re_load_power_item_t* queueFirst();
+    bool canStart(re_load_power_item_t* item, int64_t now);
+    void timerArm();
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONFIG_LOADCTRL_POWER_ENABLED
+
+#endif // __RE_LOADPOWER_H__
@@ -0,0 +1,95 @@
+/*
+   EN: Replay of recorded switching logs through real controllers with a simulated GPIO and a virtual clock (diagnostics)
+   RU: Воспроизведение записанных журналов переключений через реальные контроллеры с имитацией GPIO и виртуальными часами (диагностика)
+   --------------------------
+   (с) 2021-2023 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+   --------------------------
+   Страница проекта: https://github.com/kotyara12/reLoadCtrl
+*/
+
+#ifndef __RE_LOADREPLAY_H__
+#define __RE_LOADREPLAY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <esp_err.h>
+#include "project_config.h"
+#include "def_consts.h"
+#include "reLoadCtrl.h"
+
+#if CONFIG_LOADCTRL_REPLAY_ENABLED
+
+// Event types of the switching log
+#define LOAD_REPLAY_OFF           0             // The load is turned off
+#define LOAD_REPLAY_ON            1             // The load is turned on
+#define LOAD_REPLAY_STORE         2             // Counters of the load are saved to NVS
+#define LOAD_REPLAY_REBOOT        3             // Power was lost after the previous event and restored at this time: controllers are created again and restored from NVS
+
+typedef struct {
+  uint32_t time;                                // Wall-clock time of the event (UNIX time), must not decrease
+  uint8_t  load;                                // Index of the load
+  uint8_t  type;                                // LOAD_REPLAY_xxx
+} re_load_replay_event_t;
+
+typedef struct {
+  rLoadController* ctrl;                        // Real controller, GPIO is simulated
+  char*    nvs_space;                           // Namespace of the load: prefix and load index
+  uint8_t  level;                               // Simulated physical level of the output
+  uint32_t checkpoint_at;                       // Next checkpoint of the current on-interval on the virtual clock, 0 - none
+} re_load_replay_item_t;
+
+typedef struct {
+  uint32_t events;                              // Processed events
+  uint32_t rollovers;                           // Simulated start of day events
+  uint32_t checkpoints;                         // Simulated checkpoint timer events
+  uint32_t reboots;                             // Simulated reboots
+  uint32_t lost;                                // On-intervals interrupted by reboot
+  uint64_t time;                                // Processing time, us
+} re_load_replay_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+class rLoadReplay {
+  public:
+    // Only one replay can exist at a time: it replaces the accounting clock of all controllers.
+    // Data of the loads is stored in the NVS namespaces "<nvs_prefix><index, 2 hex digits>", they are erased by reset()
+    rLoadReplay(uint8_t loads, uint8_t* period_start, const char* nvs_prefix, uint32_t checkpoint_s);
+    ~rLoadReplay();
+
+    bool reset(uint32_t start_time);
+    bool process(const re_load_replay_event_t* events, uint32_t count);
+    // Writes the data of the load in the format of previous versions (32-bit totals, no slots), it is read on the next reboot
+    bool seedLegacy(uint8_t load, uint32_t days, re_load_counters_t* counters, re_load_durations_t* durations);
+
+    // Results
+    re_load_counters_t getCounters(uint8_t load);
+    re_load_durations_t getDurations(uint8_t load);
+    re_load_replay_stats_t getStats();
+    char* getJSON(uint8_t load);
+    char* getStatsJSON();
+  private:
+    uint8_t     _count = 0;
+    re_load_replay_item_t* _items = nullptr;
+    uint8_t*    _period_start = nullptr;        // Day of month at the beginning of the billing period
+    uint32_t    _checkpoint = 0;                // Checkpoint interval, s
+    uint32_t    _midnight = 0;                  // Next local midnight on the virtual clock
+    re_load_replay_stats_t _stats;
+
+    bool loadsCreate();
+    void loadsFree();
+    bool processEvent(const re_load_replay_event_t* event);
+    void clockAdvance(uint32_t time);
+    void clockReset(uint32_t time);
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONFIG_LOADCTRL_REPLAY_ENABLED
+
+#endif // __RE_LOADREPLAY_H__
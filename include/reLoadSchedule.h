@@ -0,0 +1,110 @@
+/*
+   EN: Weekly on/off programs for load controllers, driven by a single timer armed for the nearest transition
+   RU: Недельные программы включения нагрузок, управляемые одним таймером до ближайшего переключения
+   --------------------------
+   (с) 2021-2023 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+   --------------------------
+   Страница проекта: https://github.com/kotyara12/reLoadCtrl
+*/
+
+#ifndef __RE_LOADSCHEDULE_H__
+#define __RE_LOADSCHEDULE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <esp_err.h>
+#include "project_config.h"
+#include "def_consts.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "reLoadCtrl.h"
+
+#ifndef CONFIG_LOADCTRL_SCHEDULE_KEY
+#define CONFIG_LOADCTRL_SCHEDULE_KEY "schedule"
+#endif // CONFIG_LOADCTRL_SCHEDULE_KEY
+
+// Days of week for re_load_program_t.days (bit number = tm_wday)
+#define LOAD_SCHEDULE_SUN         0x01
+#define LOAD_SCHEDULE_MON         0x02
+#define LOAD_SCHEDULE_TUE         0x04
+#define LOAD_SCHEDULE_WED         0x08
+#define LOAD_SCHEDULE_THU         0x10
+#define LOAD_SCHEDULE_FRI         0x20
+#define LOAD_SCHEDULE_SAT         0x40
+#define LOAD_SCHEDULE_WORKDAYS    0x3E
+#define LOAD_SCHEDULE_WEEKEND     0x41
+#define LOAD_SCHEDULE_EVERYDAY    0x7F
+
+// Weekly program: on the selected days, turn the load on at "start" for "duration" minutes.
+// This is also the binary format of the NVS blob (6 bytes per program).
+typedef struct {
+  uint8_t  load;                                // Index of the load in the scheduler
+  uint8_t  days;                                // Bit mask of days of week, see LOAD_SCHEDULE_xxx
+  uint16_t start;                               // Switch-on time, minutes since midnight (local time)
+  uint16_t duration;                            // Switch-on duration, minutes (no more than one day)
+} re_load_program_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+class rLoadScheduler {
+  public:
+    rLoadScheduler(uint8_t max_loads, uint8_t max_programs);
+    ~rLoadScheduler();
+
+    // Loads
+    int16_t loadAdd(rLoadController* ctrl);
+    rLoadController* loadGet(uint8_t load);
+
+    // Programs
+    int16_t programAdd(uint8_t load, uint8_t days, uint16_t start, uint16_t duration);
+    bool programDelete(uint8_t index);
+    void programsClear();
+    uint8_t programsCount();
+    re_load_program_t* programGet(uint8_t index);
+
+    // Start / stop processing
+    bool start();
+    void stop();
+    bool update();
+
+    // Saving programs
+    bool nvsStore(const char* nvs_space);
+    bool nvsRestore(const char* nvs_space);
+
+    // Event handlers
+    void timeEventHandler(int32_t event_id, void* event_data);
+
+    // Internal timer handler
+    void timerProcess();
+  private:
+    uint8_t     _loads_max = 0;
+    uint8_t     _loads_count = 0;
+    rLoadController** _loads = nullptr;         // Controllers, programs refer to them by index
+    uint8_t     _programs_max = 0;
+    uint8_t     _programs_count = 0;
+    re_load_program_t* _programs = nullptr;     // Programs
+    time_t*     _next = nullptr;                // Cached time of the next transition of each program
+    uint8_t*    _active = nullptr;              // Cached state of each program
+    bool        _started = false;
+    esp_timer_handle_t _timer = nullptr;        // Single timer for the nearest transition
+    SemaphoreHandle_t _lock = nullptr;          // Serializes the application and the timer task: programs and their transitions
+
+    void lock();
+    void unlock();
+    bool programValid(const re_load_program_t* prg);
+    bool programCalc(uint8_t index, time_t now);
+    bool loadApply(uint8_t load);
+    bool calculate(bool apply_all);
+    bool timerArm(time_t now);
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __RE_LOADSCHEDULE_H__
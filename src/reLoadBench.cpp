@@ -0,0 +1,244 @@
+#include "reLoadBench.h"
+
+#if CONFIG_LOADCTRL_BENCHMARK_ENABLED
+
+#include <string.h>
+#include <stdlib.h>
+#include "esp_heap_caps.h"
+#include "reEvents.h"
+#include "rLog.h"
+#include "rStrings.h"
+
+static const char* logTAG = "LOAD";
+
+static const char* _benchNames[LOAD_BENCH_MAX] = { "switch", "pulse", "rollover", "store", "publish" };
+
+// Pulse mode is enabled only for the pulse workload
+static uint32_t _benchCycle = 0;
+static uint32_t _benchWrites = 0;
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------- Simulated backend --------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static bool loadBenchGpioInit(rLoadController *ctrl, uint8_t pin, uint8_t level_on)
+{
+  return true;
+}
+
+static bool loadBenchGpioChange(rLoadController *ctrl, uint8_t pin, uint8_t physical_level)
+{
+  _benchWrites++;
+  return true;
+}
+
+static bool loadBenchPublish(rLoadController *ctrl, char* topic, char* payload, bool free_topic, bool free_payload)
+{
+  if (free_topic && topic) free(topic);
+  if (free_payload && payload) free(payload);
+  return true;
+}
+
+static uint32_t loadBenchRandom(uint32_t* state)
+{
+  // xorshift32: the same sequence of operations for every library version
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+static int loadBenchCompare(const void* a, const void* b)
+{
+  uint32_t va = *(const uint32_t*)a;
+  uint32_t vb = *(const uint32_t*)b;
+  return (va > vb) - (va < vb);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Workloads ------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void loadBenchOperation(rLoadController* ctrl, uint8_t workload, uint32_t rnd)
+{
+  static const int32_t events[] = { RE_TIME_START_OF_DAY, RE_TIME_START_OF_WEEK, RE_TIME_START_OF_MONTH, RE_TIME_START_OF_YEAR };
+  switch (workload) {
+    case LOAD_BENCH_SWITCH:
+      ctrl->loadSetState(!ctrl->getState(), false, false);
+      break;
+
+    case LOAD_BENCH_PULSE:
+      ctrl->loadSetState(true, false, false);
+      ctrl->cycleToggle();
+      ctrl->loadSetState(false, false, false);
+      break;
+
+    case LOAD_BENCH_ROLLOVER:
+      {
+        int mday = 1 + rnd % 28;
+        ctrl->countersTimeEventHandler(events[rnd % (sizeof(events) / sizeof(events[0]))], &mday);
+      };
+      break;
+
+    case LOAD_BENCH_STORE:
+      ctrl->countersNvsStore();
+      break;
+
+    case LOAD_BENCH_PUBLISH:
+      ctrl->mqttPublish();
+      break;
+
+    default:
+      break;
+  };
+}
+
+static void loadBenchWorkload(rLoadController** ctrls, uint16_t count, uint8_t workload, uint32_t ops, uint32_t* samples,
+  uint32_t* state, size_t* heap_min, re_load_bench_result_t* result)
+{
+  _benchCycle = (workload == LOAD_BENCH_PULSE) ? 1000 : 0;
+  for (uint32_t i = 0; i < ops; i++) {
+    uint32_t rnd = loadBenchRandom(state);
+    rLoadController* ctrl = ctrls[rnd % count];
+    int64_t time_start = esp_timer_get_time();
+    loadBenchOperation(ctrl, workload, rnd >> 16);
+    samples[i] = (uint32_t)(esp_timer_get_time() - time_start);
+    result->time += samples[i];
+    // The heap is checked outside of the measured interval
+    size_t heap_free = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    if (heap_free < *heap_min) *heap_min = heap_free;
+  };
+  _benchCycle = 0;
+
+  result->ops = ops;
+  if (ops > 0) {
+    qsort(samples, ops, sizeof(uint32_t), loadBenchCompare);
+    result->p50 = samples[(ops - 1) * 50 / 100];
+    result->p90 = samples[(ops - 1) * 90 / 100];
+    result->p99 = samples[(ops - 1) * 99 / 100];
+    result->max = samples[ops - 1];
+  };
+  rlog_i(logTAG, "Benchmark %s: %d ops, %d us, p50 %d us, p99 %d us",
+    _benchNames[workload], result->ops, (uint32_t)result->time, result->p50, result->p99);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------------- Run ---------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+bool loadBenchRun(uint16_t loads, uint32_t ops, uint32_t seed, const char* nvs_space, re_load_bench_report_t* report)
+{
+  memset((void*)report, 0, sizeof(re_load_bench_report_t));
+  report->requested = loads;
+  if ((loads == 0) || (ops == 0)) return false;
+
+  // The index is appended to the namespace, and loadCountersNvsStore() may append its own suffix
+  if (nvs_space && (strlen(nvs_space) > LOAD_NVS_SPACE_MAX - LOAD_NVS_SUFFIX_LEN - 4)) {
+    rlog_e(logTAG, "Benchmark: namespace \"%s\" is too long", nvs_space);
+    return false;
+  };
+
+  uint16_t expanders = (loads + LOAD_BENCH_EXPANDER_PINS - 1) / LOAD_BENCH_EXPANDER_PINS;
+  uint32_t* samples = (uint32_t*)calloc(ops, sizeof(uint32_t));
+  rLoadController** ctrls = (rLoadController**)calloc(loads, sizeof(rLoadController*));
+  char** spaces = nvs_space ? (char**)calloc(loads, sizeof(char*)) : nullptr;
+  re_load_topic_prefix_t* prefixes = (re_load_topic_prefix_t*)calloc(expanders, sizeof(re_load_topic_prefix_t));
+  if ((samples == nullptr) || (ctrls == nullptr) || (nvs_space && (spaces == nullptr)) || (prefixes == nullptr)) {
+    rlog_e(logTAG, "Failed to allocate memory for benchmark");
+    if (samples) free(samples);
+    if (ctrls) free(ctrls);
+    if (spaces) free(spaces);
+    if (prefixes) free(prefixes);
+    return false;
+  };
+
+  // Loads of one expander share a topic prefix, as in a real fleet; names are not included in the heap taken by controllers
+  for (uint16_t i = 0; i < expanders; i++) {
+    loadTopicPrefixSet(&prefixes[i], malloc_stringf("bench/%d", i));
+  };
+  if (spaces) {
+    for (uint16_t i = 0; i < loads; i++) {
+      spaces[i] = malloc_stringf("%s%04x", nvs_space, i);
+    };
+  };
+
+  multi_heap_info_t info;
+  heap_caps_get_info(&info, MALLOC_CAP_DEFAULT);
+  size_t blocks_start = info.allocated_blocks;
+  size_t heap_start = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+  size_t heap_min = heap_start;
+  _benchWrites = 0;
+  uint16_t count = 0;
+  while ((count < loads) && (heap_caps_get_free_size(MALLOC_CAP_DEFAULT) > CONFIG_LOADCTRL_BENCHMARK_HEAP_RESERVE)) {
+    re_load_topic_prefix_t* prefix = &prefixes[count / LOAD_BENCH_EXPANDER_PINS];
+    uint8_t pin = count % LOAD_BENCH_EXPANDER_PINS;
+    rLoadController* ctrl = new rLoadIoExpController(pin, 1, false, spaces ? spaces[count] : nullptr,
+      &_benchCycle, &_benchCycle, TI_MILLISECONDS,
+      loadBenchGpioInit, loadBenchGpioChange, nullptr, nullptr, nullptr, loadBenchPublish);
+    #if CONFIG_LOADCTRL_TOPIC_PREFIX_ENABLED
+      ctrl->mqttTopicSetPrefix(prefix, nullptr);
+    #else
+      ctrl->mqttTopicSet(loadTopicMake(prefix->topic, nullptr, pin));
+    #endif // CONFIG_LOADCTRL_TOPIC_PREFIX_ENABLED
+    ctrl->loadInit(false);
+    ctrls[count++] = ctrl;
+  };
+  heap_caps_get_info(&info, MALLOC_CAP_DEFAULT);
+  report->loads = count;
+  report->heap_used = (uint32_t)(heap_start - heap_caps_get_free_size(MALLOC_CAP_DEFAULT));
+  report->heap_blocks = (uint32_t)(info.allocated_blocks - blocks_start);
+  if (count < loads) {
+    rlog_w(logTAG, "Benchmark: only %d of %d controllers were created", count, loads);
+  };
+
+  if (count > 0) {
+    uint32_t state = seed ? seed : 1;
+    for (uint8_t workload = 0; workload < LOAD_BENCH_MAX; workload++) {
+      // Without a namespace the store does nothing and is not measured
+      if ((workload == LOAD_BENCH_STORE) && (nvs_space == nullptr)) continue;
+      loadBenchWorkload(ctrls, count, workload, ops, samples, &state, &heap_min, &report->results[workload]);
+      // Every workload starts with all loads off
+      for (uint16_t i = 0; i < count; i++) {
+        ctrls[i]->loadSetState(false, false, false);
+      };
+    };
+  };
+  report->heap_peak = (uint32_t)(heap_start - heap_min);
+  report->gpio_writes = _benchWrites;
+
+  for (uint16_t i = 0; i < count; i++) {
+    delete ctrls[i];
+  };
+  free(ctrls);
+  free(samples);
+  if (spaces) {
+    for (uint16_t i = 0; i < loads; i++) {
+      if (spaces[i]) free(spaces[i]);
+    };
+    free(spaces);
+  };
+  for (uint16_t i = 0; i < expanders; i++) {
+    loadTopicPrefixFree(&prefixes[i]);
+  };
+  free(prefixes);
+  return count > 0;
+}
+
+char* loadBenchJSON(re_load_bench_report_t* report)
+{
+  char* _json = malloc_stringf("{\"format\":%d,\"requested\":%d,\"loads\":%d,\"heap\":{\"used\":%d,\"per_load\":%d,\"blocks\":%d,\"peak\":%d},\"gpio_writes\":%d,\"workloads\":[",
+    LOAD_BENCH_FORMAT, report->requested, report->loads,
+    report->heap_used, report->loads > 0 ? report->heap_used / report->loads : 0, report->heap_blocks, report->heap_peak,
+    report->gpio_writes);
+  for (uint8_t i = 0; i < LOAD_BENCH_MAX; i++) {
+    re_load_bench_result_t* r = &report->results[i];
+    uint32_t rate = r->time > 0 ? (uint32_t)((uint64_t)r->ops * 1000000 / r->time) : 0;
+    _json = concat_strings(_json, malloc_stringf("%s{\"name\":\"%s\",\"ops\":%d,\"time_us\":%llu,\"ops_per_sec\":%d,\"p50\":%d,\"p90\":%d,\"p99\":%d,\"max\":%d}",
+      i > 0 ? "," : "", _benchNames[i], r->ops, (unsigned long long)r->time, rate, r->p50, r->p90, r->p99, r->max));
+  };
+  return concat_strings(_json, malloc_string("]}"));
+}
+
+#endif // CONFIG_LOADCTRL_BENCHMARK_ENABLED
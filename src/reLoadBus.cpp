@@ -0,0 +1,147 @@
+#include "reLoadBus.h"
+
+#if CONFIG_LOADCTRL_BUS_ENABLED
+
+#include <string.h>
+#include "reEsp32.h"
+#include "rLog.h"
+
+static const char* logTAG = "LOAD";
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------- rLoadBusWorker ---------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+rLoadBusWorker::rLoadBusWorker(const char* name, uint8_t priority, cb_load_bus_batch_t cb_batch, void* cb_arg)
+{
+  _name = name;
+  _priority = priority;
+  _batch = cb_batch;
+  _batch_arg = cb_arg;
+  _queue = nullptr;
+  _task = nullptr;
+  _done = nullptr;
+  _stopping = false;
+}
+
+rLoadBusWorker::~rLoadBusWorker()
+{
+  stop();
+}
+
+static void loadBusWorkerTask(void* arg)
+{
+  rLoadBusWorker* worker = (rLoadBusWorker*)arg;
+  worker->process();
+  vTaskDelete(nullptr);
+}
+
+bool rLoadBusWorker::start()
+{
+  if (_queue == nullptr) {
+    _queue = xQueueCreate(CONFIG_LOADCTRL_BUS_QUEUE_SIZE, sizeof(re_load_bus_op_t));
+    if (_queue == nullptr) {
+      rlog_e(logTAG, "Failed to create bus queue");
+      return false;
+    };
+  };
+  if (_done == nullptr) {
+    _done = xSemaphoreCreateBinary();
+    if (_done == nullptr) {
+      rlog_e(logTAG, "Failed to create bus semaphore");
+      return false;
+    };
+  };
+  if (_task == nullptr) {
+    _stopping = false;
+    if (xTaskCreate(loadBusWorkerTask, _name ? _name : "load_bus", CONFIG_LOADCTRL_BUS_STACK_SIZE, this, _priority, &_task) != pdPASS) {
+      rlog_e(logTAG, "Failed to create bus task");
+      _task = nullptr;
+      return false;
+    };
+  };
+  return true;
+}
+
+void rLoadBusWorker::stop()
+{
+  if (_task) {
+    // Listeners are called from the worker task, it cannot wait for itself
+    if (xTaskGetCurrentTaskHandle() == _task) {
+      rlog_e(logTAG, "Bus worker cannot be stopped from its own task");
+      return;
+    };
+    // New requests are rejected, the stop marker is queued after all accepted ones
+    _stopping = true;
+    re_load_bus_op_t op;
+    memset(&op, 0, sizeof(re_load_bus_op_t));
+    xQueueSend(_queue, &op, portMAX_DELAY);
+    xSemaphoreTake(_done, portMAX_DELAY);
+    _task = nullptr;
+  };
+  if (_queue) {
+    // Requests that were accepted while the marker was being queued are written here
+    re_load_bus_op_t op;
+    if (xQueueReceive(_queue, &op, 0) == pdTRUE) {
+      if (_batch) _batch(_batch_arg, true);
+      do {
+        if (op.ctrl) op.ctrl->loadExecuteGPIO(op.level, op.flags);
+      } while (xQueueReceive(_queue, &op, 0) == pdTRUE);
+      if (_batch) _batch(_batch_arg, false);
+    };
+    vQueueDelete(_queue);
+    _queue = nullptr;
+  };
+  if (_done) {
+    vSemaphoreDelete(_done);
+    _done = nullptr;
+  };
+}
+
+bool rLoadBusWorker::submit(rLoadController* ctrl, uint8_t level, uint8_t flags)
+{
+  if (_queue && !_stopping) {
+    re_load_bus_op_t op;
+    op.ctrl = ctrl;
+    op.level = level;
+    op.flags = flags;
+    // Never block the caller: it may be the esp_timer task
+    if (xQueueSend(_queue, &op, 0) == pdTRUE) {
+      return true;
+    };
+    rlog_e(logTAG, "Bus queue is full, level change for pin %d is rejected", ctrl->getPin());
+  };
+  return false;
+}
+
+uint32_t rLoadBusWorker::getQueueDepth()
+{
+  if (_queue) {
+    return uxQueueMessagesWaiting(_queue);
+  };
+  return 0;
+}
+
+void rLoadBusWorker::process()
+{
+  re_load_bus_op_t op;
+  bool running = true;
+  while (running) {
+    if (xQueueReceive(_queue, &op, portMAX_DELAY) == pdTRUE) {
+      // Everything that has accumulated in the queue is written in one batch
+      if (_batch) _batch(_batch_arg, true);
+      do {
+        // Stop marker: all requests submitted before it have been written and finalized
+        if (op.ctrl == nullptr) {
+          running = false;
+          break;
+        };
+        op.ctrl->loadExecuteGPIO(op.level, op.flags);
+      } while (xQueueReceive(_queue, &op, 0) == pdTRUE);
+      if (_batch) _batch(_batch_arg, false);
+    };
+  };
+  xSemaphoreGive(_done);
+}
+
+#endif // CONFIG_LOADCTRL_BUS_ENABLED
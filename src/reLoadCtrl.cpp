@@ -1,12 +1,22 @@
 #include "reLoadCtrl.h"
+#include "reLoadPower.h"
+#include "reLoadBus.h"
+#include "reLoadInterlock.h"
 #include <string.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "reNvs.h"
 #include "reEvents.h"
 #include "reMqtt.h"
 #include "reEsp32.h"
 #include "rLog.h"
 #include "rStrings.h"
-#include "def_sntp.h"
+#if CONFIG_LOADCTRL_SLOTS_ENABLED
+#include "esp_rom_crc.h"
+#endif // CONFIG_LOADCTRL_SLOTS_ENABLED
 
 static const char* logTAG = "LOAD";
 
@@ -14,6 +24,1042 @@ static const char* logTAG = "LOAD";
 #define ERR_GPIO_SET_LEVEL "Failed to change GPIO level"
 #define ERR_GPIO_SET_MODE "Failed to set GPIO mode"
 
+// List of all created controllers
+static rLoadController* _loadFirst = nullptr;
+static portMUX_TYPE _loadListLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Serializes changes of the state, counters and timers made by the application, esp_timer and bus worker tasks.
+// The lock is shared by all controllers, as a listener or coordinator may switch another load; it is created
+// once on first use (static initialization is thread-safe), the first controller may be created in any task
+static SemaphoreHandle_t loadLockHandle()
+{
+  static SemaphoreHandle_t lock = xSemaphoreCreateRecursiveMutex();
+  return lock;
+}
+
+// Nesting of the lock and the work collected under it, only the holder of the lock uses them
+static uint16_t _loadLockDepth = 0;
+static re_load_deferred_t _loadDeferred[CONFIG_LOADCTRL_DEFERRED_MAX];
+static uint8_t _loadDeferredCount = 0;
+
+static void loadLock()
+{
+  SemaphoreHandle_t lock = loadLockHandle();
+  if (lock) {
+    xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+    _loadLockDepth++;
+  };
+}
+
+static void loadUnlock()
+{
+  SemaphoreHandle_t lock = loadLockHandle();
+  if (lock == nullptr) return;
+  // Publishing, callbacks, listeners and NVS writes collected by the outermost section are done without the lock
+  re_load_deferred_t deferred[CONFIG_LOADCTRL_DEFERRED_MAX];
+  uint8_t count = 0;
+  if (--_loadLockDepth == 0) {
+    count = _loadDeferredCount;
+    if (count > 0) {
+      memcpy(deferred, _loadDeferred, count * sizeof(re_load_deferred_t));
+      _loadDeferredCount = 0;
+    };
+  };
+  xSemaphoreGiveRecursive(lock);
+  for (uint8_t i = 0; i < count; i++) {
+    deferred[i].ctrl->deferredRun(&deferred[i]);
+  };
+}
+
+// Adds the work to the queue of the current holder of the lock; false - it must be done right away
+static bool loadDeferredAdd(const re_load_deferred_t* item)
+{
+  if ((_loadLockDepth == 0) || (_loadDeferredCount >= CONFIG_LOADCTRL_DEFERRED_MAX)) return false;
+  _loadDeferred[_loadDeferredCount++] = *item;
+  return true;
+}
+
+static bool loadDeferredAdd(rLoadController* ctrl, uint8_t work)
+{
+  re_load_deferred_t item;
+  memset(&item, 0, sizeof(re_load_deferred_t));
+  item.ctrl = ctrl;
+  item.work = work;
+  return loadDeferredAdd(&item);
+}
+
+// Drops the work of a controller that is being deleted (under the lock)
+static void loadDeferredCancel(rLoadController* ctrl)
+{
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < _loadDeferredCount; i++) {
+    if (_loadDeferred[i].ctrl != ctrl) {
+      _loadDeferred[count++] = _loadDeferred[i];
+    };
+  };
+  _loadDeferredCount = count;
+}
+
+// Serializes NVS writes of the controllers: the data is taken under the load lock in the order it is written,
+// so an older copy never overwrites a newer one. It is always taken before the load lock, never under it
+static SemaphoreHandle_t loadStoreLockHandle()
+{
+  static SemaphoreHandle_t lock = xSemaphoreCreateRecursiveMutex();
+  return lock;
+}
+
+static void loadStoreLock()
+{
+  SemaphoreHandle_t lock = loadStoreLockHandle();
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+}
+
+static void loadStoreUnlock()
+{
+  SemaphoreHandle_t lock = loadStoreLockHandle();
+  if (lock) xSemaphoreGiveRecursive(lock);
+}
+
+#if CONFIG_LOADCTRL_RESTORE_ENABLED
+// Namespace for the saved state of all controllers, set by rLoadController::loadInitAll()
+static const char* _loadStateNvs = nullptr;
+static bool _loadStateRestoring = false;
+// Delayed write of the state, coalesces changes that follow each other
+static esp_timer_handle_t _loadStateTimer = nullptr;
+#endif // CONFIG_LOADCTRL_RESTORE_ENABLED
+
+#if CONFIG_LOADCTRL_LISTENERS_ENABLED
+// Protects lists of listeners of all controllers
+static portMUX_TYPE _loadListenersLock = portMUX_INITIALIZER_UNLOCKED;
+#endif // CONFIG_LOADCTRL_LISTENERS_ENABLED
+
+#if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+// Last wake slot in which a controller timer fired, only the esp_timer task uses it
+static int64_t _loadLowPowerSlot = -1;
+#endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+
+#if CONFIG_LOADCTRL_REPLAY_ENABLED
+// Virtual clock set by an offline replay
+static cb_load_clock_mono_t _loadClockMono = nullptr;
+static cb_load_clock_time_t _loadClockTime = nullptr;
+
+void loadClockSet(cb_load_clock_mono_t cb_mono, cb_load_clock_time_t cb_time)
+{
+  _loadClockMono = cb_mono;
+  _loadClockTime = cb_time;
+}
+#endif // CONFIG_LOADCTRL_REPLAY_ENABLED
+
+// Clock of the accounting: monotonic time since boot, us
+static int64_t loadClockMono()
+{
+  #if CONFIG_LOADCTRL_REPLAY_ENABLED
+    if (_loadClockMono) return _loadClockMono();
+  #endif // CONFIG_LOADCTRL_REPLAY_ENABLED
+  return esp_timer_get_time();
+}
+
+// Clock of the accounting: wall-clock time
+static time_t loadClockTime()
+{
+  #if CONFIG_LOADCTRL_REPLAY_ENABLED
+    if (_loadClockTime) return _loadClockTime();
+  #endif // CONFIG_LOADCTRL_REPLAY_ENABLED
+  return time(nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------- Common functions --------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------- Topic prefix -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+bool loadTopicPrefixSet(re_load_topic_prefix_t* prefix, char* topic)
+{
+  if (prefix) {
+    if (prefix->topic) free(prefix->topic);
+    prefix->topic = topic;
+    return (prefix->topic != nullptr);
+  };
+  if (topic) free(topic);
+  return false;
+}
+
+bool loadTopicPrefixCreate(re_load_topic_prefix_t* prefix, bool primary, bool local, const char* topic1, const char* topic2, const char* topic3)
+{
+  return loadTopicPrefixSet(prefix, mqttGetTopicDevice(primary, local, topic1, topic2, topic3));
+}
+
+void loadTopicPrefixFree(re_load_topic_prefix_t* prefix)
+{
+  if (prefix) {
+    if (prefix->topic) free(prefix->topic);
+    prefix->topic = nullptr;
+  };
+}
+
+char* loadTopicMake(const char* prefix, const char* suffix, int32_t index)
+{
+  if (prefix) {
+    if (suffix) {
+      return malloc_stringf("%s/%s", prefix, suffix);
+    } else if (index > -1) {
+      return malloc_stringf("%s/%d", prefix, index);
+    } else {
+      return malloc_string(prefix);
+    };
+  };
+  return nullptr;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Counters -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+uint64_t loadCycleDuration(uint32_t value, timeintv_t type)
+{
+  uint64_t duration = 1000 * (uint64_t)value;
+  switch (type) {
+    case TI_SECONDS:
+      duration = duration * 1000;
+      break;
+    case TI_MINUTES:
+      duration = duration * 1000 * 60;
+      break;
+    case TI_HOURS:
+      duration = duration * 1000 * 60 * 60;
+      break;
+    case TI_DAYS:
+      duration = duration * 1000 * 60 * 60 * 24;
+      break;
+    default:
+      break;
+  }
+  return duration;
+}
+
+#if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+// Rounds a duration or a deadline (us) up to a whole number of low-power wake slots
+static uint64_t loadLowPowerPhase(uint64_t value)
+{
+  const uint64_t slot = (uint64_t)CONFIG_LOADCTRL_LOWPOWER_SLOT * 1000;
+  return ((value + slot - 1) / slot) * slot;
+}
+#endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+
+void loadMetricsTime(uint32_t* min, uint32_t* max, uint64_t* sum, uint32_t count, uint32_t value)
+{
+  if ((count <= 1) || (value < *min)) *min = value;
+  if ((count <= 1) || (value > *max)) *max = value;
+  *sum = *sum + value;
+}
+
+static inline void loadCounterAdd(uint32_t* value, uint32_t add, uint32_t* overflow, uint32_t flag)
+{
+  if (*value > UINT32_MAX - add) {
+    *value = UINT32_MAX;
+    *overflow |= flag;
+  } else {
+    *value += add;
+  };
+}
+
+void loadCountersIncrement(re_load_counters_t* counters)
+{
+  counters->cntTotal++;
+  loadCounterAdd(&counters->cntToday, 1, &counters->cntOverflow, LOAD_OVF_DAY);
+  loadCounterAdd(&counters->cntWeekCurr, 1, &counters->cntOverflow, LOAD_OVF_WEEK);
+  loadCounterAdd(&counters->cntMonthCurr, 1, &counters->cntOverflow, LOAD_OVF_MONTH);
+  loadCounterAdd(&counters->cntPeriodCurr, 1, &counters->cntOverflow, LOAD_OVF_PERIOD);
+  loadCounterAdd(&counters->cntYearCurr, 1, &counters->cntOverflow, LOAD_OVF_YEAR);
+}
+
+void loadDurationsIncrement(re_load_durations_t* durations, uint32_t duration)
+{
+  durations->durLast = duration;
+  durations->durTotal = durations->durTotal + duration;
+  loadCounterAdd(&durations->durToday, duration, &durations->durOverflow, LOAD_OVF_DAY);
+  loadCounterAdd(&durations->durWeekCurr, duration, &durations->durOverflow, LOAD_OVF_WEEK);
+  loadCounterAdd(&durations->durMonthCurr, duration, &durations->durOverflow, LOAD_OVF_MONTH);
+  loadCounterAdd(&durations->durPeriodCurr, duration, &durations->durOverflow, LOAD_OVF_PERIOD);
+  loadCounterAdd(&durations->durYearCurr, duration, &durations->durOverflow, LOAD_OVF_YEAR);
+}
+
+uint32_t loadMonoDuration(int64_t mono_start, int64_t mono_end)
+{
+  if ((mono_start > 0) && (mono_end > mono_start)) {
+    return (uint32_t)((mono_end - mono_start) / 1000000);
+  };
+  return 0;
+}
+
+time_t loadMonoToTime(int64_t mono)
+{
+  // Converts the moment on the monotonic clock to the wall-clock time, if it is already known
+  time_t now = loadClockTime();
+  if ((mono > 0) && (now > LOAD_TIME_VALID)) {
+    return now - (time_t)((loadClockMono() - mono) / 1000000);
+  };
+  return 0;
+}
+
+void loadDurationsLive(re_load_durations_t* durations, bool state, uint32_t durCurr, re_load_durations_t* live)
+{
+  // Closed intervals plus the current on-interval, if the load is on
+  *live = *durations;
+  if (state) {
+    loadDurationsIncrement(live, durCurr);
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- JSON ---------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+#if CONFIG_LOADCTRL_TIMESTAMP_ENABLED
+
+char* loadTimestampsJSON(time_t last_on, time_t last_off)
+{
+  char _time_on[CONFIG_LOADCTRL_TIMESTAMP_BUF_SIZE];
+  char _time_off[CONFIG_LOADCTRL_TIMESTAMP_BUF_SIZE];
+
+  time2str_empty( CONFIG_LOADCTRL_TIMESTAMP_FORMAT, &last_on, &_time_on[0], sizeof(_time_on));
+  time2str_empty( CONFIG_LOADCTRL_TIMESTAMP_FORMAT, &last_off, &_time_off[0], sizeof(_time_off));
+
+  return malloc_stringf("{\"" CONFIG_LOADCTRL_ON "\":\"%s\",\"" CONFIG_LOADCTRL_OFF "\":\"%s\"}", _time_on, _time_off);
+}
+
+#endif // CONFIG_LOADCTRL_TIMESTAMP_ENABLED
+
+#if CONFIG_LOADCTRL_COUNTERS_ENABLED
+
+char* loadCountersJSON(re_load_counters_t* counters)
+{
+  return malloc_stringf("{\"" CONFIG_LOADCTRL_TOTAL "\":%llu,\"" CONFIG_LOADCTRL_TODAY "\":%d,\"" CONFIG_LOADCTRL_YESTERDAY "\":%d,\"" CONFIG_LOADCTRL_WEEK_CURR "\":%d,\"" CONFIG_LOADCTRL_WEEK_PREV "\":%d,\"" CONFIG_LOADCTRL_MONTH_CURR "\":%d,\"" CONFIG_LOADCTRL_MONTH_PREV "\":%d,\"" CONFIG_LOADCTRL_PERIOD_CURR "\":%d,\"" CONFIG_LOADCTRL_PERIOD_PREV "\":%d,\"" CONFIG_LOADCTRL_YEAR_CURR "\":%d,\"" CONFIG_LOADCTRL_YEAR_PREV "\":%d,\"" CONFIG_LOADCTRL_OVERFLOW "\":%d}", 
+    (unsigned long long)counters->cntTotal, 
+    counters->cntToday, counters->cntYesterday, 
+    counters->cntWeekCurr, counters->cntWeekPrev, 
+    counters->cntMonthCurr, counters->cntMonthPrev, 
+    counters->cntPeriodCurr, counters->cntPeriodPrev, 
+    counters->cntYearCurr, counters->cntYearPrev,
+    counters->cntOverflow);
+}
+
+#endif // CONFIG_LOADCTRL_COUNTERS_ENABLED
+
+#if CONFIG_LOADCTRL_DURATIONS_ENABLED
+
+char* loadDurationsJSON(re_load_durations_t* durations, bool state, uint32_t durCurr)
+{
+  re_load_durations_t live;
+  loadDurationsLive(durations, state, durCurr, &live);
+  return malloc_stringf("{\"" CONFIG_LOADCTRL_LAST "\":%d,\"" CONFIG_LOADCTRL_TOTAL "\":%llu,\"" CONFIG_LOADCTRL_TODAY "\":%d,\"" CONFIG_LOADCTRL_YESTERDAY "\":%d,\"" CONFIG_LOADCTRL_WEEK_CURR "\":%d,\"" CONFIG_LOADCTRL_WEEK_PREV "\":%d,\"" CONFIG_LOADCTRL_MONTH_CURR "\":%d,\"" CONFIG_LOADCTRL_MONTH_PREV "\":%d,\"" CONFIG_LOADCTRL_PERIOD_CURR "\":%d,\"" CONFIG_LOADCTRL_PERIOD_PREV "\":%d,\"" CONFIG_LOADCTRL_YEAR_CURR "\":%d,\"" CONFIG_LOADCTRL_YEAR_PREV "\":%d,\"" CONFIG_LOADCTRL_OVERFLOW "\":%d}", 
+    live.durLast, (unsigned long long)live.durTotal, 
+    live.durToday, live.durYesterday, 
+    live.durWeekCurr, live.durWeekPrev, 
+    live.durMonthCurr, live.durMonthPrev, 
+    live.durPeriodCurr, live.durPeriodPrev, 
+    live.durYearCurr, live.durYearPrev,
+    live.durOverflow);
+}
+
+#endif // CONFIG_LOADCTRL_DURATIONS_ENABLED
+
+// Status object without the closing bracket, so that the controller can append its own members
+static char* loadStatusJSONOpen(bool state, int32_t cycle_count, time_t last_on, time_t last_off, re_load_counters_t* counters, re_load_durations_t* durations, uint32_t durCurr)
+{
+  char* _json = malloc_stringf("{\"" CONFIG_LOADCTRL_STATUS "\":%d", state);
+  if (cycle_count > -1) {
+    _json = concat_strings(_json, malloc_stringf(",\"" CONFIG_LOADCTRL_CYCLES "\":%d", cycle_count));
+  };
+
+  #if CONFIG_LOADCTRL_TIMESTAMP_ENABLED
+    char * _json_time = loadTimestampsJSON(last_on, last_off);
+    if (_json_time) {
+      _json = concat_strings(_json, malloc_stringf(",\"" CONFIG_LOADCTRL_TIMESTAMP "\":%s", _json_time));
+      if (_json_time) free(_json_time);
+    };
+  #endif // CONFIG_LOADCTRL_TIMESTAMP_ENABLED
+  
+  #if CONFIG_LOADCTRL_DURATIONS_ENABLED
+    char* _json_durations = loadDurationsJSON(durations, state, durCurr);
+    if (_json_durations) {
+      _json = concat_strings(_json, malloc_stringf(",\"" CONFIG_LOADCTRL_DURATIONS "\":%s", _json_durations));
+      if (_json_durations) free(_json_durations);
+    };
+  #endif // CONFIG_LOADCTRL_DURATIONS_ENABLED
+
+  #if CONFIG_LOADCTRL_COUNTERS_ENABLED
+    char* _json_counters = loadCountersJSON(counters);
+    if (_json_counters) {
+      _json = concat_strings(_json, malloc_stringf(",\"" CONFIG_LOADCTRL_COUNTERS "\":%s", _json_counters));
+      if (_json_counters) free(_json_counters);
+    };
+  #endif // CONFIG_LOADCTRL_COUNTERS_ENABLED
+
+  return _json;
+}
+
+char* loadStatusJSON(bool state, int32_t cycle_count, time_t last_on, time_t last_off, re_load_counters_t* counters, re_load_durations_t* durations, uint32_t durCurr)
+{
+  return concat_strings(loadStatusJSONOpen(state, cycle_count, last_on, last_off, counters, durations, durCurr), malloc_string("}"));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------ Reading and saving counters from flash memory ------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+void loadCountersCatchUp(uint32_t daysNvs, uint32_t daysNow, uint8_t* period_start, 
+  re_load_counters_t* nvsCnt, re_load_durations_t* nvsDur, re_load_counters_t* counters, re_load_durations_t* durations)
+{
+  // Restore data (nvsCnt or nvsDur is nullptr if it was not found in NVS)
+  if (daysNow == daysNvs) {
+    // Data was saved today
+    if (nvsCnt) {
+      *counters = *nvsCnt;
+    };
+    if (nvsDur) {
+      *durations = *nvsDur;
+    };
+  } else {
+    // Restore total counters and overflow flags; the flags of the windows that have started anew are cleared below
+    uint32_t ovfKeep = 0;
+    if (nvsCnt) {
+      counters->cntTotal  = nvsCnt->cntTotal;
+      counters->cntOverflow = nvsCnt->cntOverflow;
+    };
+    if (nvsDur) {
+      durations->durLast = nvsDur->durLast;
+      durations->durTotal = nvsDur->durTotal;
+      durations->durOverflow = nvsDur->durOverflow;
+    };
+
+    // Decode week, month, period, and year
+    time_t timeNow = (time_t)daysNow * 86400 + 1;
+    time_t timeNvs = (time_t)daysNvs * 86400 + 1;
+    uint32_t weekNow = (daysNow + 3) / 7;
+    uint32_t weekNvs = (daysNvs + 3) / 7;
+    struct tm tmNow;
+    struct tm tmNvs;
+    localtime_r(&timeNow, &tmNow);
+    localtime_r(&timeNvs, &tmNvs);
+    uint8_t pmNow = 0;
+    uint8_t pmNvs = 0;
+    uint16_t pyNow = 0;
+    uint16_t pyNvs = 0;
+    if ((period_start) && (*period_start > 0)) {
+      pyNow = tmNow.tm_year;
+      if (tmNow.tm_mday < *period_start) {
+        pmNow = tmNow.tm_mon;
+      } else {
+        pmNow = tmNow.tm_mon + 1;
+        if (pmNow > 11) {
+          pyNow++;
+          pmNow = 0;
+        };
+      };
+      pyNvs = tmNvs.tm_year;
+      if (tmNvs.tm_mday < *period_start) {
+        pmNvs = tmNvs.tm_mon;
+      } else {
+        pmNvs = tmNvs.tm_mon + 1;
+        if (pmNvs > 11) {
+          pyNvs++;
+          pmNvs = 0;
+        };
+      };
+    };
+
+    // Data was saved on the previous day
+    if (daysNow == daysNvs + 1) {
+      if (nvsCnt) {
+        counters->cntToday = 0;
+        counters->cntYesterday = nvsCnt->cntToday;
+      };
+      if (nvsDur) {
+        durations->durToday = 0;
+        durations->durYesterday = nvsDur->durToday;
+      };
+    };
+
+    // Data was saved on the current week
+    if (weekNow == weekNvs) {
+      ovfKeep |= LOAD_OVF_WEEK;
+      if (nvsCnt) {
+        counters->cntWeekCurr = nvsCnt->cntWeekCurr;
+        counters->cntWeekPrev = nvsCnt->cntWeekPrev;
+      };
+      if (nvsDur) {
+        durations->durWeekCurr = nvsDur->durWeekCurr;
+        durations->durWeekPrev = nvsDur->durWeekPrev;
+      };
+    }
+    // Data was saved on the previous week
+    else if (weekNow == weekNvs + 1) {
+      if (nvsCnt) {
+        counters->cntWeekCurr = 0;
+        counters->cntWeekPrev = nvsCnt->cntWeekCurr;
+      };
+      if (nvsDur) {
+        durations->durWeekCurr = 0;
+        durations->durWeekPrev = nvsDur->durWeekCurr;
+      };
+    };
+
+    // Data was saved on the current month
+    if ((tmNow.tm_year == tmNvs.tm_year) && (tmNow.tm_mon == tmNvs.tm_mon)) {
+      ovfKeep |= LOAD_OVF_MONTH;
+      if (nvsCnt) {
+        counters->cntMonthCurr = nvsCnt->cntMonthCurr;
+        counters->cntMonthPrev = nvsCnt->cntMonthPrev;
+      };
+      if (nvsDur) {
+        durations->durMonthCurr = nvsDur->durMonthCurr;
+        durations->durMonthPrev = nvsDur->durMonthPrev;
+      };
+    }
+    // Data was saved on the previous month
+    else if (((tmNow.tm_year == tmNvs.tm_year) && (tmNow.tm_mon == tmNvs.tm_mon + 1)) 
+          || ((tmNow.tm_year == tmNvs.tm_year + 1) && (tmNow.tm_mon == 0) && (tmNvs.tm_mon == 11))) {
+      if (nvsCnt) {
+        counters->cntMonthCurr = 0;
+        counters->cntMonthPrev = nvsCnt->cntMonthCurr;
+      };
+      if (nvsDur) {
+        durations->durMonthCurr = 0;
+        durations->durMonthPrev = nvsDur->durMonthCurr;
+      };
+    };
+
+    // Data was saved on the current period
+    if ((pyNow == pyNvs) && (pmNow == pmNvs)) {
+      ovfKeep |= LOAD_OVF_PERIOD;
+      if (nvsCnt) {
+        counters->cntPeriodCurr = nvsCnt->cntPeriodCurr;
+        counters->cntPeriodPrev = nvsCnt->cntPeriodPrev;
+      };
+      if (nvsDur) {
+        durations->durPeriodCurr = nvsDur->durPeriodCurr;
+        durations->durPeriodPrev = nvsDur->durPeriodPrev;
+      };
+    }
+    // Data was saved on the previous period
+    else if (((pyNow == pyNvs) && (pmNow == pmNvs + 1)) 
+          || ((pyNow == pyNvs + 1) && (pmNow == 0) && (pmNvs == 11))) {
+      if (nvsCnt) {
+        counters->cntPeriodCurr = 0;
+        counters->cntPeriodPrev = nvsCnt->cntPeriodCurr;
+      };
+      if (nvsDur) {
+        durations->durPeriodCurr = 0;
+        durations->durPeriodPrev = nvsDur->durPeriodCurr;
+      };
+    };
+
+    // Data was saved on the current year
+    if (tmNow.tm_year == tmNvs.tm_year) {
+      ovfKeep |= LOAD_OVF_YEAR;
+      if (nvsCnt) {
+        counters->cntYearCurr = nvsCnt->cntYearCurr;
+        counters->cntYearPrev = nvsCnt->cntYearPrev;
+      };
+      if (nvsDur) {
+        durations->durYearCurr = nvsDur->durYearCurr;
+        durations->durYearPrev = nvsDur->durYearPrev;
+      };
+    } 
+    // Data was saved on the previous year
+    else if (tmNow.tm_year == tmNvs.tm_year + 1) {
+      if (nvsCnt) {
+        counters->cntYearCurr = 0;
+        counters->cntYearPrev = nvsCnt->cntYearCurr;
+      };
+      if (nvsDur) {
+        durations->durYearCurr = 0;
+        durations->durYearPrev = nvsDur->durYearCurr;
+      };
+    };
+
+    counters->cntOverflow &= ovfKeep;
+    durations->durOverflow &= ovfKeep;
+  };
+}
+
+// Size of one NVS entry: primitive values take one entry, blobs take a header and data entries plus an index entry
+#define LOAD_NVS_ENTRY_SIZE 32
+
+#if CONFIG_LOADCTRL_SLOTS_ENABLED
+
+static bool loadSnapshotRead(nvs_handle_t nvs_handle, uint8_t slot, re_load_snapshot_t* snapshot)
+{
+  char key[16];
+  snprintf(key, sizeof(key), "%s%d", CONFIG_LOADCTRL_SLOTS_KEY, slot);
+  size_t size = sizeof(re_load_snapshot_t);
+  if ((nvs_get_blob(nvs_handle, key, snapshot, &size) == ESP_OK) && (size == sizeof(re_load_snapshot_t))) {
+    return snapshot->crc == esp_rom_crc32_le(0, (const uint8_t*)snapshot, offsetof(re_load_snapshot_t, crc));
+  };
+  return false;
+}
+
+static int8_t loadSnapshotNewest(nvs_handle_t nvs_handle, re_load_snapshot_t* snapshot)
+{
+  // Slots with a broken CRC are skipped, sequence numbers are compared with wrap-around
+  int8_t ret = -1;
+  re_load_snapshot_t slot;
+  for (uint8_t i = 0; i < CONFIG_LOADCTRL_SLOTS_COUNT; i++) {
+    if (loadSnapshotRead(nvs_handle, i, &slot) && ((ret < 0) || ((int32_t)(slot.seq - snapshot->seq) > 0))) {
+      *snapshot = slot;
+      ret = i;
+    };
+  };
+  return ret;
+}
+
+static bool loadSnapshotRestore(const char* nvs_space, re_load_snapshot_t* snapshot)
+{
+  bool ret = false;
+  nvs_handle_t nvs_handle;
+  if (nvsOpen(nvs_space, NVS_READONLY, &nvs_handle)) {
+    ret = loadSnapshotNewest(nvs_handle, snapshot) >= 0;
+    nvs_close(nvs_handle);
+  };
+  return ret;
+}
+
+static bool loadSnapshotStore(const char* nvs_space, re_load_counters_t* counters, re_load_durations_t* durations, uint32_t* slot_seq)
+{
+  bool ret = false;
+  nvs_handle_t nvs_handle;
+  if (nvsOpen(nvs_space, NVS_READWRITE, &nvs_handle)) {
+    // The slot after the newest valid one, the other slots are not touched;
+    // all slots are read only if the sequence number is not yet known
+    re_load_snapshot_t snapshot;
+    uint32_t seq = 0;
+    if (slot_seq && (*slot_seq != 0)) {
+      seq = *slot_seq + 1;
+    } else {
+      seq = loadSnapshotNewest(nvs_handle, &snapshot) >= 0 ? snapshot.seq + 1 : 1;
+    };
+    // Zero marks an unknown sequence number
+    if (seq == 0) seq = 1;
+    memset((void*)&snapshot, 0, sizeof(re_load_snapshot_t));
+    snapshot.seq = seq;
+    snapshot.days = (uint32_t)(loadClockTime() / 86400);
+    snapshot.counters = *counters;
+    snapshot.durations = *durations;
+    snapshot.crc = esp_rom_crc32_le(0, (const uint8_t*)&snapshot, offsetof(re_load_snapshot_t, crc));
+    char key[16];
+    snprintf(key, sizeof(key), "%s%d", CONFIG_LOADCTRL_SLOTS_KEY, (uint8_t)(seq % CONFIG_LOADCTRL_SLOTS_COUNT));
+    esp_err_t err = nvs_set_blob(nvs_handle, key, &snapshot, sizeof(re_load_snapshot_t));
+    if (err == ESP_OK) {
+      err = nvs_commit(nvs_handle);
+    };
+    ret = (err == ESP_OK);
+    if (ret) {
+      if (slot_seq) *slot_seq = seq;
+    } else {
+      rlog_e(logTAG, "Failed to store counters to NVS slot %s: #%d %s", key, err, esp_err_to_name(err));
+    };
+    nvs_close(nvs_handle);
+  };
+  return ret;
+}
+
+#endif // CONFIG_LOADCTRL_SLOTS_ENABLED
+
+static void loadTotalNvsRestore(nvs_handle_t nvs_handle, uint64_t* total, uint32_t* overflow)
+{
+  if (nvs_get_u64(nvs_handle, CONFIG_LOADCTRL_TOTAL64, total) != ESP_OK) {
+    // Data saved by previous versions: 32-bit total, no flags
+    uint32_t total32 = 0;
+    RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_TOTAL, &total32));
+    *total = total32;
+    *overflow = 0;
+  } else {
+    RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_OVERFLOW, overflow));
+  };
+}
+
+#if !CONFIG_LOADCTRL_SLOTS_ENABLED
+static void loadTotalNvsStore(nvs_handle_t nvs_handle, uint64_t total, uint32_t overflow)
+{
+  RE_ERROR_LOG(nvs_set_u64(nvs_handle, CONFIG_LOADCTRL_TOTAL64, total));
+  RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_OVERFLOW, overflow));
+}
+#endif // !CONFIG_LOADCTRL_SLOTS_ENABLED
+
+void loadCountersNvsRestore(const char* nvs_space, uint8_t* period_start, re_load_counters_t* counters, re_load_durations_t* durations, uint32_t* slot_seq)
+{
+  if (nvs_space) {
+    // Number of days since UNIX epoch, discarding time
+    uint32_t daysNow = (uint32_t)(loadClockTime() / 86400);
+    uint32_t daysNvs = daysNow;
+
+    #if CONFIG_LOADCTRL_SLOTS_ENABLED
+      // Counters saved in slots; if there are none yet, they are read from the keys of previous versions
+      re_load_snapshot_t snapshot;
+      if (loadSnapshotRestore(nvs_space, &snapshot)) {
+        if (slot_seq) *slot_seq = snapshot.seq;
+        loadCountersCatchUp(snapshot.days, daysNow, period_start, &snapshot.counters, &snapshot.durations, counters, durations);
+        return;
+      };
+    #endif // CONFIG_LOADCTRL_SLOTS_ENABLED
+
+    nvs_handle_t nvs_handle;
+    if (nvsOpen(nvs_space, NVS_READONLY, &nvs_handle)) {
+      RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_DAYS, &daysNvs));
+      nvs_close(nvs_handle);
+    };
+
+    re_load_counters_t _nvsCnt;
+    bool _nvsCntEnabled = false;
+    char* nmsp_cnt = malloc_stringf("%s.cnt", nvs_space);
+    if (nmsp_cnt) {
+      nvs_handle_t nvs_handle;
+      if (nvsOpen(nmsp_cnt, NVS_READONLY, &nvs_handle)) {
+        _nvsCntEnabled = true;
+        loadTotalNvsRestore(nvs_handle, &_nvsCnt.cntTotal, &_nvsCnt.cntOverflow);
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_TODAY, &_nvsCnt.cntToday));
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_YESTERDAY, &_nvsCnt.cntYesterday));
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_CURR, &_nvsCnt.cntWeekCurr));
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_PREV, &_nvsCnt.cntWeekPrev));
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_CURR, &_nvsCnt.cntMonthCurr));
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_PREV, &_nvsCnt.cntMonthPrev));
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_CURR, &_nvsCnt.cntPeriodCurr));
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_PREV, &_nvsCnt.cntPeriodPrev));
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_CURR, &_nvsCnt.cntYearCurr));
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_PREV, &_nvsCnt.cntYearPrev));
+        nvs_close(nvs_handle);
+      };
+      free(nmsp_cnt);
+    };
+
+    re_load_durations_t _nvsDur;
+    bool _nvsDurEnabled = false;
+    char* nmsp_dur = malloc_stringf("%s.dur", nvs_space);
+    if (nmsp_dur) {
+      nvs_handle_t nvs_handle;
+      if (nvsOpen(nmsp_dur, NVS_READONLY, &nvs_handle)) {
+        _nvsDurEnabled = true;
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_LAST, &_nvsDur.durLast));
+        loadTotalNvsRestore(nvs_handle, &_nvsDur.durTotal, &_nvsDur.durOverflow);
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_TODAY, &_nvsDur.durToday));
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_YESTERDAY, &_nvsDur.durYesterday));
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_CURR, &_nvsDur.durWeekCurr));
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_PREV, &_nvsDur.durWeekPrev));
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_CURR, &_nvsDur.durMonthCurr));
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_PREV, &_nvsDur.durMonthPrev));
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_CURR, &_nvsDur.durPeriodCurr));
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_PREV, &_nvsDur.durPeriodPrev));
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_CURR, &_nvsDur.durYearCurr));
+        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_PREV, &_nvsDur.durYearPrev));
+        nvs_close(nvs_handle);
+      };
+      free(nmsp_dur);
+    };
+
+    // Restore data
+    loadCountersCatchUp(daysNvs, daysNow, period_start, 
+      _nvsCntEnabled ? &_nvsCnt : nullptr, _nvsDurEnabled ? &_nvsDur : nullptr, counters, durations);
+  };
+}
+
+bool loadCountersNvsStore(const char* nvs_space, re_load_counters_t* counters, re_load_durations_t* durations, uint32_t* slot_seq)
+{
+  // Nothing is written for a load that has never been switched on
+  bool ret = false;
+  if (nvs_space && (counters->cntTotal > 0)) {
+    #if CONFIG_LOADCTRL_SLOTS_ENABLED
+      ret = loadSnapshotStore(nvs_space, counters, durations, slot_seq);
+    #else
+      nvs_handle_t nvs_handle;
+      if (nvsOpen(nvs_space, NVS_READWRITE, &nvs_handle)) {
+        // Number of days since UNIX epoch, discarding time
+        uint32_t days = (uint32_t)(loadClockTime() / 86400);
+        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_DAYS, days));
+        ret = true;
+        RE_OK_CHECK(nvs_commit(nvs_handle), ret = false);
+        nvs_close(nvs_handle);
+      };
+
+      char* nmsp_cnt = malloc_stringf("%s.cnt", nvs_space);
+      if (nmsp_cnt) {
+        nvs_handle_t nvs_handle;
+        if (nvsOpen(nmsp_cnt, NVS_READWRITE, &nvs_handle)) {
+          loadTotalNvsStore(nvs_handle, counters->cntTotal, counters->cntOverflow);
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_TODAY, counters->cntToday));
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_YESTERDAY, counters->cntYesterday));
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_CURR, counters->cntWeekCurr));
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_PREV, counters->cntWeekPrev));
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_CURR, counters->cntMonthCurr));
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_PREV, counters->cntMonthPrev));
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_CURR, counters->cntPeriodCurr));
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_PREV, counters->cntPeriodPrev));
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_CURR, counters->cntYearCurr));
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_PREV, counters->cntYearPrev));
+          RE_OK_CHECK(nvs_commit(nvs_handle), ret = false);
+          nvs_close(nvs_handle);
+        } else {
+          ret = false;
+        };
+        free(nmsp_cnt);
+      } else {
+        ret = false;
+      };
+
+      char* nmsp_dur = malloc_stringf("%s.dur", nvs_space);
+      if (nmsp_dur) {
+        nvs_handle_t nvs_handle;
+        if (nvsOpen(nmsp_dur, NVS_READWRITE, &nvs_handle)) {
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_LAST, durations->durLast));
+          loadTotalNvsStore(nvs_handle, durations->durTotal, durations->durOverflow);
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_TODAY, durations->durToday));
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_YESTERDAY, durations->durYesterday));
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_CURR, durations->durWeekCurr));
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_PREV, durations->durWeekPrev));
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_CURR, durations->durMonthCurr));
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_PREV, durations->durMonthPrev));
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_CURR, durations->durPeriodCurr));
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_PREV, durations->durPeriodPrev));
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_CURR, durations->durYearCurr));
+          RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_PREV, durations->durYearPrev));
+          RE_OK_CHECK(nvs_commit(nvs_handle), ret = false);
+          nvs_close(nvs_handle);
+        } else {
+          ret = false;
+        };
+        free(nmsp_dur);
+      } else {
+        ret = false;
+      };
+    #endif // CONFIG_LOADCTRL_SLOTS_ENABLED
+  };
+  return ret;
+}
+
+uint32_t loadCountersNvsStoreSize()
+{
+  // Estimated number of bytes written to flash by one loadCountersNvsStore()
+  #if CONFIG_LOADCTRL_SLOTS_ENABLED
+    return (2 + (sizeof(re_load_snapshot_t) + LOAD_NVS_ENTRY_SIZE - 1) / LOAD_NVS_ENTRY_SIZE) * LOAD_NVS_ENTRY_SIZE;
+  #else
+    // Day of the store, 12 keys of counters and 13 keys of durations
+    return 26 * LOAD_NVS_ENTRY_SIZE;
+  #endif // CONFIG_LOADCTRL_SLOTS_ENABLED
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ----------------------------------------------------- Checkpoints -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+#if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+
+bool loadCheckpointStore(const char* nvs_space, re_load_checkpoint_t* checkpoint)
+{
+  bool ret = false;
+  nvs_handle_t nvs_handle;
+  if (nvs_space && nvsOpen(nvs_space, NVS_READWRITE, &nvs_handle)) {
+    esp_err_t err = nvs_set_blob(nvs_handle, CONFIG_LOADCTRL_CHECKPOINT_KEY, checkpoint, sizeof(re_load_checkpoint_t));
+    if (err == ESP_OK) {
+      err = nvs_commit(nvs_handle);
+    };
+    ret = (err == ESP_OK);
+    if (!ret) {
+      rlog_e(logTAG, "Failed to store checkpoint to NVS: #%d %s", err, esp_err_to_name(err));
+    };
+    nvs_close(nvs_handle);
+  };
+  return ret;
+}
+
+bool loadCheckpointRestore(const char* nvs_space, re_load_checkpoint_t* checkpoint)
+{
+  bool ret = false;
+  nvs_handle_t nvs_handle;
+  if (nvs_space && nvsOpen(nvs_space, NVS_READONLY, &nvs_handle)) {
+    size_t size = sizeof(re_load_checkpoint_t);
+    ret = (nvs_get_blob(nvs_handle, CONFIG_LOADCTRL_CHECKPOINT_KEY, checkpoint, &size) == ESP_OK) 
+       && (size == sizeof(re_load_checkpoint_t));
+    nvs_close(nvs_handle);
+  };
+  return ret;
+}
+
+bool loadCheckpointClear(const char* nvs_space)
+{
+  bool ret = false;
+  nvs_handle_t nvs_handle;
+  if (nvs_space && nvsOpen(nvs_space, NVS_READWRITE, &nvs_handle)) {
+    esp_err_t err = nvs_erase_key(nvs_handle, CONFIG_LOADCTRL_CHECKPOINT_KEY);
+    if (err == ESP_ERR_NVS_NOT_FOUND) err = ESP_OK;
+    if (err == ESP_OK) {
+      err = nvs_commit(nvs_handle);
+    };
+    ret = (err == ESP_OK);
+    nvs_close(nvs_handle);
+  };
+  return ret;
+}
+
+void loadCheckpointFold(re_load_checkpoint_t* checkpoint, re_load_counters_t* counters, re_load_durations_t* durations)
+{
+  if ((checkpoint->duration > 0) || (checkpoint->count > 0)) {
+    uint32_t daysNow = (uint32_t)(loadClockTime() / 86400);
+    uint32_t daysSaved = checkpoint->saved / 86400;
+    if ((checkpoint->saved > LOAD_TIME_VALID) && (daysSaved == daysNow)) {
+      // The checkpoint was saved today: everything it carries belongs to all current periods
+      loadDurationsIncrement(durations, checkpoint->duration);
+      counters->cntTotal = counters->cntTotal + checkpoint->count;
+      loadCounterAdd(&counters->cntToday, checkpoint->count, &counters->cntOverflow, LOAD_OVF_DAY);
+      loadCounterAdd(&counters->cntWeekCurr, checkpoint->count, &counters->cntOverflow, LOAD_OVF_WEEK);
+      loadCounterAdd(&counters->cntMonthCurr, checkpoint->count, &counters->cntOverflow, LOAD_OVF_MONTH);
+      loadCounterAdd(&counters->cntPeriodCurr, checkpoint->count, &counters->cntOverflow, LOAD_OVF_PERIOD);
+      loadCounterAdd(&counters->cntYearCurr, checkpoint->count, &counters->cntOverflow, LOAD_OVF_YEAR);
+    } else {
+      // The checkpoint was saved earlier, only the totals are known for sure
+      durations->durTotal = durations->durTotal + checkpoint->duration;
+      counters->cntTotal = counters->cntTotal + checkpoint->count;
+      if ((checkpoint->saved > LOAD_TIME_VALID) && (daysSaved + 1 == daysNow)) {
+        loadCounterAdd(&durations->durYesterday, checkpoint->duration, &durations->durOverflow, LOAD_OVF_DAY);
+        loadCounterAdd(&counters->cntYesterday, checkpoint->count, &counters->cntOverflow, LOAD_OVF_DAY);
+      };
+    };
+    durations->durLast = checkpoint->last;
+  };
+}
+
+#endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Relay wear -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+#if CONFIG_LOADCTRL_WEAR_ENABLED
+
+uint32_t loadWearWeight(const re_load_wear_config_t* config)
+{
+  // Derating by load type, 1/1000
+  static const uint32_t factors[] = { 1000, 2000, 3000, 5000 };
+  uint32_t weight = config->type < sizeof(factors) / sizeof(factors[0]) ? factors[config->type] : factors[0];
+  // Contact erosion grows roughly with the square of the current; below 30% of the rated current the mechanical life prevails
+  if ((config->rated_current > 0) && (config->load_current > 0)) {
+    uint32_t ratio = (uint32_t)config->load_current * 1000 / config->rated_current;
+    uint32_t factor = ratio * ratio / 1000;
+    if (factor < 100) factor = 100;
+    weight = (uint32_t)((uint64_t)weight * factor / 1000);
+  };
+  return weight;
+}
+
+uint32_t loadWearConsumed(const re_load_wear_config_t* config, const re_load_wear_t* wear)
+{
+  // Consumed part of the relay life, 1/1000000
+  uint64_t consumed = 0;
+  if (config->life_cycles > 0) {
+    consumed += wear->cycles * 1000 / config->life_cycles;
+  };
+  if (config->life_hours > 0) {
+    consumed += wear->on_time * 1000000 / ((uint64_t)config->life_hours * 3600);
+  };
+  return consumed < 1000000 ? (uint32_t)consumed : 1000000;
+}
+
+bool loadWearNvsStore(const char* nvs_space, re_load_wear_t* wear)
+{
+  bool ret = false;
+  nvs_handle_t nvs_handle;
+  if (nvs_space && nvsOpen(nvs_space, NVS_READWRITE, &nvs_handle)) {
+    esp_err_t err = nvs_set_blob(nvs_handle, CONFIG_LOADCTRL_WEAR_KEY, wear, sizeof(re_load_wear_t));
+    if (err == ESP_OK) {
+      err = nvs_commit(nvs_handle);
+    };
+    ret = (err == ESP_OK);
+    if (!ret) {
+      rlog_e(logTAG, "Failed to store relay wear to NVS: #%d %s", err, esp_err_to_name(err));
+    };
+    nvs_close(nvs_handle);
+  };
+  return ret;
+}
+
+bool loadWearNvsRestore(const char* nvs_space, re_load_wear_t* wear)
+{
+  bool ret = false;
+  nvs_handle_t nvs_handle;
+  if (nvs_space && nvsOpen(nvs_space, NVS_READONLY, &nvs_handle)) {
+    size_t size = sizeof(re_load_wear_t);
+    ret = (nvs_get_blob(nvs_handle, CONFIG_LOADCTRL_WEAR_KEY, wear, &size) == ESP_OK) && (size == sizeof(re_load_wear_t));
+    nvs_close(nvs_handle);
+  };
+  if (!ret) {
+    memset((void*)wear, 0, sizeof(re_load_wear_t));
+  };
+  return ret;
+}
+
+#endif // CONFIG_LOADCTRL_WEAR_ENABLED
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------- Event handlers ----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+void loadCountersTimeEvent(re_load_counters_t* counters, re_load_durations_t* durations, uint8_t* period_start, int32_t event_id, void* event_data)
+{
+  // Start of the day
+  // The overflow flag of a window is cleared together with its counter
+  if (event_id == RE_TIME_START_OF_DAY) {
+    counters->cntYesterday = counters->cntToday;
+    counters->cntToday = 0;
+    counters->cntOverflow &= ~LOAD_OVF_DAY;
+    durations->durYesterday = durations->durToday;
+    durations->durToday = 0;
+    durations->durOverflow &= ~LOAD_OVF_DAY;
+
+    if ((event_data) && (period_start)) {
+      int* mday = (int*)event_data;
+      if (*mday == *period_start) {
+        counters->cntPeriodPrev = counters->cntPeriodCurr;
+        counters->cntPeriodCurr = 0;
+        counters->cntOverflow &= ~LOAD_OVF_PERIOD;
+        durations->durPeriodPrev = durations->durPeriodCurr;
+        durations->durPeriodCurr = 0;
+        durations->durOverflow &= ~LOAD_OVF_PERIOD;
+      };
+    };
+  }
+  // Beginning of the week
+  else if (event_id == RE_TIME_START_OF_WEEK) {
+    counters->cntWeekPrev = counters->cntWeekCurr;
+    counters->cntWeekCurr = 0;
+    counters->cntOverflow &= ~LOAD_OVF_WEEK;
+    durations->durWeekPrev = durations->durWeekCurr;
+    durations->durWeekCurr = 0;
+    durations->durOverflow &= ~LOAD_OVF_WEEK;
+  }
+  // Beginning of the month
+  else if (event_id == RE_TIME_START_OF_MONTH) {
+    counters->cntMonthPrev = counters->cntMonthCurr;
+    counters->cntMonthCurr = 0;
+    counters->cntOverflow &= ~LOAD_OVF_MONTH;
+    durations->durMonthPrev = durations->durMonthCurr;
+    durations->durMonthCurr = 0;
+    durations->durOverflow &= ~LOAD_OVF_MONTH;
+  }
+  // Beginning of the year
+  else if (event_id == RE_TIME_START_OF_YEAR) {
+    counters->cntYearPrev = counters->cntYearCurr;
+    counters->cntYearCurr  = 0;
+    counters->cntOverflow &= ~LOAD_OVF_YEAR;
+    durations->durYearPrev = durations->durYearCurr;
+    durations->durYearCurr  = 0;
+    durations->durOverflow &= ~LOAD_OVF_YEAR;
+  };
+}
+
 // -----------------------------------------------------------------------------------------------------------------------
 // --------------------------------------------------- rLoadController ---------------------------------------------------
 // -----------------------------------------------------------------------------------------------------------------------
@@ -30,6 +1076,7 @@ rLoadController::rLoadController(uint8_t pin, uint8_t level_on, bool use_timer,
   _state = false;
   _last_on = 0;
   _last_off = 0;
+  _mono_on = 0;
   _cycle_duration = cycle_duration;
   _cycle_interval = cycle_interval;
   _cycle_type = cycle_type;
@@ -42,6 +1089,43 @@ rLoadController::rLoadController(uint8_t pin, uint8_t level_on, bool use_timer,
   _timer_on = nullptr;
   _timer_free = !use_timer;
   _timer_cycle = nullptr;
+  _reject = LOAD_REJECT_NONE;
+  #if CONFIG_LOADCTRL_TOPIC_PREFIX_ENABLED
+    _mqtt_prefix = nullptr;
+    _mqtt_suffix = nullptr;
+  #endif // CONFIG_LOADCTRL_TOPIC_PREFIX_ENABLED
+  #if CONFIG_LOADCTRL_POWER_ENABLED
+    _power = nullptr;
+    _power_granted = false;
+  #endif // CONFIG_LOADCTRL_POWER_ENABLED
+  #if CONFIG_LOADCTRL_BUS_ENABLED
+    _bus = nullptr;
+  #endif // CONFIG_LOADCTRL_BUS_ENABLED
+  #if CONFIG_LOADCTRL_INTERLOCK_ENABLED
+    _interlock = nullptr;
+  #endif // CONFIG_LOADCTRL_INTERLOCK_ENABLED
+  #if CONFIG_LOADCTRL_LISTENERS_ENABLED
+    memset(_listeners, 0, sizeof(_listeners));
+    _source = LOAD_SOURCE_COMMAND;
+  #endif // CONFIG_LOADCTRL_LISTENERS_ENABLED
+  #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+    _timer_checkpoint = nullptr;
+    _checkpoint_interval = 0;
+    _checkpoint_saved = false;
+    _checkpoint_mono = 0;
+  #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+  #if CONFIG_LOADCTRL_WEAR_ENABLED
+    memset((void*)&_wear_config, 0, sizeof(re_load_wear_config_t));
+    memset((void*)&_wear, 0, sizeof(re_load_wear_t));
+    _wear_weight = loadWearWeight(&_wear_config);
+  #endif // CONFIG_LOADCTRL_WEAR_ENABLED
+  #if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+    _low_power = false;
+    _cycle_start = 0;
+    _publish_pending = false;
+    _store_pending = false;
+    _state_pending = false;
+  #endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
 
   // Callbacks
   _gpio_before = cb_gpio_before;
@@ -51,12 +1135,45 @@ rLoadController::rLoadController(uint8_t pin, uint8_t level_on, bool use_timer,
 
   // Clear counters
   countersReset();
+  #if CONFIG_LOADCTRL_METRICS_ENABLED
+    metricsReset();
+  #endif // CONFIG_LOADCTRL_METRICS_ENABLED
+
+  // Add to the list of all controllers
+  portENTER_CRITICAL(&_loadListLock);
+  _next = _loadFirst;
+  _loadFirst = this;
+  portEXIT_CRITICAL(&_loadListLock);
 }
 
 rLoadController::~rLoadController()
 {
+  #if CONFIG_LOADCTRL_POWER_ENABLED
+    if (_power) _power->loadRemove(this);
+  #endif // CONFIG_LOADCTRL_POWER_ENABLED
+  #if CONFIG_LOADCTRL_INTERLOCK_ENABLED
+    if (_interlock) _interlock->loadRemove(this);
+  #endif // CONFIG_LOADCTRL_INTERLOCK_ENABLED
+
+  // Remove from the list of all controllers, not while another task walks through it
+  loadLock();
+  loadDeferredCancel(this);
+  portENTER_CRITICAL(&_loadListLock);
+  rLoadController** item = &_loadFirst;
+  while (*item) {
+    if (*item == this) {
+      *item = _next;
+      break;
+    };
+    item = &(*item)->_next;
+  };
+  portEXIT_CRITICAL(&_loadListLock);
+  loadUnlock();
   cycleFree();
   timerFree();
+  #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+    checkpointSetInterval(0);
+  #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
   if (_mqtt_topic) free(_mqtt_topic);
   _mqtt_topic = nullptr;
 }
@@ -77,97 +1194,678 @@ void rLoadController::setCallbacks(cb_load_change_t cb_gpio_before, cb_load_chan
   _state_changed = cb_state_changed;
 }
 
+re_load_reject_t rLoadController::getLastReject()
+{
+  return _reject;
+}
+
+#if CONFIG_LOADCTRL_POWER_ENABLED
+
+void rLoadController::setPowerBudget(rLoadPowerBudget* power)
+{
+  _power = power;
+}
+
+rLoadPowerBudget* rLoadController::getPowerBudget()
+{
+  return _power;
+}
+
+#endif // CONFIG_LOADCTRL_POWER_ENABLED
+
+#if CONFIG_LOADCTRL_INTERLOCK_ENABLED
+
+void rLoadController::setInterlock(rLoadInterlock* interlock)
+{
+  _interlock = interlock;
+}
+
+rLoadInterlock* rLoadController::getInterlock()
+{
+  return _interlock;
+}
+
+#endif // CONFIG_LOADCTRL_INTERLOCK_ENABLED
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------------- Load --------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+bool rLoadController::loadInit(bool init_state)
+{
+  if (!_timer_free) timerCreate();
+  return loadInitGPIO() && loadSetState(init_state, true, false);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------- Restoring state ----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+#if CONFIG_LOADCTRL_RESTORE_ENABLED
+
+void rLoadController::setRestorePolicy(re_load_restore_t policy)
+{
+  _restore = policy;
+}
+
+re_load_restore_t rLoadController::getRestorePolicy()
+{
+  return _restore;
+}
+
+void rLoadController::stateGet(re_load_state_rec_t* rec, int64_t mono_now, time_t now)
+{
+  memset(rec, 0, sizeof(re_load_state_rec_t));
+  rec->pin = _pin;
+  rec->state = _state;
+  int32_t cycle_count = getCycleCount();
+  rec->cycle_count = cycle_count > 0 ? (uint16_t)cycle_count : 0;
+  if (_state && timerIsActive() && (_timer_on_deadline > mono_now)) {
+    rec->timer = 1;
+    rec->timer_left = (uint32_t)((_timer_on_deadline - mono_now) / 1000);
+    if (now > LOAD_TIME_VALID) {
+      rec->timer_end = (uint32_t)now + rec->timer_left / 1000;
+    };
+  };
+}
+
+bool rLoadController::stateNvsStoreAll()
+{
+  // The records are taken under the load lock, the blob is written without it
+  loadStoreLock();
+  loadLock();
+  // A delayed write is no longer needed
+  if ((_loadStateTimer != nullptr) && esp_timer_is_active(_loadStateTimer)) {
+    esp_timer_stop(_loadStateTimer);
+  };
+  size_t size = 0;
+  re_load_state_hdr_t* hdr = stateGetAll(&size);
+  loadUnlock();
+
+  bool ret = false;
+  if (hdr) {
+    nvs_handle_t nvs_handle;
+    if (nvsOpen(_loadStateNvs, NVS_READWRITE, &nvs_handle)) {
+      esp_err_t err = nvs_set_blob(nvs_handle, CONFIG_LOADCTRL_STATE_KEY, hdr, size);
+      if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+      };
+      ret = (err == ESP_OK);
+      if (!ret) {
+        rlog_e(logTAG, "Failed to store load states to NVS: #%d %s", err, esp_err_to_name(err));
+      };
+      nvs_close(nvs_handle);
+    };
+    free(hdr);
+  };
+  loadStoreUnlock();
+  return ret;
+}
+
+re_load_state_hdr_t* rLoadController::stateGetAll(size_t* size)
+{
+  if ((_loadStateNvs == nullptr) || _loadStateRestoring) return nullptr;
+
+  // The state of all controllers is written with one blob
+  uint16_t count = 0;
+  rLoadController* ctrl = _loadFirst;
+  while (ctrl && (count < UINT16_MAX)) {
+    count++;
+    ctrl = ctrl->_next;
+  };
+  if (count == 0) return nullptr;
+  *size = sizeof(re_load_state_hdr_t) + (size_t)count * sizeof(re_load_state_rec_t);
+  re_load_state_hdr_t* hdr = (re_load_state_hdr_t*)calloc(1, *size);
+  if (hdr == nullptr) {
+    rlog_e(logTAG, "Failed to allocate memory for load states");
+    return nullptr;
+  };
+  re_load_state_rec_t* recs = (re_load_state_rec_t*)(hdr + 1);
+  int64_t mono_now = esp_timer_get_time();
+  time_t now = loadClockTime();
+  ctrl = _loadFirst;
+  while (ctrl && (hdr->count < count)) {
+    ctrl->stateGet(&recs[hdr->count++], mono_now, now);
+    ctrl = ctrl->_next;
+  };
+  return hdr;
+}
+
+#if CONFIG_LOADCTRL_STATE_DELAY > 0
+static void loadStateTimerEnd(void* arg)
+{
+  rLoadController::stateNvsStoreAll();
+}
+#endif // CONFIG_LOADCTRL_STATE_DELAY
+
+void rLoadController::stateNvsStoreRequest()
+{
+  #if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+    if (_low_power) {
+      _state_pending = true;
+      _lowpower.storeDeferred++;
+      return;
+    };
+  #endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+  if (!loadDeferredAdd(this, LOAD_DEFER_STATE)) {
+    stateNvsStoreSchedule();
+  };
+}
+
+void rLoadController::stateNvsStoreSchedule()
+{
+  #if CONFIG_LOADCTRL_STATE_DELAY > 0
+    // Each write rewrites the blob of all controllers: changes within the delay are written once, with the state at that moment
+    bool delayed = false;
+    loadLock();
+    if (_loadStateTimer == nullptr) {
+      esp_timer_create_args_t cfg;
+      memset(&cfg, 0, sizeof(esp_timer_create_args_t));
+      cfg.name = "load_ctrl_state";
+      cfg.callback = loadStateTimerEnd;
+      cfg.arg = nullptr;
+      if (esp_timer_create(&cfg, &_loadStateTimer) != ESP_OK) {
+        _loadStateTimer = nullptr;
+      };
+    };
+    if (_loadStateTimer != nullptr) {
+      delayed = esp_timer_is_active(_loadStateTimer)
+             || (esp_timer_start_once(_loadStateTimer, (uint64_t)CONFIG_LOADCTRL_STATE_DELAY * 1000) == ESP_OK);
+    };
+    loadUnlock();
+    if (delayed) return;
+  #endif // CONFIG_LOADCTRL_STATE_DELAY
+  stateNvsStoreAll();
+}
+
+bool rLoadController::loadInitRestore(re_load_state_rec_t* rec)
+{
+  bool new_state = false;
+  uint32_t timer_left = 0;
+  switch (_restore) {
+    case LOAD_RESTORE_ON:
+      new_state = true;
+      break;
+    case LOAD_RESTORE_LAST:
+      new_state = rec && rec->state && !rec->timer;
+      break;
+    case LOAD_RESTORE_TIMER:
+      if (rec && rec->state) {
+        if (rec->timer) {
+          // If the clock is already set, the time spent without power is also taken into account
+          time_t now = loadClockTime();
+          if ((rec->timer_end > LOAD_TIME_VALID) && (now > LOAD_TIME_VALID)) {
+            timer_left = rec->timer_end > (uint32_t)now ? (rec->timer_end - (uint32_t)now) * 1000 : 0;
+          } else {
+            timer_left = rec->timer_left;
+          };
+          new_state = timer_left > 0;
+        } else {
+          new_state = true;
+        };
+      };
+      break;
+    default:
+      break;
+  };
+
+  if (!_timer_free) timerCreate();
+  if (!loadInitGPIO()) return false;
+  #if CONFIG_LOADCTRL_LISTENERS_ENABLED
+    _source = LOAD_SOURCE_RESTORE;
+  #endif // CONFIG_LOADCTRL_LISTENERS_ENABLED
+  // Nothing is published during boot, the state is published when MQTT connects
+  bool ret = false;
+  loadLock();
+  if (timer_left > 0) {
+    ret = loadSetTimerPriv(timer_left, false);
+  } else {
+    ret = loadSetStateCmd(new_state, true, false);
+  };
+  // The pulse mode starts from the beginning of the switch-on phase, but the cycle counter is continued
+  if (ret && new_state && rec && (_cycle_count >= 0)) {
+    _cycle_count += rec->cycle_count;
+  };
+  loadUnlock();
+  return ret;
+}
+
+bool rLoadController::loadInitAll(const char* nvs_space)
+{
+  _loadStateNvs = nvs_space;
+
+  // Reading the state of all controllers with one blob, its size is checked against the stored number of records
+  re_load_state_hdr_t* hdr = nullptr;
+  uint16_t count = 0;
+  if (nvs_space) {
+    nvs_handle_t nvs_handle;
+    if (nvsOpen(nvs_space, NVS_READONLY, &nvs_handle)) {
+      size_t size = 0;
+      if ((nvs_get_blob(nvs_handle, CONFIG_LOADCTRL_STATE_KEY, nullptr, &size) == ESP_OK) && (size >= sizeof(re_load_state_hdr_t))) {
+        hdr = (re_load_state_hdr_t*)malloc(size);
+        if (hdr) {
+          if ((nvs_get_blob(nvs_handle, CONFIG_LOADCTRL_STATE_KEY, hdr, &size) == ESP_OK)
+           && (size == sizeof(re_load_state_hdr_t) + (size_t)hdr->count * sizeof(re_load_state_rec_t))) {
+            count = hdr->count;
+          } else {
+            rlog_w(logTAG, "Saved load states are damaged or have an old format and are ignored");
+          };
+        };
+      };
+      nvs_close(nvs_handle);
+    };
+  };
+  re_load_state_rec_t* recs = hdr ? (re_load_state_rec_t*)(hdr + 1) : nullptr;
+
+  // Restoring, the state is saved once at the end
+  bool ret = true;
+  uint16_t i = 0;
+  _loadStateRestoring = true;
+  rLoadController* ctrl = _loadFirst;
+  while (ctrl) {
+    re_load_state_rec_t* rec = nullptr;
+    if ((i < count) && (recs[i].pin == ctrl->_pin)) {
+      rec = &recs[i];
+    };
+    if (!ctrl->loadInitRestore(rec)) {
+      ret = false;
+    };
+    ctrl = ctrl->_next;
+    if (i < UINT16_MAX) i++;
+  };
+  _loadStateRestoring = false;
+  if (hdr) free(hdr);
+  stateNvsStoreAll();
+  return ret;
+}
+
+#endif // CONFIG_LOADCTRL_RESTORE_ENABLED
+
+bool rLoadController::loadSetStatePriv(bool new_state, uint8_t async_flags)
+{
+  uint8_t phy_level = new_state ? _level_on : !_level_on;
+  #if CONFIG_LOADCTRL_BUS_ENABLED
+    if (_bus) {
+      // The level will be written by the bus worker, the rest of the work will be done upon completion
+      return _bus->submit(this, phy_level, async_flags);
+    };
+  #endif // CONFIG_LOADCTRL_BUS_ENABLED
+  return loadWriteGPIO(phy_level);
+}
+
+bool rLoadController::loadWriteGPIO(uint8_t phy_level)
+{
+  if (_gpio_before) { 
+    _gpio_before(this, phy_level, 0); 
+  };
+  #if CONFIG_LOADCTRL_METRICS_ENABLED
+    int64_t time_start = esp_timer_get_time();
+    bool ret = loadSetStateGPIO(phy_level);
+    uint32_t time_write = (uint32_t)(esp_timer_get_time() - time_start);
+    _metrics.gpioCount++;
+    if (!ret) _metrics.gpioFailed++;
+    loadMetricsTime(&_metrics.gpioMin, &_metrics.gpioMax, &_metrics.gpioSum, _metrics.gpioCount, time_write);
+  #else
+    bool ret = loadSetStateGPIO(phy_level);
+  #endif // CONFIG_LOADCTRL_METRICS_ENABLED
+  if (_gpio_after) { 
+    _gpio_after(this, phy_level, 0); 
+  };
+  return ret;
+}
+
+bool rLoadController::loadSetState(bool new_state, bool forced, bool publish)
+{
+  loadLock();
+  bool ret = loadSetStateCmd(new_state, forced, publish);
+  loadUnlock();
+  return ret;
+}
+
+bool rLoadController::loadTargetState()
+{
+  #if CONFIG_LOADCTRL_BUS_ENABLED
+    // The worker has not yet written the last submitted level, _state still holds the previous one
+    if (_bus_pending > 0) return _bus_target;
+  #endif // CONFIG_LOADCTRL_BUS_ENABLED
+  return _state;
+}
+
+bool rLoadController::loadOnPending()
+{
+  #if CONFIG_LOADCTRL_BUS_ENABLED
+    return (_bus_pending > 0) && _bus_target;
+  #else
+    return false;
+  #endif // CONFIG_LOADCTRL_BUS_ENABLED
+}
+
+bool rLoadController::loadSetStateCmd(bool new_state, bool forced, bool publish)
+{
+  // Requests are compared with the state that the load will have after all submitted switchings
+  bool target = loadTargetState();
+
+  #if CONFIG_LOADCTRL_POWER_ENABLED
+    bool granted = _power_granted;
+    _power_granted = false;
+  #endif // CONFIG_LOADCTRL_POWER_ENABLED
+
+  // Switching off cancels a pending switch-on request
+  if (!new_state) {
+    #if CONFIG_LOADCTRL_POWER_ENABLED
+      if (_power) _power->requestCancel(this);
+    #endif // CONFIG_LOADCTRL_POWER_ENABLED
+    #if CONFIG_LOADCTRL_INTERLOCK_ENABLED
+      if (_interlock && !target) _interlock->release(this, false);
+    #endif // CONFIG_LOADCTRL_INTERLOCK_ENABLED
+  };
+
+  _reject = LOAD_REJECT_NONE;
+  if (forced || (target != new_state)) {
+    #if CONFIG_LOADCTRL_INTERLOCK_ENABLED
+      // Switch-on must be allowed by the interlock group: the check and the claim are atomic
+      if (_interlock && new_state && !target) {
+        _reject = _interlock->requestOn(this, publish);
+        if (_reject != LOAD_REJECT_NONE) {
+          #if CONFIG_LOADCTRL_LISTENERS_ENABLED
+            _source = LOAD_SOURCE_COMMAND;
+          #endif // CONFIG_LOADCTRL_LISTENERS_ENABLED
+          return false;
+        };
+      };
+    #endif // CONFIG_LOADCTRL_INTERLOCK_ENABLED
+
+    #if CONFIG_LOADCTRL_POWER_ENABLED
+      // Switch-on must fit into the power budget, otherwise the request is queued
+      if (_power && new_state && !target && !granted) {
+        if (!_power->requestOn(this, publish)) {
+          _reject = LOAD_REJECT_POWER;
+          #if CONFIG_LOADCTRL_LISTENERS_ENABLED
+            _source = LOAD_SOURCE_COMMAND;
+          #endif // CONFIG_LOADCTRL_LISTENERS_ENABLED
+          return false;
+        };
+      };
+    #endif // CONFIG_LOADCTRL_POWER_ENABLED
+
+    bool change_ok = false;
+    uint8_t async_flags = LOAD_ASYNC_FINALIZE | (new_state ? LOAD_ASYNC_STATE_ON : 0) | (publish ? LOAD_ASYNC_PUBLISH : 0);
+    if ((_cycle_duration) && (*_cycle_duration > 0) && (_cycle_interval) && (*_cycle_interval > 0)) {
+      // Activate cycle timer
+      if (new_state) _cycle_count = 0;
+      change_ok = cycleSetCyclePriv(new_state, async_flags);
+    } else {
+      // Set physical level to GPIO
+      _cycle_count = -1;
+      cycleFree();
+      change_ok = loadSetStatePriv(new_state, async_flags);
+    };
+
+    #if CONFIG_LOADCTRL_BUS_ENABLED
+      // The change is submitted to the bus worker and will be finalized in loadCompleteGPIO()
+      if (change_ok && _bus) {
+        _bus_target = new_state;
+        _bus_pending++;
+        return true;
+      };
+    #endif // CONFIG_LOADCTRL_BUS_ENABLED
+
+    // If the change level was successful
+    if (change_ok && (_state != new_state)) {
+      loadSetStateFinalize(new_state, publish);
+      return true;
+    };
+
+    // Switching on failed, the reserved power and the interlock claim are no longer needed
+    if (!change_ok) {
+      _reject = LOAD_REJECT_GPIO;
+    };
+    if (new_state && !target) {
+      loadReleaseClaims(false);
+    };
+  };
+  #if CONFIG_LOADCTRL_LISTENERS_ENABLED
+    // Nothing has changed, the next change will be attributed to the application
+    _source = LOAD_SOURCE_COMMAND;
+  #endif // CONFIG_LOADCTRL_LISTENERS_ENABLED
+  return false;
+}
+
+void rLoadController::loadReleaseClaims(bool was_on)
+{
+  #if CONFIG_LOADCTRL_POWER_ENABLED
+    if (_power) _power->release(this);
+  #endif // CONFIG_LOADCTRL_POWER_ENABLED
+  #if CONFIG_LOADCTRL_INTERLOCK_ENABLED
+    if (_interlock) _interlock->release(this, was_on);
+  #endif // CONFIG_LOADCTRL_INTERLOCK_ENABLED
+}
+
+void rLoadController::loadSetStateFinalize(bool new_state, bool publish)
+{
+  #if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+    // Phases derived from the schedule are counted only while the load is on: they are fixed before _state is cleared
+    if (_state && !new_state) {
+      _cycle_count = getCycleCount();
+    };
+  #endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+  _state = new_state;
+  int64_t mono_now = loadClockMono();
+  if (_state) {
+    _mono_on = mono_now;
+    _last_on = loadClockTime();
+    _durations.durLast = 0;
+    loadCountersIncrement(&_counters);
+    #if CONFIG_LOADCTRL_WEAR_ENABLED
+      _wear.cycles += _wear_weight;
+    #endif // CONFIG_LOADCTRL_WEAR_ENABLED
+    #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+      checkpointStart();
+    #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+    rlog_i(logTAG, "Load on GPIO %d is ON", _pin);
+  } else {
+    _last_off = loadClockTime();
+    timerStop();
+    #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+      checkpointStop();
+    #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+    // The turn-on duration is calculated by the monotonic clock, so it does not depend on SNTP synchronization and time zone
+    loadDurationsIncrement(&_durations, loadMonoDuration(_mono_on, mono_now));
+    #if CONFIG_LOADCTRL_WEAR_ENABLED
+      _wear.on_time += _durations.durLast;
+    #endif // CONFIG_LOADCTRL_WEAR_ENABLED
+    #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+      checkpointRefresh();
+    #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+    rlog_i(logTAG, "Load on GPIO %d is OFF", _pin);
+  };
+
+  // Return power to the budget and release the interlock group (the dead time starts now),
+  // unless the load is switched on again by a request already submitted to the bus worker
+  if (!_state && !loadOnPending()) {
+    loadReleaseClaims(true);
+  };
+
+  // Publish status and counters
+  if (publish) {
+    mqttPublishRequest();
+  };
+
+  #if CONFIG_LOADCTRL_RESTORE_ENABLED
+    // Save the last commanded state
+    if (_restore != LOAD_RESTORE_OFF) {
+      stateNvsStoreRequest();
+    };
+  #endif // CONFIG_LOADCTRL_RESTORE_ENABLED
+
+  // External callback and listeners are called after the lock is released, with the state at this moment
+  re_load_deferred_t item;
+  memset(&item, 0, sizeof(re_load_deferred_t));
+  item.ctrl = this;
+  item.work = LOAD_DEFER_CHANGED;
+  item.state = _state;
+  item.duration = _durations.durLast;
+  item.time = _state ? _last_on : _last_off;
+  item.timestamp = mono_now;
+  #if CONFIG_LOADCTRL_LISTENERS_ENABLED
+    item.source = _source;
+    _source = LOAD_SOURCE_COMMAND;
+  #endif // CONFIG_LOADCTRL_LISTENERS_ENABLED
+  if (!loadDeferredAdd(&item)) {
+    deferredRun(&item);
+  };
+}
+
+void rLoadController::deferredRun(const re_load_deferred_t* item)
+{
+  if (item->work & LOAD_DEFER_PUBLISH) {
+    mqttPublish();
+  };
+  #if CONFIG_LOADCTRL_RESTORE_ENABLED
+    if (item->work & LOAD_DEFER_STATE) {
+      stateNvsStoreSchedule();
+    };
+  #endif // CONFIG_LOADCTRL_RESTORE_ENABLED
+  #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+    if (item->work & LOAD_DEFER_CHECKPOINT) {
+      checkpointStore();
+    };
+  #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+  if (item->work & LOAD_DEFER_CHANGED) {
+    if (_state_changed) { 
+      _state_changed(this, item->state, item->duration); 
+    };
+    #if CONFIG_LOADCTRL_LISTENERS_ENABLED
+      listenersNotify(item);
+    #endif // CONFIG_LOADCTRL_LISTENERS_ENABLED
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Listeners ------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+#if CONFIG_LOADCTRL_LISTENERS_ENABLED
+
+bool rLoadController::listenerAdd(cb_load_listener_t cb, void* arg)
+{
+  bool ret = false;
+  if (cb) {
+    portENTER_CRITICAL(&_loadListenersLock);
+    for (uint8_t i = 0; i < CONFIG_LOADCTRL_LISTENERS_MAX; i++) {
+      if (_listeners[i].cb == nullptr) {
+        _listeners[i].cb = cb;
+        _listeners[i].arg = arg;
+        ret = true;
+        break;
+      };
+    };
+    portEXIT_CRITICAL(&_loadListenersLock);
+    if (!ret) {
+      rlog_e(logTAG, "Load on GPIO %d: no free slots for listeners", _pin);
+    };
+  };
+  return ret;
+}
+
+bool rLoadController::listenerRemove(cb_load_listener_t cb, void* arg)
+{
+  bool ret = false;
+  portENTER_CRITICAL(&_loadListenersLock);
+  for (uint8_t i = 0; i < CONFIG_LOADCTRL_LISTENERS_MAX; i++) {
+    if ((_listeners[i].cb == cb) && (_listeners[i].arg == arg)) {
+      _listeners[i].cb = nullptr;
+      _listeners[i].arg = nullptr;
+      ret = true;
+    };
+  };
+  portEXIT_CRITICAL(&_loadListenersLock);
+  return ret;
+}
+
+void rLoadController::listenersNotify(const re_load_deferred_t* item)
+{
+  re_load_event_t event;
+  event.ctrl = this;
+  event.state = item->state;
+  event.source = item->source;
+  event.timestamp = item->timestamp;
+  event.time = item->time;
+  event.duration = item->state ? 0 : item->duration;
+
+  // The list is copied on the stack, so listeners are called outside the critical section and can be removed at any time
+  re_load_listener_t listeners[CONFIG_LOADCTRL_LISTENERS_MAX];
+  portENTER_CRITICAL(&_loadListenersLock);
+  memcpy(listeners, _listeners, sizeof(listeners));
+  portEXIT_CRITICAL(&_loadListenersLock);
+  for (uint8_t i = 0; i < CONFIG_LOADCTRL_LISTENERS_MAX; i++) {
+    if (listeners[i].cb) {
+      listeners[i].cb(&event, listeners[i].arg);
+    };
+  };
+}
+
+#endif // CONFIG_LOADCTRL_LISTENERS_ENABLED
+
 // -----------------------------------------------------------------------------------------------------------------------
-// --------------------------------------------------------- Load --------------------------------------------------------
+// ------------------------------------------------------ Bus worker -----------------------------------------------------
 // -----------------------------------------------------------------------------------------------------------------------
 
-bool rLoadController::loadInit(bool init_state)
+#if CONFIG_LOADCTRL_BUS_ENABLED
+
+void rLoadController::setBusWorker(rLoadBusWorker* bus)
 {
-  if (!_timer_free) timerCreate();
-  return loadInitGPIO() && loadSetState(init_state, true, false);
+  _bus = bus;
 }
 
-bool rLoadController::loadSetStatePriv(bool new_state)
+void rLoadController::loadExecuteGPIO(uint8_t phy_level, uint8_t async_flags)
 {
-  bool phy_level = new_state ? _level_on : !_level_on;
-  if (_gpio_before) { 
-    _gpio_before(this, phy_level, 0); 
-  };
-  bool ret = loadSetStateGPIO(phy_level);
-  if (_gpio_after) { 
-    _gpio_after(this, phy_level, 0); 
-  };
-  return ret;
+  #if CONFIG_LOADCTRL_VERIFY_ENABLED
+    if (async_flags & LOAD_ASYNC_RETRY) {
+      loadLock();
+      loadRetryGPIO(phy_level);
+      loadUnlock();
+      return;
+    };
+  #endif // CONFIG_LOADCTRL_VERIFY_ENABLED
+
+  // A cycle phase submitted before the switch-off must not turn the load on again
+  loadLock();
+  bool stale = (async_flags & LOAD_ASYNC_CYCLE) && !(async_flags & LOAD_ASYNC_FINALIZE) && !loadTargetState();
+  loadUnlock();
+  if (stale) return;
+
+  // The bus is written without the lock, only the finalization is serialized with the application and timers
+  bool change_ok = loadWriteGPIO(phy_level);
+  loadLock();
+  loadCompleteGPIO(change_ok, async_flags);
+  loadUnlock();
 }
 
-bool rLoadController::loadSetState(bool new_state, bool forced, bool publish)
+void rLoadController::loadCompleteGPIO(bool change_ok, uint8_t async_flags)
 {
-  if (forced || (_state != new_state)) {
-    bool change_ok = false;
-    if ((_cycle_duration) && (*_cycle_duration > 0) && (_cycle_interval) && (*_cycle_interval > 0)) {
-      // Activate cycle timer
-      if (new_state) _cycle_count = 0;
-      change_ok = cycleSetCyclePriv(new_state);
-    } else {
-      // Set physical level to GPIO
-      _cycle_count = -1;
-      cycleFree();
-      change_ok = loadSetStatePriv(new_state);
+  // Cycle toggle: start the timer for the next phase
+  if (async_flags & LOAD_ASYNC_CYCLE) {
+    if (change_ok) {
+      change_ok = cycleCommit(async_flags & LOAD_ASYNC_CYCLE_ON);
     };
+  };
 
-    // If the change level was successful
+  // Load switching: update state, counters and publish
+  if (async_flags & LOAD_ASYNC_FINALIZE) {
+    if (_bus_pending > 0) _bus_pending--;
+    bool new_state = async_flags & LOAD_ASYNC_STATE_ON;
     if (change_ok && (_state != new_state)) {
-      _state = new_state;
-      if (_state) {
-        _last_on = time(nullptr);
-        _durations.durLast = 0;
-        _counters.cntTotal++;
-        _counters.cntToday++;
-        _counters.cntWeekCurr++;
-        _counters.cntMonthCurr++;
-        _counters.cntPeriodCurr++;
-        _counters.cntYearCurr++;
-        rlog_i(logTAG, "Load on GPIO %d is ON", _pin);
-      } else {
-        _last_off = time(nullptr);
-        timerStop();
-        // Calculate turn-on duration
-        if (((_last_on <= 1000000000) && (_last_off <= 1000000000)) || ((_last_on > 1000000000) && (_last_off > 1000000000))) {
-          // Сrutch: timezone correction 
-          // When the first time stamp occurred before the zone was applied, and the second after it, and a negative time interval is obtained
-          if (_last_on > _last_off) {
-            if ((_last_on - _last_off) < CONFIG_SNTP_TIMEZONE_SECONDS) {
-              _last_off =+ CONFIG_SNTP_TIMEZONE_SECONDS;
-            };
-          };
-          if (_last_on < _last_off) {
-            _durations.durLast = _last_off - _last_on;
-            _durations.durTotal = _durations.durTotal + _durations.durLast;
-            _durations.durToday = _durations.durToday + _durations.durLast;
-            _durations.durWeekCurr = _durations.durWeekCurr + _durations.durLast;
-            _durations.durMonthCurr = _durations.durMonthCurr + _durations.durLast;
-            _durations.durPeriodCurr = _durations.durPeriodCurr + _durations.durLast;
-            _durations.durYearCurr = _durations.durYearCurr + _durations.durLast;
-          };
-        };
-        rlog_i(logTAG, "Load on GPIO %d is OFF", _pin);
-      };
-
-      // Publish status and counters
-      if (publish) {
-        mqttPublish();
-      };
-
-      // Call external callback
-      if (_state_changed) { 
-        _state_changed(this, _state, _durations.durLast); 
-      };
-      return true;
+      loadSetStateFinalize(new_state, async_flags & LOAD_ASYNC_PUBLISH);
+    } else if (!change_ok && new_state && !_state) {
+      _reject = LOAD_REJECT_GPIO;
+      if (!loadOnPending()) loadReleaseClaims(false);
     };
   };
-  return false;
 }
 
+#endif // CONFIG_LOADCTRL_BUS_ENABLED
+
 // -----------------------------------------------------------------------------------------------------------------------
 // -------------------------------------------------------- Cycle --------------------------------------------------------
 // -----------------------------------------------------------------------------------------------------------------------
@@ -176,10 +1874,21 @@ static void loadControllerCycleEnd(void* arg)
 {
   if (arg) {
     rLoadController* ctrl = (rLoadController*)arg;
-    ctrl->cycleToggle();
+    ctrl->timerCycleEnd();
   };
 }
 
+void rLoadController::timerCycleEnd()
+{
+  #if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+    lowPowerWakeup();
+  #endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+  #if CONFIG_LOADCTRL_METRICS_ENABLED
+    metricsTimerLate(_timer_cycle_deadline);
+  #endif // CONFIG_LOADCTRL_METRICS_ENABLED
+  cycleToggle();
+}
+
 bool rLoadController::cycleCreate()
 {
   if (_timer_cycle == nullptr) {
@@ -207,6 +1916,14 @@ bool rLoadController::cycleFree()
 }
 
 bool rLoadController::cycleToggle()
+{
+  loadLock();
+  bool ret = cycleTogglePriv(0);
+  loadUnlock();
+  return ret;
+}
+
+bool rLoadController::cycleTogglePriv(uint8_t async_flags)
 {
   if (_timer_cycle && _cycle_duration && _cycle_interval) {
     // Stop timer if active
@@ -215,54 +1932,69 @@ bool rLoadController::cycleToggle()
     };
     // Switching the load
     bool new_state = !_cycle_state;
-    if (loadSetStatePriv(new_state)) {
-      if (new_state) _cycle_count++;
-      // Calculate timer duration
-      uint64_t duration = 1000 * (uint64_t)(new_state ? *_cycle_duration : *_cycle_interval);
-      switch (_cycle_type) {
-        case TI_SECONDS:
-          duration = duration * 1000;
-          break;
-        case TI_MINUTES:
-          duration = duration * 1000 * 60;
-          break;
-        case TI_HOURS:
-          duration = duration * 1000 * 60 * 60;
-          break;
-        case TI_DAYS:
-          duration = duration * 1000 * 60 * 60 * 24;
-          break;
-        default:
-          break;
-      }
-      // Starting the timer
-      if (duration > 0) {
-        if (esp_timer_start_once(_timer_cycle, duration) == ESP_OK) {
-          _cycle_state = new_state;
-          return true;
-        } else {
-          loadSetStatePriv(_cycle_state);
-          return false;
-        };
-      } else {
-        _cycle_state = new_state;
-        return true;
-      };
+    if (loadSetStatePriv(new_state, async_flags | LOAD_ASYNC_CYCLE | (new_state ? LOAD_ASYNC_CYCLE_ON : 0))) {
+      #if CONFIG_LOADCTRL_BUS_ENABLED
+        if (_bus) return true;
+      #endif // CONFIG_LOADCTRL_BUS_ENABLED
+      return cycleCommit(new_state);
     };
   };
   return false;
 }
 
-bool rLoadController::cycleSetCyclePriv(bool new_state)
+bool rLoadController::cycleCommit(bool new_state)
+{
+  // Calculate timer duration
+  uint64_t duration = loadCycleDuration(new_state ? *_cycle_duration : *_cycle_interval, _cycle_type);
+  #if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+    int64_t now = esp_timer_get_time();
+    if (_low_power && (duration > 0)) {
+      // The phase ends at the boundary of a wake slot, shared by all controllers
+      duration = (uint64_t)(loadLowPowerPhase(now + duration) - now);
+    };
+    // In low-power mode only the first phase is counted, the rest are derived from the schedule in getCycleCount()
+    if (new_state && (!_low_power || (_cycle_count == 0))) {
+      _cycle_count++;
+      _cycle_start = now;
+      if (_low_power && (duration > 0)) {
+        // The following phases last whole slots: the schedule is counted as if the first one did too
+        _cycle_start = now + duration - loadLowPowerPhase(loadCycleDuration(*_cycle_duration, _cycle_type));
+      };
+    };
+  #else
+    if (new_state) _cycle_count++;
+  #endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+  // Starting the timer
+  if (duration > 0) {
+    if (esp_timer_start_once(_timer_cycle, duration) == ESP_OK) {
+      #if CONFIG_LOADCTRL_METRICS_ENABLED
+        _timer_cycle_deadline = esp_timer_get_time() + duration;
+      #endif // CONFIG_LOADCTRL_METRICS_ENABLED
+      _cycle_state = new_state;
+      return true;
+    } else {
+      #if CONFIG_LOADCTRL_METRICS_ENABLED
+        _metrics.cycleRollbacks++;
+      #endif // CONFIG_LOADCTRL_METRICS_ENABLED
+      loadSetStatePriv(_cycle_state, 0);
+      return false;
+    };
+  } else {
+    _cycle_state = new_state;
+    return true;
+  };
+}
+
+bool rLoadController::cycleSetCyclePriv(bool new_state, uint8_t async_flags)
 {
   _cycle_state = false;
   if (new_state) {
     if (cycleCreate()) {
-      return cycleToggle();
+      return cycleTogglePriv(async_flags);
     };
   } else {
     cycleFree();
-    return loadSetStatePriv(_cycle_state);
+    return loadSetStatePriv(_cycle_state, async_flags);
   };
   return false;
 }
@@ -275,11 +2007,33 @@ static void loadControllerTimerEnd(void* arg)
 {
   if (arg) {
     rLoadController* ctrl = (rLoadController*)arg;
-    ctrl->loadSetState(false, false, true);
+    ctrl->timerOnEnd();
   };
 }
 
+void rLoadController::timerOnEnd()
+{
+  #if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+    lowPowerWakeup();
+  #endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+  #if CONFIG_LOADCTRL_METRICS_ENABLED
+    metricsTimerLate(_timer_on_deadline);
+  #endif // CONFIG_LOADCTRL_METRICS_ENABLED
+  #if CONFIG_LOADCTRL_LISTENERS_ENABLED
+    _source = LOAD_SOURCE_TIMER;
+  #endif // CONFIG_LOADCTRL_LISTENERS_ENABLED
+  loadSetState(false, false, true);
+}
+
 bool rLoadController::loadSetTimer(uint32_t duration_ms)
+{
+  loadLock();
+  bool ret = loadSetTimerPriv(duration_ms, true);
+  loadUnlock();
+  return ret;
+}
+
+bool rLoadController::loadSetTimerPriv(uint32_t duration_ms, bool publish)
 {
   if (_timer_on == nullptr) timerCreate();
   if (_timer_on != nullptr) {
@@ -287,8 +2041,27 @@ bool rLoadController::loadSetTimer(uint32_t duration_ms)
       esp_timer_stop(_timer_on);
     };
     RE_OK_CHECK(esp_timer_start_once(_timer_on, (uint64_t)(duration_ms)*1000), return false);
-    if (getState() || loadSetState(true, false, true)) {
+    #if CONFIG_LOADCTRL_RESTORE_ENABLED || CONFIG_LOADCTRL_METRICS_ENABLED
+      _timer_on_deadline = esp_timer_get_time() + (int64_t)duration_ms * 1000;
+    #endif // CONFIG_LOADCTRL_RESTORE_ENABLED || CONFIG_LOADCTRL_METRICS_ENABLED
+    if (loadTargetState()) {
+      #if CONFIG_LOADCTRL_RESTORE_ENABLED
+        // The state does not change, but the timer must be saved
+        if (_restore == LOAD_RESTORE_TIMER) stateNvsStoreRequest();
+      #endif // CONFIG_LOADCTRL_RESTORE_ENABLED
+      return true;
+    } else if (loadSetStateCmd(true, false, publish)) {
       return true;
+    #if CONFIG_LOADCTRL_POWER_ENABLED
+    } else if (_power && _power->isQueued(this)) {
+      // The load will be turned on when the power budget allows, the turn-off time is counted from now
+      return true;
+    #endif // CONFIG_LOADCTRL_POWER_ENABLED
+    #if CONFIG_LOADCTRL_INTERLOCK_ENABLED
+    } else if (_interlock && _interlock->isPending(this)) {
+      // The same for a switch-on delayed by the dead time of the interlock group
+      return true;
+    #endif // CONFIG_LOADCTRL_INTERLOCK_ENABLED
     } else {
       esp_timer_stop(_timer_on);
       esp_timer_delete(_timer_on);
@@ -346,6 +2119,11 @@ bool rLoadController::timerFree()
 // ------------------------------------------------------ Get data -------------------------------------------------------
 // -----------------------------------------------------------------------------------------------------------------------
 
+uint8_t rLoadController::getPin()
+{
+  return _pin;
+}
+
 bool rLoadController::getState()
 {
   return _state;
@@ -353,12 +2131,12 @@ bool rLoadController::getState()
 
 time_t rLoadController::getLastOn()
 {
-  return _last_on;
+  return (time_t)_last_on;
 }
 
 time_t rLoadController::getLastOff()
 {
-  return _last_off;
+  return (time_t)_last_off;
 }
 
 time_t rLoadController::getLastDuration()
@@ -378,7 +2156,30 @@ re_load_counters_t rLoadController::getCounters()
 
 re_load_durations_t rLoadController::getDurations()
 {
-  return _durations;
+  return getDurationsAt(loadClockMono());
+}
+
+re_load_durations_t rLoadController::getDurationsAt(int64_t mono_now)
+{
+  re_load_durations_t ret;
+  loadDurationsLive(&_durations, _state, getCurrentDuration(mono_now), &ret);
+  return ret;
+}
+
+uint16_t rLoadController::getDurationsAll(re_load_durations_t* buf, uint16_t size)
+{
+  // All controllers are calculated at the same moment, in the order of the list of controllers;
+  // the lock keeps the snapshot consistent: no load changes its state or counters until it is taken
+  uint16_t count = 0;
+  loadLock();
+  int64_t now = loadClockMono();
+  rLoadController* ctrl = _loadFirst;
+  while (ctrl && (count < size)) {
+    buf[count++] = ctrl->getDurationsAt(now);
+    ctrl = ctrl->_next;
+  };
+  loadUnlock();
+  return count;
 }
 
 // -----------------------------------------------------------------------------------------------------------------------
@@ -407,16 +2208,68 @@ bool rLoadController::mqttTopicCreate(bool primary, bool local, const char* topi
   return mqttTopicSet(mqttGetTopicDevice(primary, local, topic1, topic2, topic3));
 }
 
+#if CONFIG_LOADCTRL_TOPIC_PREFIX_ENABLED
+
+bool rLoadController::mqttTopicSetPrefix(re_load_topic_prefix_t* prefix, const char* suffix)
+{
+  mqttTopicFree();
+  _mqtt_prefix = prefix;
+  _mqtt_suffix = suffix;
+  return (_mqtt_prefix != nullptr);
+}
+
+#endif // CONFIG_LOADCTRL_TOPIC_PREFIX_ENABLED
+
+char* rLoadController::mqttTopicMake()
+{
+  if (_mqtt_topic) {
+    return malloc_string(_mqtt_topic);
+  };
+  #if CONFIG_LOADCTRL_TOPIC_PREFIX_ENABLED
+    if (_mqtt_prefix) {
+      return loadTopicMake(_mqtt_prefix->topic, _mqtt_suffix, _pin);
+    };
+  #endif // CONFIG_LOADCTRL_TOPIC_PREFIX_ENABLED
+  return nullptr;
+}
+
 void rLoadController::mqttTopicFree()
 {
   if (_mqtt_topic) free(_mqtt_topic);
   _mqtt_topic = nullptr;
+  #if CONFIG_LOADCTRL_TOPIC_PREFIX_ENABLED
+    _mqtt_prefix = nullptr;
+    _mqtt_suffix = nullptr;
+  #endif // CONFIG_LOADCTRL_TOPIC_PREFIX_ENABLED
 }
 
 bool rLoadController::mqttPublish()
 {
-  if ((_mqtt_topic) && (_mqtt_publish)) {
-    return _mqtt_publish(this, _mqtt_topic, getJSON(), false, true);
+  #if CONFIG_LOADCTRL_METRICS_ENABLED
+    bool ret = mqttPublishPriv();
+    _metrics.mqttCount++;
+    if (!ret) _metrics.mqttFailed++;
+    return ret;
+  #else
+    return mqttPublishPriv();
+  #endif // CONFIG_LOADCTRL_METRICS_ENABLED
+}
+
+bool rLoadController::mqttPublishPriv()
+{
+  if (_mqtt_publish) {
+    if (_mqtt_topic) {
+      return _mqtt_publish(this, _mqtt_topic, getJSON(), false, true);
+    };
+    #if CONFIG_LOADCTRL_TOPIC_PREFIX_ENABLED
+      if ((_mqtt_prefix) && (_mqtt_prefix->topic)) {
+        // The full topic is assembled only for the time of sending
+        char* topic = loadTopicMake(_mqtt_prefix->topic, _mqtt_suffix, _pin);
+        if (topic) {
+          return _mqtt_publish(this, topic, getJSON(), true, true);
+        };
+      };
+    #endif // CONFIG_LOADCTRL_TOPIC_PREFIX_ENABLED
   };
   return false;
 }
@@ -425,17 +2278,49 @@ bool rLoadController::mqttPublish()
 // -------------------------------------------------------- JSON ---------------------------------------------------------
 // -----------------------------------------------------------------------------------------------------------------------
 
-#if CONFIG_LOADCTRL_TIMESTAMP_ENABLED
+void rLoadController::mqttPublishRequest()
+{
+  #if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+    if (_low_power) {
+      _publish_pending = true;
+      _lowpower.publishDeferred++;
+      return;
+    };
+  #endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+  if (!loadDeferredAdd(this, LOAD_DEFER_PUBLISH)) {
+    mqttPublish();
+  };
+}
 
-char* rLoadController::getTimestampsJSON()
+int32_t rLoadController::getCycleCount()
 {
-  char _time_on[CONFIG_LOADCTRL_TIMESTAMP_BUF_SIZE];
-  char _time_off[CONFIG_LOADCTRL_TIMESTAMP_BUF_SIZE];
+  #if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+    // Phases are not counted in low-power mode: the number of phases passed is calculated by the schedule
+    if (_low_power && _state && (_cycle_count > 0) && _cycle_duration && _cycle_interval) {
+      uint64_t period = loadLowPowerPhase(loadCycleDuration(*_cycle_duration, _cycle_type))
+                      + loadLowPowerPhase(loadCycleDuration(*_cycle_interval, _cycle_type));
+      int64_t elapsed = esp_timer_get_time() - _cycle_start;
+      if ((period > 0) && (elapsed > 0)) {
+        return _cycle_count + (int32_t)((uint64_t)elapsed / period);
+      };
+    };
+  #endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+  return _cycle_count;
+}
 
-  time2str_empty( CONFIG_LOADCTRL_TIMESTAMP_FORMAT, &_last_on, &_time_on[0], sizeof(_time_on));
-  time2str_empty( CONFIG_LOADCTRL_TIMESTAMP_FORMAT, &_last_off, &_time_off[0], sizeof(_time_off));
+uint32_t rLoadController::getCurrentDuration(int64_t mono_now)
+{
+  if (_state) {
+    return loadMonoDuration(_mono_on, mono_now);
+  };
+  return 0;
+}
 
-  return malloc_stringf("{\"" CONFIG_LOADCTRL_ON "\":\"%s\",\"" CONFIG_LOADCTRL_OFF "\":\"%s\"}", _time_on, _time_off);
+#if CONFIG_LOADCTRL_TIMESTAMP_ENABLED
+
+char* rLoadController::getTimestampsJSON()
+{
+  return loadTimestampsJSON(_last_on, _last_off);
 }
 
 #endif // CONFIG_LOADCTRL_TIMESTAMP_ENABLED
@@ -444,13 +2329,7 @@ char* rLoadController::getTimestampsJSON()
 
 char* rLoadController::getCountersJSON()
 {
-  return malloc_stringf("{\"" CONFIG_LOADCTRL_TOTAL "\":%d,\"" CONFIG_LOADCTRL_TODAY "\":%d,\"" CONFIG_LOADCTRL_YESTERDAY "\":%d,\"" CONFIG_LOADCTRL_WEEK_CURR "\":%d,\"" CONFIG_LOADCTRL_WEEK_PREV "\":%d,\"" CONFIG_LOADCTRL_MONTH_CURR "\":%d,\"" CONFIG_LOADCTRL_MONTH_PREV "\":%d,\"" CONFIG_LOADCTRL_PERIOD_CURR "\":%d,\"" CONFIG_LOADCTRL_PERIOD_PREV "\":%d,\"" CONFIG_LOADCTRL_YEAR_CURR "\":%d,\"" CONFIG_LOADCTRL_YEAR_PREV "\":%d}", 
-    _counters.cntTotal, 
-    _counters.cntToday, _counters.cntYesterday, 
-    _counters.cntWeekCurr, _counters.cntWeekPrev, 
-    _counters.cntMonthCurr, _counters.cntMonthPrev, 
-    _counters.cntPeriodCurr, _counters.cntPeriodPrev, 
-    _counters.cntYearCurr, _counters.cntYearPrev);
+  return loadCountersJSON(&_counters);
 }
 
 #endif // CONFIG_LOADCTRL_COUNTERS_ENABLED
@@ -459,57 +2338,64 @@ char* rLoadController::getCountersJSON()
 
 char* rLoadController::getDurationsJSON()
 {
-  uint32_t durCurr = 0;
-  if (_state && (_last_on > 1000000000)) {
-    durCurr = time(nullptr) - _last_on;
-  };
-  return malloc_stringf("{\"" CONFIG_LOADCTRL_LAST "\":%d,\"" CONFIG_LOADCTRL_TOTAL "\":%d,\"" CONFIG_LOADCTRL_TODAY "\":%d,\"" CONFIG_LOADCTRL_YESTERDAY "\":%d,\"" CONFIG_LOADCTRL_WEEK_CURR "\":%d,\"" CONFIG_LOADCTRL_WEEK_PREV "\":%d,\"" CONFIG_LOADCTRL_MONTH_CURR "\":%d,\"" CONFIG_LOADCTRL_MONTH_PREV "\":%d,\"" CONFIG_LOADCTRL_PERIOD_CURR "\":%d,\"" CONFIG_LOADCTRL_PERIOD_PREV "\":%d,\"" CONFIG_LOADCTRL_YEAR_CURR "\":%d,\"" CONFIG_LOADCTRL_YEAR_PREV "\":%d}", 
-    _state ? durCurr : _durations.durLast, _durations.durTotal + durCurr, 
-    _durations.durToday + durCurr, _durations.durYesterday, 
-    _durations.durWeekCurr + durCurr, _durations.durWeekPrev, 
-    _durations.durMonthCurr + durCurr, _durations.durMonthPrev, 
-    _durations.durPeriodCurr + durCurr, _durations.durPeriodPrev, 
-    _durations.durYearCurr + durCurr, _durations.durYearPrev);
+  return getDurationsJSONAt(loadClockMono());
 }
 
-#endif // CONFIG_LOADCTRL_DURATIONS_ENABLED
-
-char* rLoadController::getJSON()
+char* rLoadController::getDurationsJSONAt(int64_t mono_now)
 {
-  char* _json = malloc_stringf("{\"" CONFIG_LOADCTRL_STATUS "\":%d", _state);
-  if (_cycle_count > -1) {
-    _json = concat_strings(_json, malloc_stringf(",\"" CONFIG_LOADCTRL_CYCLES "\":%d", _cycle_count));
-  };
+  return loadDurationsJSON(&_durations, _state, getCurrentDuration(mono_now));
+}
 
-  #if CONFIG_LOADCTRL_TIMESTAMP_ENABLED
-    char * _json_time = getTimestampsJSON();
-    if (_json_time) {
-      _json = concat_strings(_json, malloc_stringf(",\"" CONFIG_LOADCTRL_TIMESTAMP "\":%s", _json_time));
-      if (_json_time) free(_json_time);
-    };
-  #endif // CONFIG_LOADCTRL_TIMESTAMP_ENABLED
-  
-  #if CONFIG_LOADCTRL_DURATIONS_ENABLED
-    char* _json_durations = getDurationsJSON();
+char* rLoadController::getDurationsJSONAll()
+{
+  char* _json = malloc_string("[");
+  loadLock();
+  int64_t now = loadClockMono();
+  rLoadController* ctrl = _loadFirst;
+  while (ctrl) {
+    char* _json_durations = ctrl->getDurationsJSONAt(now);
     if (_json_durations) {
-      _json = concat_strings(_json, malloc_stringf(",\"" CONFIG_LOADCTRL_DURATIONS "\":%s", _json_durations));
-      if (_json_durations) free(_json_durations);
+      if (ctrl != _loadFirst) {
+        _json = concat_strings(_json, malloc_string(","));
+      };
+      // Entries are identified by pin, as in getMetricsJSONAll()
+      _json = concat_strings(_json, malloc_stringf("{\"pin\":%d,\"" CONFIG_LOADCTRL_DURATIONS "\":%s}", ctrl->_pin, _json_durations));
+      free(_json_durations);
     };
-  #endif // CONFIG_LOADCTRL_DURATIONS_ENABLED
+    ctrl = ctrl->_next;
+  };
+  loadUnlock();
+  return concat_strings(_json, malloc_string("]"));
+}
 
-  #if CONFIG_LOADCTRL_COUNTERS_ENABLED
-    char* _json_counters = getCountersJSON();
-    if (_json_counters) {
-      _json = concat_strings(_json, malloc_stringf(",\"" CONFIG_LOADCTRL_COUNTERS "\":%s", _json_counters));
-      if (_json_counters) free(_json_counters);
-    };
-  #endif // CONFIG_LOADCTRL_COUNTERS_ENABLED
-  
-  _json = concat_strings(_json, malloc_string("}"));
+#endif // CONFIG_LOADCTRL_DURATIONS_ENABLED
 
+char* rLoadController::getJSON()
+{
+  // Publishing is done without the lock, the status is taken under it
+  loadLock();
+  char* _json = getJSONPriv();
+  loadUnlock();
   return _json;
 }
 
+char* rLoadController::getJSONPriv()
+{
+  #if CONFIG_LOADCTRL_WEAR_ENABLED
+    char* _json = loadStatusJSONOpen(_state, getCycleCount(), _last_on, _last_off, &_counters, &_durations, getCurrentDuration(loadClockMono()));
+    if (_wear_config.life_cycles > 0) {
+      char* _json_wear = getWearJSON();
+      if (_json_wear) {
+        _json = concat_strings(_json, malloc_stringf(",\"" CONFIG_LOADCTRL_WEAR "\":%s", _json_wear));
+        free(_json_wear);
+      };
+    };
+    return concat_strings(_json, malloc_string("}"));
+  #else
+    return loadStatusJSON(_state, getCycleCount(), _last_on, _last_off, &_counters, &_durations, getCurrentDuration(loadClockMono()));
+  #endif // CONFIG_LOADCTRL_WEAR_ENABLED
+}
+
 // -----------------------------------------------------------------------------------------------------------------------
 // ------------------------------------ Reading and saving counters from flash memory ------------------------------------
 // -----------------------------------------------------------------------------------------------------------------------
@@ -518,331 +2404,530 @@ void rLoadController::countersReset()
 {
   memset((void*)&_counters, 0, sizeof(re_load_counters_t));
   memset((void*)&_durations, 0, sizeof(re_load_durations_t));
+  #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+    _checkpoint_dur = 0;
+    _checkpoint_cnt = 0;
+  #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
 }
 
 void rLoadController::countersNvsRestore()
 {
-  if (_nvs_space) {
-    // Number of days since UNIX epoch, discarding time
-    uint32_t daysNow = (uint32_t)(time(nullptr) / 86400);
-    uint32_t daysNvs = daysNow;
-    nvs_handle_t nvs_handle;
-    if (nvsOpen(_nvs_space, NVS_READONLY, &nvs_handle)) {
-      RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_DAYS, &daysNvs));
-      nvs_close(nvs_handle);
+  #if CONFIG_LOADCTRL_SLOTS_ENABLED
+    loadCountersNvsRestore(_nvs_space, _period_start, &_counters, &_durations, &_slot_seq);
+  #else
+    loadCountersNvsRestore(_nvs_space, _period_start, &_counters, &_durations, nullptr);
+  #endif // CONFIG_LOADCTRL_SLOTS_ENABLED
+  #if CONFIG_LOADCTRL_WEAR_ENABLED
+    loadWearNvsRestore(_nvs_space, &_wear);
+  #endif // CONFIG_LOADCTRL_WEAR_ENABLED
+  #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+    // The stored counters are the base of the next checkpoint, so it carries the restored amount again until the next store
+    _checkpoint_dur = _durations.durTotal;
+    _checkpoint_cnt = _counters.cntTotal;
+    // What was not covered by the store before reboot is added to the restored counters
+    re_load_checkpoint_t checkpoint;
+    if (loadCheckpointRestore(_nvs_space, &checkpoint) && ((checkpoint.duration > 0) || (checkpoint.count > 0))) {
+      loadCheckpointFold(&checkpoint, &_counters, &_durations);
+      #if CONFIG_LOADCTRL_WEAR_ENABLED
+        _wear.on_time += checkpoint.duration;
+      #endif // CONFIG_LOADCTRL_WEAR_ENABLED
+      _checkpoint_saved = true;
+      rlog_i(logTAG, "Load on GPIO %d: restored %d s and %d switchings not saved before reboot", _pin, checkpoint.duration, checkpoint.count);
     };
+  #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+}
 
-    re_load_counters_t _nvsCnt;
-    bool _nvsCntEnabled = false;
-    char* nmsp_cnt = malloc_stringf("%s.cnt", _nvs_space);
-    if (nmsp_cnt) {
-      nvs_handle_t nvs_handle;
-      if (nvsOpen(nmsp_cnt, NVS_READONLY, &nvs_handle)) {
-        _nvsCntEnabled = true;
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_TOTAL, &_nvsCnt.cntTotal));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_TODAY, &_nvsCnt.cntToday));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_YESTERDAY, &_nvsCnt.cntYesterday));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_CURR, &_nvsCnt.cntWeekCurr));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_PREV, &_nvsCnt.cntWeekPrev));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_CURR, &_nvsCnt.cntMonthCurr));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_PREV, &_nvsCnt.cntMonthPrev));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_CURR, &_nvsCnt.cntPeriodCurr));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_PREV, &_nvsCnt.cntPeriodPrev));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_CURR, &_nvsCnt.cntYearCurr));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_PREV, &_nvsCnt.cntYearPrev));
-        nvs_close(nvs_handle);
+void rLoadController::countersNvsStore()
+{
+  #if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+    if (_low_power) {
+      _store_pending = true;
+      _lowpower.storeDeferred++;
+      return;
+    };
+  #endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+  countersNvsStorePriv();
+}
+
+void rLoadController::countersNvsStorePriv()
+{
+  // The counters are copied under the load lock and written without it
+  loadStoreLock();
+  #if CONFIG_LOADCTRL_METRICS_ENABLED
+    int64_t time_start = esp_timer_get_time();
+  #endif // CONFIG_LOADCTRL_METRICS_ENABLED
+  loadLock();
+  re_load_counters_t counters = _counters;
+  re_load_durations_t durations = _durations;
+  #if CONFIG_LOADCTRL_SLOTS_ENABLED
+    uint32_t slot_seq = _slot_seq;
+  #endif // CONFIG_LOADCTRL_SLOTS_ENABLED
+  #if CONFIG_LOADCTRL_WEAR_ENABLED
+    re_load_wear_t wear = _wear;
+  #endif // CONFIG_LOADCTRL_WEAR_ENABLED
+  loadUnlock();
+
+  #if CONFIG_LOADCTRL_SLOTS_ENABLED
+    bool stored = loadCountersNvsStore(_nvs_space, &counters, &durations, &slot_seq);
+  #else
+    bool stored = loadCountersNvsStore(_nvs_space, &counters, &durations, nullptr);
+  #endif // CONFIG_LOADCTRL_SLOTS_ENABLED
+  #if CONFIG_LOADCTRL_WEAR_ENABLED
+    if (counters.cntTotal > 0) {
+      loadWearNvsStore(_nvs_space, &wear);
+    };
+  #endif // CONFIG_LOADCTRL_WEAR_ENABLED
+
+  #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+    bool checkpoint_store = false;
+    bool checkpoint_clear = false;
+  #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+  loadLock();
+  #if CONFIG_LOADCTRL_SLOTS_ENABLED
+    _slot_seq = slot_seq;
+  #endif // CONFIG_LOADCTRL_SLOTS_ENABLED
+  if (stored) {
+    #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+      // Only the counters that have actually been written cover the checkpoint: it is then cleared
+      // or replaced with the current interval, otherwise it is kept until the next successful store
+      _checkpoint_dur = durations.durTotal;
+      _checkpoint_cnt = counters.cntTotal;
+      if (_checkpoint_saved) {
+        checkpoint_store = _state && (_checkpoint_interval > 0);
+        checkpoint_clear = !checkpoint_store;
       };
-      free(nmsp_cnt);
+    #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+  };
+  #if CONFIG_LOADCTRL_METRICS_ENABLED
+    _metrics.nvsCount++;
+    loadMetricsTime(&_metrics.nvsMin, &_metrics.nvsMax, &_metrics.nvsSum, _metrics.nvsCount, (uint32_t)(esp_timer_get_time() - time_start));
+  #endif // CONFIG_LOADCTRL_METRICS_ENABLED
+  loadUnlock();
+
+  #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+    if (checkpoint_store) {
+      checkpointStore();
+    } else if (checkpoint_clear && loadCheckpointClear(_nvs_space)) {
+      // Nothing else writes the checkpoint while the store lock is held
+      loadLock();
+      _checkpoint_saved = false;
+      loadUnlock();
+    };
+  #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+  loadStoreUnlock();
+}
+
+// ----------------------------------------------------- Checkpoints -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+#if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+
+static void loadControllerCheckpointEnd(void* arg)
+{
+  if (arg) {
+    rLoadController* ctrl = (rLoadController*)arg;
+    ctrl->checkpointTimerEnd();
+  };
+}
+
+bool rLoadController::checkpointSetInterval(uint32_t interval_s)
+{
+  checkpointStop();
+  if (_timer_checkpoint != nullptr) {
+    RE_OK_CHECK(esp_timer_delete(_timer_checkpoint), return false);
+    _timer_checkpoint = nullptr;
+  };
+  _checkpoint_interval = interval_s;
+  if ((_checkpoint_interval > 0) && _nvs_space) {
+    esp_timer_create_args_t cfg;
+    memset(&cfg, 0, sizeof(esp_timer_create_args_t));
+    cfg.name = "load_ctrl_chkpt";
+    cfg.callback = loadControllerCheckpointEnd;
+    cfg.arg = this;
+    RE_OK_CHECK(esp_timer_create(&cfg, &_timer_checkpoint), return false);
+    if (_state) checkpointStart();
+  };
+  return true;
+}
+
+void rLoadController::checkpointStart()
+{
+  #if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+    // In low-power mode the checkpoint is saved in the wake window
+    if (_low_power) return;
+  #endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+  #if CONFIG_LOADCTRL_REPLAY_ENABLED
+    // The replay calls checkpointTimerEnd() on its virtual clock
+    if (_loadClockMono) return;
+  #endif // CONFIG_LOADCTRL_REPLAY_ENABLED
+  if (_timer_checkpoint != nullptr) {
+    if (esp_timer_is_active(_timer_checkpoint)) {
+      esp_timer_stop(_timer_checkpoint);
+    };
+    RE_OK_CHECK(esp_timer_start_periodic(_timer_checkpoint, (uint64_t)_checkpoint_interval * 1000000), return);
+  };
+}
+
+void rLoadController::checkpointStop()
+{
+  // The checkpoint itself is left in NVS until countersNvsStore(): the closed interval is not yet saved
+  if ((_timer_checkpoint != nullptr) && esp_timer_is_active(_timer_checkpoint)) {
+    esp_timer_stop(_timer_checkpoint);
+  };
+}
+
+void rLoadController::checkpointRefresh()
+{
+  // The checkpoint in NVS ends inside the interval that has just been closed
+  if (_checkpoint_saved && (_checkpoint_interval > 0)) {
+    #if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+      // In low-power mode the counters are stored in the wake window, which covers the checkpoint as well
+      if (_low_power) {
+        _store_pending = true;
+        return;
+      };
+    #endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+    if (!loadDeferredAdd(this, LOAD_DEFER_CHECKPOINT)) {
+      checkpointStore();
     };
+  };
+}
+
+void rLoadController::checkpointTimerEnd()
+{
+  loadLock();
+  #if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+    lowPowerWakeup();
+  #endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+  bool state = _state;
+  loadUnlock();
+  if (state) {
+    checkpointStore();
+  };
+}
+
+bool rLoadController::checkpointStore()
+{
+  bool ret = false;
+  loadStoreLock();
+  // Everything since the last store of counters: the intervals closed since then and the open one
+  loadLock();
+  uint32_t current = getCurrentDuration(loadClockMono());
+  uint64_t duration = _durations.durTotal - _checkpoint_dur + current;
+  uint64_t count = _counters.cntTotal - _checkpoint_cnt;
+  bool store = _nvs_space && ((duration > 0) || (count > 0) || _checkpoint_saved);
+  re_load_checkpoint_t checkpoint;
+  if (store) {
+    checkpoint.started = (_last_on > LOAD_TIME_VALID) ? _last_on : 0;
+    time_t now = loadClockTime();
+    checkpoint.saved = (now > LOAD_TIME_VALID) ? (uint32_t)now : 0;
+    checkpoint.duration = duration < UINT32_MAX ? (uint32_t)duration : UINT32_MAX;
+    checkpoint.last = _state ? current : _durations.durLast;
+    checkpoint.count = count < UINT32_MAX ? (uint32_t)count : UINT32_MAX;
+  };
+  loadUnlock();
+  if (store && loadCheckpointStore(_nvs_space, &checkpoint)) {
+    loadLock();
+    _checkpoint_saved = true;
+    _checkpoint_mono = esp_timer_get_time();
+    loadUnlock();
+    ret = true;
+  };
+  loadStoreUnlock();
+  return ret;
+}
+
+#endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Relay wear -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+#if CONFIG_LOADCTRL_WEAR_ENABLED
+
+void rLoadController::wearSetConfig(const re_load_wear_config_t* config)
+{
+  if (config) {
+    _wear_config = *config;
+  } else {
+    memset((void*)&_wear_config, 0, sizeof(re_load_wear_config_t));
+  };
+  // The weight is calculated once, switching only adds it
+  _wear_weight = loadWearWeight(&_wear_config);
+}
+
+void rLoadController::wearReset()
+{
+  // The relay has been replaced
+  memset((void*)&_wear, 0, sizeof(re_load_wear_t));
+  loadWearNvsStore(_nvs_space, &_wear);
+}
+
+re_load_wear_t rLoadController::getWear()
+{
+  re_load_wear_t ret = _wear;
+  ret.on_time += getCurrentDuration(loadClockMono());
+  return ret;
+}
+
+uint8_t rLoadController::getWearRemaining()
+{
+  re_load_wear_t wear = getWear();
+  return (uint8_t)((1000000 - loadWearConsumed(&_wear_config, &wear)) / 10000);
+}
+
+uint32_t rLoadController::getWearRemainingCycles()
+{
+  // Switching cycles left at the current load, if the on-time wear keeps the same pace
+  if ((_wear_config.life_cycles > 0) && (_wear_weight > 0)) {
+    re_load_wear_t wear = getWear();
+    uint64_t remaining = (uint64_t)(1000000 - loadWearConsumed(&_wear_config, &wear)) * _wear_config.life_cycles / _wear_weight / 1000;
+    return remaining < UINT32_MAX ? (uint32_t)remaining : UINT32_MAX;
+  };
+  return 0;
+}
+
+char* rLoadController::getWearJSON()
+{
+  re_load_wear_t wear = getWear();
+  uint8_t remaining = (uint8_t)((1000000 - loadWearConsumed(&_wear_config, &wear)) / 10000);
+  return malloc_stringf("{\"" CONFIG_LOADCTRL_WEAR_CYCLES "\":%llu,\"" CONFIG_LOADCTRL_WEAR_ON_TIME "\":%llu,\"" CONFIG_LOADCTRL_WEAR_REMAINING "\":%d,\"" CONFIG_LOADCTRL_WEAR_REMAINING_CYCLES "\":%" PRIu32 ",\"" CONFIG_LOADCTRL_WEAR_REPLACE "\":%d}",
+    (unsigned long long)(wear.cycles / 1000), (unsigned long long)wear.on_time, remaining, getWearRemainingCycles(),
+    remaining < _wear_config.warn_percent);
+}
+
+#endif // CONFIG_LOADCTRL_WEAR_ENABLED
 
-    re_load_durations_t _nvsDur;
-    bool _nvsDurEnabled = false;
-    char* nmsp_dur = malloc_stringf("%s.dur", _nvs_space);
-    if (nmsp_dur) {
-      nvs_handle_t nvs_handle;
-      if (nvsOpen(nmsp_dur, NVS_READONLY, &nvs_handle)) {
-        _nvsDurEnabled = true;
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_LAST, &_nvsDur.durLast));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_TOTAL, &_nvsDur.durTotal));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_TODAY, &_nvsDur.durToday));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_YESTERDAY, &_nvsDur.durYesterday));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_CURR, &_nvsDur.durWeekCurr));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_PREV, &_nvsDur.durWeekPrev));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_CURR, &_nvsDur.durMonthCurr));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_PREV, &_nvsDur.durMonthPrev));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_CURR, &_nvsDur.durPeriodCurr));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_PREV, &_nvsDur.durPeriodPrev));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_CURR, &_nvsDur.durYearCurr));
-        RE_ERROR_LOG(nvs_get_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_PREV, &_nvsDur.durYearPrev));
-        nvs_close(nvs_handle);
-      };
-      free(nmsp_dur);
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- Metrics -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+rLoadController* rLoadController::getFirst()
+{
+  return _loadFirst;
+}
+
+rLoadController* rLoadController::getNext()
+{
+  return _next;
+}
+
+#if CONFIG_LOADCTRL_METRICS_ENABLED
+
+void rLoadController::metricsReset()
+{
+  memset((void*)&_metrics, 0, sizeof(re_load_metrics_t));
+}
+
+re_load_metrics_t rLoadController::getMetrics()
+{
+  return _metrics;
+}
+
+void rLoadController::metricsTimerLate(int64_t deadline)
+{
+  if (deadline > 0) {
+    int64_t late = esp_timer_get_time() - deadline;
+    if (late < 0) late = 0;
+    uint8_t bucket = 0;
+    int64_t limit = 100;
+    while ((bucket < LOAD_METRICS_LATE_BUCKETS - 1) && (late >= limit)) {
+      bucket++;
+      limit = limit * 10;
+    };
+    _metrics.timerLate[bucket]++;
+    if (late > _metrics.timerLateMax) {
+      _metrics.timerLateMax = (uint32_t)late;
     };
+  };
+}
 
-    // Restore data
-    if (daysNow == daysNvs) {
-      // Data was saved today
-      if (_nvsCntEnabled) {
-        _counters = _nvsCnt;
-      };
-      if (_nvsDurEnabled) {
-        _durations = _nvsDur;
-      };
-    } else {
-      // Restore total counters
-      if (_nvsCntEnabled) {
-        _counters.cntTotal  = _nvsCnt.cntTotal;
-      };
-      if (_nvsDurEnabled) {
-        _durations.durLast = _nvsDur.durLast;
-        _durations.durTotal = _nvsDur.durTotal;
-      };
-
-      // Decode week, month, period, and year
-      time_t timeNow = (time_t)daysNow * 86400 + 1;
-      time_t timeNvs = (time_t)daysNvs * 86400 + 1;
-      uint32_t weekNow = (daysNow + 3) / 7;
-      uint32_t weekNvs = (daysNvs + 3) / 7;
-      struct tm tmNow;
-      struct tm tmNvs;
-      localtime_r(&timeNow, &tmNow);
-      localtime_r(&timeNvs, &tmNvs);
-      uint8_t pmNow = 0;
-      uint8_t pmNvs = 0;
-      uint16_t pyNow = 0;
-      uint16_t pyNvs = 0;
-      if ((_period_start) && (*_period_start > 0)) {
-        pyNow = tmNow.tm_year;
-        if (tmNow.tm_mday < *_period_start) {
-          pmNow = tmNow.tm_mon;
-        } else {
-          pmNow = tmNow.tm_mon + 1;
-          if (pmNow > 11) {
-            pyNow++;
-            pmNow = 0;
-          };
-        };
-        pyNvs = tmNvs.tm_year;
-        if (tmNvs.tm_mday < *_period_start) {
-          pmNvs = tmNvs.tm_mon;
-        } else {
-          pmNvs = tmNvs.tm_mon + 1;
-          if (pmNvs > 11) {
-            pyNvs++;
-            pmNvs = 0;
-          };
-        };
-      };
+char* rLoadController::getMetricsJSON()
+{
+  re_load_metrics_t m = _metrics;
+  return malloc_stringf("{\"pin\":%d,\"gpio\":{\"count\":%d,\"failed\":%d,\"min\":%d,\"avg\":%d,\"max\":%d},\"late\":[%d,%d,%d,%d,%d,%d],\"late_max\":%d,\"rollbacks\":%d,\"verify\":{\"mismatch\":%d,\"retries\":%d,\"failed\":%d,\"fixed\":%d},\"mqtt\":{\"count\":%d,\"failed\":%d},\"nvs\":{\"count\":%d,\"min\":%d,\"avg\":%d,\"max\":%d}}",
+    _pin,
+    m.gpioCount, m.gpioFailed, m.gpioMin, m.gpioCount > 0 ? (uint32_t)(m.gpioSum / m.gpioCount) : 0, m.gpioMax,
+    m.timerLate[0], m.timerLate[1], m.timerLate[2], m.timerLate[3], m.timerLate[4], m.timerLate[5], m.timerLateMax,
+    m.cycleRollbacks, m.verifyMismatch, m.verifyRetries, m.verifyFailed, m.reconcileFixed,
+    m.mqttCount, m.mqttFailed,
+    m.nvsCount, m.nvsMin, m.nvsCount > 0 ? (uint32_t)(m.nvsSum / m.nvsCount) : 0, m.nvsMax);
+}
 
-      // Data was saved on the previous day
-      if (daysNow == daysNvs + 1) {
-        if (_nvsCntEnabled) {
-          _counters.cntToday = 0;
-          _counters.cntYesterday = _nvsCnt.cntToday;
-        };
-        if (_nvsDurEnabled) {
-          _durations.durToday = 0;
-          _durations.durYesterday = _nvsDur.durToday;
-        };
+char* rLoadController::getMetricsJSONAll()
+{
+  char* _json = malloc_string("[");
+  rLoadController* ctrl = _loadFirst;
+  while (ctrl) {
+    char* _json_ctrl = ctrl->getMetricsJSON();
+    if (_json_ctrl) {
+      if (ctrl != _loadFirst) {
+        _json = concat_strings(_json, malloc_string(","));
       };
+      _json = concat_strings(_json, _json_ctrl);
+    };
+    ctrl = ctrl->_next;
+  };
+  return concat_strings(_json, malloc_string("]"));
+}
 
-      // Data was saved on the current week
-      if (weekNow == weekNvs) {
-        if (_nvsCntEnabled) {
-          _counters.cntWeekCurr = _nvsCnt.cntWeekCurr;
-          _counters.cntWeekPrev = _nvsCnt.cntWeekPrev;
-        };
-        if (_nvsDurEnabled) {
-          _durations.durWeekCurr = _nvsDur.durWeekCurr;
-          _durations.durWeekPrev = _nvsDur.durWeekPrev;
-        };
-      }
-      // Data was saved on the previous week
-      else if (weekNow == weekNvs + 1) {
-        if (_nvsCntEnabled) {
-          _counters.cntWeekCurr = 0;
-          _counters.cntWeekPrev = _nvsCnt.cntWeekCurr;
-        };
-        if (_nvsDurEnabled) {
-          _durations.durWeekCurr = 0;
-          _durations.durWeekPrev = _nvsDur.durWeekCurr;
-        };
-      };
+#endif // CONFIG_LOADCTRL_METRICS_ENABLED
 
-      // Data was saved on the current month
-      if ((tmNow.tm_year == tmNvs.tm_year) && (tmNow.tm_mon == tmNvs.tm_mon)) {
-        if (_nvsCntEnabled) {
-          _counters.cntMonthCurr = _nvsCnt.cntMonthCurr;
-          _counters.cntMonthPrev = _nvsCnt.cntMonthPrev;
-        };
-        if (_nvsDurEnabled) {
-          _durations.durMonthCurr = _nvsDur.durMonthCurr;
-          _durations.durMonthPrev = _nvsDur.durMonthPrev;
-        };
-      }
-      // Data was saved on the previous month
-      else if (((tmNow.tm_year == tmNvs.tm_year) && (tmNow.tm_mon == tmNvs.tm_mon + 1)) 
-            || ((tmNow.tm_year == tmNvs.tm_year + 1) && (tmNow.tm_mon == 0) && (tmNvs.tm_mon == 11))) {
-        if (_nvsCntEnabled) {
-          _counters.cntMonthCurr = 0;
-          _counters.cntMonthPrev = _nvsCnt.cntMonthCurr;
-        };
-        if (_nvsDurEnabled) {
-          _durations.durMonthCurr = 0;
-          _durations.durMonthPrev = _nvsDur.durMonthCurr;
-        };
-      };
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Low power ------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
 
-      // Data was saved on the current period
-      if ((pyNow == pyNvs) && (pmNow == pmNvs)) {
-        if (_nvsCntEnabled) {
-          _counters.cntPeriodCurr = _nvsCnt.cntPeriodCurr;
-          _counters.cntPeriodPrev = _nvsCnt.cntPeriodPrev;
-        };
-        if (_nvsDurEnabled) {
-          _durations.durPeriodCurr = _nvsDur.durPeriodCurr;
-          _durations.durPeriodPrev = _nvsDur.durPeriodPrev;
-        };
-      }
-      // Data was saved on the previous period
-      else if (((pyNow == pyNvs) && (pmNow == pmNvs + 1)) 
-            || ((pyNow == pyNvs + 1) && (pmNow == 0) && (pmNvs == 11))) {
-        if (_nvsCntEnabled) {
-          _counters.cntPeriodCurr = 0;
-          _counters.cntPeriodPrev = _nvsCnt.cntPeriodCurr;
-        };
-        if (_nvsDurEnabled) {
-          _durations.durPeriodCurr = 0;
-          _durations.durPeriodPrev = _nvsDur.durPeriodCurr;
-        };
-      };
+#if CONFIG_LOADCTRL_LOWPOWER_ENABLED
 
-      // Data was saved on the current year
-      if (tmNow.tm_year == tmNvs.tm_year) {
-        if (_nvsCntEnabled) {
-          _counters.cntYearCurr = _nvsCnt.cntYearCurr;
-          _counters.cntYearPrev = _nvsCnt.cntYearPrev;
-        };
-        if (_nvsDurEnabled) {
-          _durations.durYearCurr = _nvsDur.durYearCurr;
-          _durations.durYearPrev = _nvsDur.durYearPrev;
-        };
-      } 
-      // Data was saved on the previous year
-      else if (tmNow.tm_year == tmNvs.tm_year + 1) {
-        if (_nvsCntEnabled) {
-          _counters.cntYearCurr = 0;
-          _counters.cntYearPrev = _nvsCnt.cntYearCurr;
-        };
-        if (_nvsDurEnabled) {
-          _durations.durYearCurr = 0;
-          _durations.durYearPrev = _nvsDur.durYearCurr;
-        };
-      };
+void rLoadController::lowPowerWakeup()
+{
+  _lowpower.wakeups++;
+  if (_low_power) {
+    int64_t slot = esp_timer_get_time() / ((int64_t)CONFIG_LOADCTRL_LOWPOWER_SLOT * 1000);
+    if (slot == _loadLowPowerSlot) {
+      _lowpower.wakeupsShared++;
+    } else {
+      _loadLowPowerSlot = slot;
     };
   };
 }
 
-void rLoadController::countersNvsStore()
+bool rLoadController::loadHoldGPIO(bool hold)
 {
-  if (_nvs_space && (_counters.cntTotal > 0)) {
-    nvs_handle_t nvs_handle;
-    if (nvsOpen(_nvs_space, NVS_READWRITE, &nvs_handle)) {
-      // Number of days since UNIX epoch, discarding time
-      uint32_t days = (uint32_t)(time(nullptr) / 86400);
-      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_DAYS, days));
-      RE_ERROR_LOG(nvs_commit(nvs_handle));
-      nvs_close(nvs_handle);
+  // I/O expanders keep their output levels by themselves
+  return true;
+}
+
+bool rLoadController::setLowPower(bool enabled)
+{
+  if (_low_power == enabled) return true;
+  if (enabled) {
+    if (!loadHoldGPIO(true)) return false;
+    _low_power = true;
+    #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+      checkpointStop();
+    #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+  } else {
+    // Counting of phases by switching is resumed from the phase calculated by the schedule
+    _cycle_count = getCycleCount();
+    _low_power = false;
+    lowPowerFlush();
+    if (_state_pending) {
+      _state_pending = false;
+      #if CONFIG_LOADCTRL_RESTORE_ENABLED
+        stateNvsStoreAll();
+      #endif // CONFIG_LOADCTRL_RESTORE_ENABLED
     };
+    loadHoldGPIO(false);
+    #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+      if (_state) checkpointStart();
+    #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+  };
+  rlog_i(logTAG, "Load on GPIO %d: low-power mode %s", _pin, enabled ? "enabled" : "disabled");
+  return true;
+}
 
-    char* nmsp_cnt = malloc_stringf("%s.cnt", _nvs_space);
-    if (nmsp_cnt) {
-      nvs_handle_t nvs_handle;
-      if (nvsOpen(nmsp_cnt, NVS_READWRITE, &nvs_handle)) {
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_TOTAL, _counters.cntTotal));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_TODAY, _counters.cntToday));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_YESTERDAY, _counters.cntYesterday));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_CURR, _counters.cntWeekCurr));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_PREV, _counters.cntWeekPrev));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_CURR, _counters.cntMonthCurr));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_PREV, _counters.cntMonthPrev));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_CURR, _counters.cntPeriodCurr));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_PREV, _counters.cntPeriodPrev));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_CURR, _counters.cntYearCurr));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_PREV, _counters.cntYearPrev));
-        RE_ERROR_LOG(nvs_commit(nvs_handle));
-        nvs_close(nvs_handle);
-      };
-      free(nmsp_cnt);
+bool rLoadController::getLowPower()
+{
+  return _low_power;
+}
+
+uint32_t rLoadController::lowPowerFlush()
+{
+  uint32_t ret = 0;
+  if (_publish_pending) {
+    // Only the latest state is published, however many changes there were since the last window
+    _publish_pending = false;
+    mqttPublish();
+    _lowpower.publishBatched++;
+    ret++;
+  };
+  if (_store_pending) {
+    _store_pending = false;
+    countersNvsStorePriv();
+    _lowpower.storeBatched++;
+    ret++;
+  };
+  #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+    // The periodic checkpoint timer is not used in low-power mode
+    if (_low_power && _state && (_checkpoint_interval > 0)
+     && ((esp_timer_get_time() - _checkpoint_mono) >= (int64_t)_checkpoint_interval * 1000000)
+     && checkpointStore()) {
+      _lowpower.storeBatched++;
+      ret++;
     };
+  #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+  return ret;
+}
 
-    char* nmsp_dur = malloc_stringf("%s.dur", _nvs_space);
-    if (nmsp_dur) {
-      nvs_handle_t nvs_handle;
-      if (nvsOpen(nmsp_dur, NVS_READWRITE, &nvs_handle)) {
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_LAST, _durations.durLast));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_TOTAL, _durations.durTotal));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_TODAY, _durations.durToday));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_YESTERDAY, _durations.durYesterday));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_CURR, _durations.durWeekCurr));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_PREV, _durations.durWeekPrev));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_CURR, _durations.durMonthCurr));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_PREV, _durations.durMonthPrev));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_CURR, _durations.durPeriodCurr));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_PREV, _durations.durPeriodPrev));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_CURR, _durations.durYearCurr));
-        RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_PREV, _durations.durYearPrev));
-        RE_ERROR_LOG(nvs_commit(nvs_handle));
-        nvs_close(nvs_handle);
+uint32_t rLoadController::lowPowerWindow()
+{
+  // All postponed work of all controllers is done in one pass, the state of all controllers is written once
+  uint32_t ret = 0;
+  bool state_store = false;
+  rLoadController* ctrl = _loadFirst;
+  while (ctrl) {
+    uint32_t done = ctrl->lowPowerFlush();
+    if (ctrl->_state_pending) {
+      ctrl->_state_pending = false;
+      if (!state_store) {
+        state_store = true;
+        ctrl->_lowpower.storeBatched++;
+        done++;
       };
-      free(nmsp_dur);
     };
+    if (done > 0) {
+      ctrl->_lowpower.windows++;
+      ret += done;
+    };
+    ctrl = ctrl->_next;
   };
+  #if CONFIG_LOADCTRL_RESTORE_ENABLED
+    if (state_store) {
+      stateNvsStoreAll();
+    };
+  #endif // CONFIG_LOADCTRL_RESTORE_ENABLED
+  return ret;
+}
+
+re_load_lowpower_stats_t rLoadController::getLowPowerStats()
+{
+  return _lowpower;
+}
+
+char* rLoadController::getLowPowerJSON()
+{
+  re_load_lowpower_stats_t lp = _lowpower;
+  return malloc_stringf("{\"pin\":%d,\"lowpower\":%d,\"wakeups\":%d,\"shared\":%d,\"windows\":%d,\"publish\":{\"deferred\":%d,\"batched\":%d},\"nvs\":{\"deferred\":%d,\"batched\":%d}}",
+    _pin, _low_power, lp.wakeups, lp.wakeupsShared, lp.windows, lp.publishDeferred, lp.publishBatched, lp.storeDeferred, lp.storeBatched);
 }
 
+#endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+
 // -----------------------------------------------------------------------------------------------------------------------
 // --------------------------------------------------- Event handlers ----------------------------------------------------
 // -----------------------------------------------------------------------------------------------------------------------
 
 void rLoadController::countersTimeEventHandler(int32_t event_id, void* event_data)
 {
-  // Start of the day
-  if (event_id == RE_TIME_START_OF_DAY) {
-    _counters.cntYesterday = _counters.cntToday;
-    _counters.cntToday = 0;
-    _durations.durYesterday = _durations.durToday;
-    _durations.durToday = 0;
+  loadLock();
+  if (event_id == RE_TIME_SNTP_SYNC_OK) {
+    timestampsRepair();
+  } else {
+    loadCountersTimeEvent(&_counters, &_durations, _period_start, event_id, event_data);
+  };
+  loadUnlock();
+}
 
-    if ((event_data) && (_period_start)) {
-      int* mday = (int*)event_data;
-      if (*mday == *_period_start) {
-        _counters.cntPeriodPrev = _counters.cntPeriodCurr;
-        _counters.cntPeriodCurr = 0;
-        _durations.durPeriodPrev = _durations.durPeriodCurr;
-        _durations.durPeriodCurr = 0;
-      };
-    };
-  }
-  // Beginning of the week
-  else if (event_id == RE_TIME_START_OF_WEEK) {
-    _counters.cntWeekPrev = _counters.cntWeekCurr;
-    _counters.cntWeekCurr = 0;
-    _durations.durWeekPrev = _durations.durWeekCurr;
-    _durations.durWeekCurr = 0;
-  }
-  // Beginning of the month
-  else if (event_id == RE_TIME_START_OF_MONTH) {
-    _counters.cntMonthPrev = _counters.cntMonthCurr;
-    _counters.cntMonthCurr = 0;
-    _durations.durMonthPrev = _durations.durMonthCurr;
-    _durations.durMonthCurr = 0;
-  }
-  // Beginning of the year
-  else if (event_id == RE_TIME_START_OF_YEAR) {
-    _counters.cntYearPrev = _counters.cntYearCurr;
-    _counters.cntYearCurr  = 0;
-    _durations.durYearPrev = _durations.durYearCurr;
-    _durations.durYearCurr  = 0;
+void rLoadController::timestampsRepair()
+{
+  // Switching that happened before the time synchronization is back-attributed by the monotonic clock
+  if ((_last_on <= LOAD_TIME_VALID) && (_mono_on > 0)) {
+    _last_on = loadMonoToTime(_mono_on);
+  };
+  if (!_state && (_last_off <= LOAD_TIME_VALID) && (_mono_on > 0)) {
+    // The moment of switching off is not kept, it follows from the duration of the last on-interval
+    _last_off = loadMonoToTime(_mono_on + (int64_t)_durations.durLast * 1000000);
   };
 }
 
@@ -883,10 +2968,30 @@ bool rLoadGpioController::loadInitGPIO()
 
 bool rLoadGpioController::loadSetStateGPIO(uint8_t physical_level)
 {
+  #if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+    // A held pin ignores writes: release, change and hold again
+    if (_low_power) {
+      gpio_hold_dis((gpio_num_t)_pin);
+      esp_err_t err = gpio_set_level((gpio_num_t)_pin, (uint32_t)physical_level);
+      gpio_hold_en((gpio_num_t)_pin);
+      ERR_LOAD_CHECK(err, ERR_GPIO_SET_LEVEL);
+      return true;
+    };
+  #endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
   ERR_LOAD_CHECK(gpio_set_level((gpio_num_t)_pin, (uint32_t)physical_level), ERR_GPIO_SET_LEVEL);
   return true;
 }
 
+#if CONFIG_LOADCTRL_LOWPOWER_ENABLED
+
+bool rLoadGpioController::loadHoldGPIO(bool hold)
+{
+  ERR_LOAD_CHECK(hold ? gpio_hold_en((gpio_num_t)_pin) : gpio_hold_dis((gpio_num_t)_pin), "Failed to change GPIO hold");
+  return true;
+}
+
+#endif // CONFIG_LOADCTRL_LOWPOWER_ENABLED
+
 // -----------------------------------------------------------------------------------------------------------------------
 // -----------------------------------------------------------------------------------------------------------------------
 // ------------------------------------------------- rLoadIoExpController ------------------------------------------------
@@ -933,8 +3038,282 @@ bool rLoadIoExpController::loadInitGPIO()
 bool rLoadIoExpController::loadSetStateGPIO(uint8_t physical_level)
 {
   if (_gpio_change) {
-    return _gpio_change(this, _pin, physical_level);
+    #if CONFIG_LOADCTRL_VERIFY_ENABLED
+      // A new level cancels retries of the previous one
+      if ((_verify_timer != nullptr) && esp_timer_is_active(_verify_timer)) {
+        esp_timer_stop(_verify_timer);
+      };
+      _verify_attempt = 0;
+      _verify_reconcile = false;
+      _level = physical_level;
+      bool ret = _gpio_change(this, _pin, physical_level);
+      if (ret && _gpio_read && !verifyCheck()) {
+        // The bus reported success, but the level did not latch: repeat on a timer without blocking the caller;
+        // without retries the switching fails right away
+        return verifySchedule();
+      };
+      return ret;
+    #else
+      return _gpio_change(this, _pin, physical_level);
+    #endif // CONFIG_LOADCTRL_VERIFY_ENABLED
+  };
+  return false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------- Read-back verification ----------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+#if CONFIG_LOADCTRL_VERIFY_ENABLED
+
+bool rLoadController::loadRetryRequest(uint8_t physical_level)
+{
+  #if CONFIG_LOADCTRL_BUS_ENABLED
+    if (_bus) {
+      return _bus->submit(this, physical_level, LOAD_ASYNC_RETRY);
+    };
+  #endif // CONFIG_LOADCTRL_BUS_ENABLED
+  loadLock();
+  loadRetryGPIO(physical_level);
+  loadUnlock();
+  return true;
+}
+
+void rLoadController::loadRetryGPIO(uint8_t physical_level)
+{
+}
+
+void rLoadController::loadVerifyFailed(bool commanded_state)
+{
+  _reject = LOAD_REJECT_GPIO;
+  // A newer switching or the next cycle phase will write the level again
+  if ((loadTargetState() != _state) || (_state != commanded_state) || (_state && (_cycle_count >= 0))) {
+    return;
+  };
+  // The load has kept its previous state: the counters, timers and listeners must not see the commanded one
+  rlog_e(logTAG, "Load on pin %d: the level did not latch, the state is corrected to %s", _pin, commanded_state ? "OFF" : "ON");
+  #if CONFIG_LOADCTRL_LISTENERS_ENABLED
+    _source = LOAD_SOURCE_VERIFY;
+  #endif // CONFIG_LOADCTRL_LISTENERS_ENABLED
+  loadSetStateFinalize(!commanded_state, true);
+}
+
+rLoadIoExpController::~rLoadIoExpController()
+{
+  if (_verify_timer != nullptr) {
+    if (esp_timer_is_active(_verify_timer)) {
+      esp_timer_stop(_verify_timer);
+    };
+    esp_timer_delete(_verify_timer);
+    _verify_timer = nullptr;
+  };
+}
+
+void rLoadIoExpController::setReadback(cb_load_gpio_read_t cb_gpio_read, uint8_t retries, uint32_t backoff_ms)
+{
+  _gpio_read = cb_gpio_read;
+  _verify_retries = retries;
+  _verify_backoff = backoff_ms;
+}
+
+bool rLoadIoExpController::verifyCheck()
+{
+  uint8_t level = 0;
+  if (_gpio_read(this, _pin, &level) && ((level != 0) == (_level != 0))) {
+    return true;
+  };
+  #if CONFIG_LOADCTRL_METRICS_ENABLED
+    _metrics.verifyMismatch++;
+  #endif // CONFIG_LOADCTRL_METRICS_ENABLED
+  rlog_w(logTAG, "Load on pin %d: read-back level does not match the written one", _pin);
+  return false;
+}
+
+static void loadIoExpVerifyTimerEnd(void* arg)
+{
+  if (arg) {
+    rLoadIoExpController* ctrl = (rLoadIoExpController*)arg;
+    ctrl->verifyRetry();
+  };
+}
+
+bool rLoadIoExpController::verifySchedule()
+{
+  if (_verify_attempt >= _verify_retries) {
+    #if CONFIG_LOADCTRL_METRICS_ENABLED
+      _metrics.verifyFailed++;
+    #endif // CONFIG_LOADCTRL_METRICS_ENABLED
+    rlog_e(logTAG, "Load on pin %d: failed to set level after %d retries", _pin, _verify_attempt);
+    return false;
+  };
+  if (_verify_timer == nullptr) {
+    esp_timer_create_args_t cfg;
+    memset(&cfg, 0, sizeof(esp_timer_create_args_t));
+    cfg.name = "load_ctrl_verify";
+    cfg.callback = loadIoExpVerifyTimerEnd;
+    cfg.arg = this;
+    RE_OK_CHECK(esp_timer_create(&cfg, &_verify_timer), return false);
+  };
+  // Exponential backoff
+  uint64_t delay = (uint64_t)_verify_backoff * 1000 << (_verify_attempt < 16 ? _verify_attempt : 16);
+  if (delay == 0) delay = 1000;
+  RE_OK_CHECK(esp_timer_start_once(_verify_timer, delay), return false);
+  return true;
+}
+
+void rLoadIoExpController::verifyRetry()
+{
+  if (_level != 0xFF) {
+    loadRetryRequest(_level);
+  };
+}
+
+void rLoadIoExpController::loadRetryGPIO(uint8_t physical_level)
+{
+  // A new level has been written since the retry was requested
+  if ((_gpio_change == nullptr) || (physical_level != _level)) return;
+
+  _verify_attempt++;
+  #if CONFIG_LOADCTRL_METRICS_ENABLED
+    _metrics.verifyRetries++;
+  #endif // CONFIG_LOADCTRL_METRICS_ENABLED
+  if (_gpio_change(this, _pin, _level) && ((_gpio_read == nullptr) || verifyCheck())) {
+    rlog_i(logTAG, "Load on pin %d: level is set after %d retries", _pin, _verify_attempt);
+    // The divergence is fixed only when the rewritten level is read back
+    #if CONFIG_LOADCTRL_METRICS_ENABLED
+      if (_verify_reconcile) _metrics.reconcileFixed++;
+    #endif // CONFIG_LOADCTRL_METRICS_ENABLED
+    _verify_reconcile = false;
+    return;
+  };
+  if (!verifySchedule()) {
+    _verify_reconcile = false;
+    loadVerifyFailed((_level != 0) == (_level_on != 0));
+  };
+}
+
+bool rLoadIoExpController::verifyLevel(uint8_t physical_level)
+{
+  loadLock();
+  bool ret = verifyLevelPriv(physical_level);
+  loadUnlock();
+  return ret;
+}
+
+bool rLoadIoExpController::verifyLevelPriv(uint8_t physical_level)
+{
+  if ((_level != 0xFF) && ((physical_level != 0) != (_level != 0))) {
+    #if CONFIG_LOADCTRL_METRICS_ENABLED
+      _metrics.verifyMismatch++;
+    #endif // CONFIG_LOADCTRL_METRICS_ENABLED
+    // Retries are already scheduled
+    if ((_verify_timer != nullptr) && esp_timer_is_active(_verify_timer)) {
+      return false;
+    };
+    rlog_w(logTAG, "Load on pin %d: actual level differs from the written one, rewriting", _pin);
+    _verify_attempt = 0;
+    _verify_reconcile = true;
+    if (!loadRetryRequest(_level)) {
+      _verify_reconcile = false;
+    };
+    return false;
+  };
+  return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------- rLoadIoExpPort ---------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+rLoadIoExpPort::rLoadIoExpPort(uint8_t max_loads, cb_load_port_read_t cb_port_read, void* port_arg, uint32_t interval_ms)
+{
+  _count = 0;
+  _max_loads = 0;
+  _loads = (rLoadIoExpController**)calloc(max_loads, sizeof(rLoadIoExpController*));
+  if (_loads) {
+    _max_loads = max_loads;
+  };
+  _port_read = cb_port_read;
+  _port_arg = port_arg;
+  _interval = interval_ms;
+  _timer = nullptr;
+}
+
+rLoadIoExpPort::~rLoadIoExpPort()
+{
+  stop();
+  if (_timer != nullptr) {
+    esp_timer_delete(_timer);
+    _timer = nullptr;
+  };
+  if (_loads) free(_loads);
+  _loads = nullptr;
+  _count = 0;
+}
+
+bool rLoadIoExpPort::loadAdd(rLoadIoExpController* ctrl)
+{
+  if (ctrl && (_count < _max_loads)) {
+    _loads[_count] = ctrl;
+    _count++;
+    return true;
+  };
+  return false;
+}
+
+bool rLoadIoExpPort::reconcile()
+{
+  // One batched read for all loads on the expander
+  uint32_t levels = 0;
+  if (_port_read && _port_read(_port_arg, &levels)) {
+    bool ret = true;
+    for (uint8_t i = 0; i < _count; i++) {
+      // The port is read as a 32-bit mask, pins beyond it cannot be checked
+      if (_loads[i]->getPin() < 32) {
+        ret = _loads[i]->verifyLevel((levels >> _loads[i]->getPin()) & 0x01) && ret;
+      };
+    };
+    return ret;
+  };
+  return false;
+}
+
+static void loadIoExpPortTimerEnd(void* arg)
+{
+  if (arg) {
+    rLoadIoExpPort* port = (rLoadIoExpPort*)arg;
+    port->reconcile();
+  };
+}
+
+bool rLoadIoExpPort::start()
+{
+  if (_interval > 0) {
+    if (_timer == nullptr) {
+      esp_timer_create_args_t cfg;
+      memset(&cfg, 0, sizeof(esp_timer_create_args_t));
+      cfg.name = "load_ioexp_port";
+      cfg.callback = loadIoExpPortTimerEnd;
+      cfg.arg = this;
+      RE_OK_CHECK(esp_timer_create(&cfg, &_timer), return false);
+    };
+    if (esp_timer_is_active(_timer)) {
+      esp_timer_stop(_timer);
+    };
+    RE_OK_CHECK(esp_timer_start_periodic(_timer, (uint64_t)_interval * 1000), return false);
+    return true;
   };
   return false;
 }
 
+void rLoadIoExpPort::stop()
+{
+  if ((_timer != nullptr) && esp_timer_is_active(_timer)) {
+    esp_timer_stop(_timer);
+  };
+}
+
+#endif // CONFIG_LOADCTRL_VERIFY_ENABLED
+
@@ -0,0 +1,181 @@
+#include "reLoadFuzz.h"
+
+#if CONFIG_LOADCTRL_FUZZ_ENABLED
+
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "rLog.h"
+
+static const char* logTAG = "LOAD";
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------- Reference model ---------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+typedef struct {
+  uint32_t week;
+  uint32_t month;
+  uint32_t period;
+  uint32_t year;
+} re_load_calendar_t;
+
+static void loadCalendarIndexes(uint32_t days, uint8_t period_start, re_load_calendar_t* cal)
+{
+  // The same conversion of the day to the local date as in loadCountersCatchUp()
+  time_t time = (time_t)days * 86400 + 1;
+  struct tm tm;
+  localtime_r(&time, &tm);
+  cal->week = (days + 3) / 7;
+  cal->year = tm.tm_year;
+  cal->month = (uint32_t)tm.tm_year * 12 + tm.tm_mon;
+  // The billing period is named after the month in which it ends
+  cal->period = period_start > 0 ? cal->month + (tm.tm_mday >= period_start ? 1 : 0) : 0;
+}
+
+static void loadCatchUpPair(uint32_t idxNow, uint32_t idxNvs, uint32_t nvsCurr, uint32_t nvsPrev, uint32_t* curr, uint32_t* prev)
+{
+  if (idxNow == idxNvs) {
+    *curr = nvsCurr;
+    *prev = nvsPrev;
+  } else if (idxNow == idxNvs + 1) {
+    *curr = 0;
+    *prev = nvsCurr;
+  };
+}
+
+void loadCatchUpReference(re_load_catchup_case_t* data, re_load_counters_t* counters, re_load_durations_t* durations)
+{
+  re_load_counters_t* c = &data->counters;
+  re_load_durations_t* d = &data->durations;
+  if (data->daysNow == data->daysNvs) {
+    *counters = *c;
+    *durations = *d;
+    return;
+  };
+
+  counters->cntTotal = c->cntTotal;
+  counters->cntOverflow = c->cntOverflow;
+  durations->durLast = d->durLast;
+  durations->durTotal = d->durTotal;
+  durations->durOverflow = d->durOverflow;
+  if (data->daysNow == data->daysNvs + 1) {
+    counters->cntToday = 0;
+    counters->cntYesterday = c->cntToday;
+    durations->durToday = 0;
+    durations->durYesterday = d->durToday;
+  };
+
+  re_load_calendar_t calNow, calNvs;
+  loadCalendarIndexes(data->daysNow, data->period_start, &calNow);
+  loadCalendarIndexes(data->daysNvs, data->period_start, &calNvs);
+  // Only the windows that continue keep their overflow flags, the day has always changed here
+  uint32_t keep = (calNow.week == calNvs.week ? LOAD_OVF_WEEK : 0) | (calNow.month == calNvs.month ? LOAD_OVF_MONTH : 0)
+                | (calNow.period == calNvs.period ? LOAD_OVF_PERIOD : 0) | (calNow.year == calNvs.year ? LOAD_OVF_YEAR : 0);
+  counters->cntOverflow &= keep;
+  durations->durOverflow &= keep;
+  loadCatchUpPair(calNow.week, calNvs.week, c->cntWeekCurr, c->cntWeekPrev, &counters->cntWeekCurr, &counters->cntWeekPrev);
+  loadCatchUpPair(calNow.week, calNvs.week, d->durWeekCurr, d->durWeekPrev, &durations->durWeekCurr, &durations->durWeekPrev);
+  loadCatchUpPair(calNow.month, calNvs.month, c->cntMonthCurr, c->cntMonthPrev, &counters->cntMonthCurr, &counters->cntMonthPrev);
+  loadCatchUpPair(calNow.month, calNvs.month, d->durMonthCurr, d->durMonthPrev, &durations->durMonthCurr, &durations->durMonthPrev);
+  loadCatchUpPair(calNow.period, calNvs.period, c->cntPeriodCurr, c->cntPeriodPrev, &counters->cntPeriodCurr, &counters->cntPeriodPrev);
+  loadCatchUpPair(calNow.period, calNvs.period, d->durPeriodCurr, d->durPeriodPrev, &durations->durPeriodCurr, &durations->durPeriodPrev);
+  loadCatchUpPair(calNow.year, calNvs.year, c->cntYearCurr, c->cntYearPrev, &counters->cntYearCurr, &counters->cntYearPrev);
+  loadCatchUpPair(calNow.year, calNvs.year, d->durYearCurr, d->durYearPrev, &durations->durYearCurr, &durations->durYearPrev);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Checks -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Field by field: the 64-bit total leaves padding at the end of re_load_counters_t
+static bool loadCountersEqual(re_load_counters_t* a, re_load_counters_t* b)
+{
+  return (a->cntTotal == b->cntTotal) && (a->cntOverflow == b->cntOverflow)
+      && (a->cntToday == b->cntToday) && (a->cntYesterday == b->cntYesterday)
+      && (a->cntWeekCurr == b->cntWeekCurr) && (a->cntWeekPrev == b->cntWeekPrev)
+      && (a->cntMonthCurr == b->cntMonthCurr) && (a->cntMonthPrev == b->cntMonthPrev)
+      && (a->cntPeriodCurr == b->cntPeriodCurr) && (a->cntPeriodPrev == b->cntPeriodPrev)
+      && (a->cntYearCurr == b->cntYearCurr) && (a->cntYearPrev == b->cntYearPrev);
+}
+
+bool loadCatchUpCheck(re_load_catchup_case_t* data)
+{
+  // Both sides start from the state of a freshly created controller
+  re_load_counters_t cntReal = {}, cntRef = {};
+  re_load_durations_t durReal = {}, durRef = {};
+  uint8_t period_start = data->period_start;
+  loadCountersCatchUp(data->daysNvs, data->daysNow, &period_start, &data->counters, &data->durations, &cntReal, &durReal);
+  loadCatchUpReference(data, &cntRef, &durRef);
+
+  // Totals are never lost
+  bool ret = (cntReal.cntTotal == data->counters.cntTotal) && (durReal.durTotal == data->durations.durTotal);
+  // Restore must not depend on anything but the calendar
+  ret = ret && loadCountersEqual(&cntReal, &cntRef)
+            && (memcmp(&durReal, &durRef, sizeof(re_load_durations_t)) == 0);
+  if (!ret) {
+    rlog_e(logTAG, "Catch-up check failed: stored on day %d, restored on day %d, period start %d",
+      data->daysNvs, data->daysNow, data->period_start);
+  };
+  return ret;
+}
+
+static uint32_t loadFuzzRandom(uint32_t* state)
+{
+  // xorshift32: deterministic, so that a failed case can be reproduced from the seed
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+uint32_t loadCatchUpSelfTest(uint32_t iterations, uint32_t seed)
+{
+  // Distances between store and restore that hit the boundaries of days, weeks, months and years
+  static const int32_t deltas[] = { 0, 1, 2, 6, 7, 8, 13, 14, 27, 28, 29, 30, 31, 32, 59, 60, 61, 62, 364, 365, 366, 367, -1 };
+  uint32_t state = seed ? seed : 1;
+  uint32_t failed = 0;
+  re_load_catchup_case_t data;
+  for (uint32_t i = 0; i < iterations; i++) {
+    memset((void*)&data, 0, sizeof(re_load_catchup_case_t));
+    data.daysNvs = 1 + loadFuzzRandom(&state) % (LOAD_FUZZ_DAYS_MAX - 800);
+    uint32_t r = loadFuzzRandom(&state);
+    if (r & 1) {
+      data.daysNow = data.daysNvs + deltas[(r >> 1) % (sizeof(deltas) / sizeof(deltas[0]))];
+    } else {
+      data.daysNow = data.daysNvs + (r >> 1) % 800;
+    };
+    data.period_start = loadFuzzRandom(&state) % 32;
+    uint32_t* cnt = (uint32_t*)&data.counters;
+    for (uint8_t j = 0; j < sizeof(re_load_counters_t) / sizeof(uint32_t); j++) {
+      cnt[j] = loadFuzzRandom(&state);
+    };
+    uint32_t* dur = (uint32_t*)&data.durations;
+    for (uint8_t j = 0; j < sizeof(re_load_durations_t) / sizeof(uint32_t); j++) {
+      dur[j] = loadFuzzRandom(&state);
+    };
+    if (!loadCatchUpCheck(&data)) {
+      failed++;
+    };
+  };
+  rlog_i(logTAG, "Catch-up self-test: %d cases, %d failed", iterations, failed);
+  return failed;
+}
+
+int loadCatchUpFuzz(const uint8_t* data, size_t size)
+{
+  if (size < sizeof(re_load_catchup_case_t)) return 0;
+  re_load_catchup_case_t fuzz;
+  memcpy(&fuzz, data, sizeof(re_load_catchup_case_t));
+  fuzz.daysNvs = fuzz.daysNvs % LOAD_FUZZ_DAYS_MAX;
+  fuzz.daysNow = fuzz.daysNow % LOAD_FUZZ_DAYS_MAX;
+  // Divergence is reported as a crash, so that the fuzzer keeps the input
+  if (!loadCatchUpCheck(&fuzz)) {
+    abort();
+  };
+  return 0;
+}
+
+#endif // CONFIG_LOADCTRL_FUZZ_ENABLED
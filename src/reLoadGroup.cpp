@@ -0,0 +1,624 @@
+#include "reLoadGroup.h"
+#include <stdio.h>
+#include <string.h>
+#include <driver/gpio.h>
+#include "reNvs.h"
+#include "reEvents.h"
+#include "reMqtt.h"
+#include "reEsp32.h"
+#include "rLog.h"
+#include "rStrings.h"
+
+static const char* logTAG = "LOAD";
+
+#define ERR_GPIO_SET_LEVEL "Failed to change GPIO level"
+#define ERR_GPIO_SET_MODE "Failed to set GPIO mode"
+
+#define LOAD_GROUP_CHECK_INDEX(index, ret) if ((_items == nullptr) || (index >= _count)) { return ret; };
+
+static uint32_t loadGroupNowMs()
+{
+  return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ rLoadGroup -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+rLoadGroup::rLoadGroup(uint8_t count, const char* nvs_prefix,
+  uint32_t* cycle_duration, uint32_t* cycle_interval, timeintv_t cycle_type,
+  cb_load_group_gpio_init_t cb_gpio_init, cb_load_group_gpio_change_t cb_gpio_change,
+  cb_load_group_change_t cb_state_changed, cb_load_group_publish_t cb_mqtt_publish)
+{
+  _count = 0;
+  _items = (re_load_group_item_t*)calloc(count, sizeof(re_load_group_item_t));
+  if (_items) {
+    _count = count;
+  } else {
+    rlog_e(logTAG, "Failed to allocate memory for %d loads", count);
+  };
+
+  _nvs_prefix = nvs_prefix;
+  if (_nvs_prefix && (strlen(_nvs_prefix) + 3 > LOAD_NVS_SPACE_MAX - LOAD_NVS_SUFFIX_LEN)) {
+    rlog_w(logTAG, "NVS prefix \"%s\" is too long, counters of some loads will not be saved", _nvs_prefix);
+  };
+  _cycle_duration = cycle_duration;
+  _cycle_interval = cycle_interval;
+  _cycle_type = cycle_type;
+  _period_start = nullptr;
+  _mqtt_prefix = nullptr;
+  _timer = nullptr;
+  // Created here, before the group is visible to other tasks
+  _lock = xSemaphoreCreateRecursiveMutex();
+
+  // Callbacks
+  _gpio_init = cb_gpio_init;
+  _gpio_change = cb_gpio_change;
+  _gpio_before = nullptr;
+  _gpio_after = nullptr;
+  _state_changed = cb_state_changed;
+  _mqtt_publish = cb_mqtt_publish;
+}
+
+rLoadGroup::~rLoadGroup()
+{
+  // Waits for the timer task if it is processing the group
+  lock();
+  if (_timer != nullptr) {
+    if (esp_timer_is_active(_timer)) {
+      esp_timer_stop(_timer);
+    };
+    esp_timer_delete(_timer);
+    _timer = nullptr;
+  };
+  unlock();
+  if (_mqtt_prefix) free(_mqtt_prefix);
+  _mqtt_prefix = nullptr;
+  if (_items) free(_items);
+  _items = nullptr;
+  _count = 0;
+  if (_lock) vSemaphoreDelete(_lock);
+  _lock = nullptr;
+}
+
+void rLoadGroup::lock()
+{
+  if (_lock) xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+}
+
+void rLoadGroup::unlock()
+{
+  if (_lock) xSemaphoreGiveRecursive(_lock);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Parameters -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+uint8_t rLoadGroup::getCount()
+{
+  return _count;
+}
+
+bool rLoadGroup::loadAttach(uint8_t index, uint8_t pin, uint8_t level_on)
+{
+  LOAD_GROUP_CHECK_INDEX(index, false);
+  lock();
+  _items[index].pin = pin;
+  _items[index].level_on = level_on ? 1 : 0;
+  unlock();
+  return true;
+}
+
+void rLoadGroup::setPeriodStartDay(uint8_t* mday)
+{
+  lock();
+  _period_start = mday;
+  unlock();
+}
+
+void rLoadGroup::setCallbacks(cb_load_group_change_t cb_gpio_before, cb_load_group_change_t cb_gpio_after, cb_load_group_change_t cb_state_changed)
+{
+  lock();
+  _gpio_before = cb_gpio_before;
+  _gpio_after = cb_gpio_after;
+  _state_changed = cb_state_changed;
+  unlock();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------------- Load --------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+bool rLoadGroup::loadInit(uint8_t index, bool init_value)
+{
+  LOAD_GROUP_CHECK_INDEX(index, false);
+  lock();
+  re_load_group_item_t* item = &_items[index];
+  bool ret = true;
+  if (_gpio_init) {
+    ret = _gpio_init(this, index, item->pin, item->level_on);
+  } else {
+    // Configure internal GPIO to output
+    gpio_reset_pin((gpio_num_t)item->pin);
+    esp_err_t err = gpio_set_direction((gpio_num_t)item->pin, GPIO_MODE_OUTPUT);
+    if (err != ESP_OK) {
+      rlog_e(logTAG, "%s: #%d %s", ERR_GPIO_SET_MODE, err, esp_err_to_name(err));
+      ret = false;
+    };
+  };
+  if (ret) {
+    ret = loadSetState(index, init_value, true, false);
+  };
+  unlock();
+  return ret;
+}
+
+bool rLoadGroup::loadInitAll(bool init_value)
+{
+  bool ret = true;
+  lock();
+  for (uint8_t i = 0; i < _count; i++) {
+    ret = loadInit(i, init_value) && ret;
+  };
+  unlock();
+  return ret;
+}
+
+bool rLoadGroup::loadSetStatePriv(uint8_t index, bool new_state)
+{
+  re_load_group_item_t* item = &_items[index];
+  uint8_t phy_level = new_state ? item->level_on : !item->level_on;
+  if (_gpio_before) {
+    _gpio_before(this, index, phy_level, 0);
+  };
+  bool ret = false;
+  if (_gpio_change) {
+    ret = _gpio_change(this, index, item->pin, phy_level);
+  } else {
+    esp_err_t err = gpio_set_level((gpio_num_t)item->pin, (uint32_t)phy_level);
+    if (err == ESP_OK) {
+      ret = true;
+    } else {
+      rlog_e(logTAG, "%s: #%d %s", ERR_GPIO_SET_LEVEL, err, esp_err_to_name(err));
+    };
+  };
+  if (_gpio_after) {
+    _gpio_after(this, index, phy_level, 0);
+  };
+  return ret;
+}
+
+bool rLoadGroup::loadSetState(uint8_t index, bool new_state, bool forced, bool publish)
+{
+  LOAD_GROUP_CHECK_INDEX(index, false);
+  bool ret = false;
+  lock();
+  re_load_group_item_t* item = &_items[index];
+  if (forced || (item->state != new_state)) {
+    bool change_ok = false;
+    if (cycleEnabled()) {
+      // Activate cycle
+      item->cycle_state = 0;
+      if (new_state) {
+        item->cycle_active = 1;
+        item->cycle_count = 0;
+        change_ok = cycleToggle(index);
+        if (!change_ok) item->cycle_active = 0;
+      } else {
+        item->cycle_active = 0;
+        change_ok = loadSetStatePriv(index, false);
+      };
+    } else {
+      // Set physical level to GPIO
+      item->cycle_active = 0;
+      change_ok = loadSetStatePriv(index, new_state);
+    };
+
+    // If the change level was successful
+    if (change_ok && (item->state != new_state)) {
+      item->state = new_state;
+      if (new_state) {
+        item->mono_last = (uint32_t)(esp_timer_get_time() / 1000000);
+        item->last_on = (uint32_t)time(nullptr);
+        item->durations.durLast = 0;
+        loadCountersIncrement(&item->counters);
+        rlog_i(logTAG, "Load on GPIO %d is ON", item->pin);
+      } else {
+        uint32_t mono_on = item->mono_last;
+        item->mono_last = (uint32_t)(esp_timer_get_time() / 1000000);
+        item->last_off = (uint32_t)time(nullptr);
+        item->timer_active = 0;
+        // The turn-on duration is calculated by the monotonic clock, so it does not depend on SNTP synchronization
+        loadDurationsIncrement(&item->durations, item->mono_last - mono_on);
+        rlog_i(logTAG, "Load on GPIO %d is OFF", item->pin);
+      };
+      timerArm();
+
+      // Publish status and counters
+      if (publish) {
+        mqttPublish(index);
+      };
+
+      // Call external callback
+      if (_state_changed) {
+        _state_changed(this, index, new_state, item->durations.durLast);
+      };
+      ret = true;
+    } else {
+      timerArm();
+    };
+  };
+  unlock();
+  return ret;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Cycle --------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+bool rLoadGroup::cycleEnabled()
+{
+  return (_cycle_duration) && (*_cycle_duration > 0) && (_cycle_interval) && (*_cycle_interval > 0);
+}
+
+bool rLoadGroup::cycleToggle(uint8_t index)
+{
+  re_load_group_item_t* item = &_items[index];
+  if (item->cycle_active && cycleEnabled()) {
+    bool new_state = !item->cycle_state;
+    if (loadSetStatePriv(index, new_state)) {
+      if (new_state && (item->cycle_count < UINT16_MAX)) item->cycle_count++;
+      item->cycle_state = new_state;
+      uint64_t duration = loadCycleDuration(new_state ? *_cycle_duration : *_cycle_interval, _cycle_type);
+      item->deadline_cycle = loadGroupNowMs() + (uint32_t)(duration / 1000);
+      return true;
+    };
+  };
+  return false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Timer --------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void loadGroupTimerEnd(void* arg)
+{
+  if (arg) {
+    rLoadGroup* group = (rLoadGroup*)arg;
+    group->timerProcess();
+  };
+}
+
+bool rLoadGroup::timerCreate()
+{
+  if (_timer == nullptr) {
+    esp_timer_create_args_t cfg;
+    memset(&cfg, 0, sizeof(esp_timer_create_args_t));
+    cfg.name = "load_group";
+    cfg.callback = loadGroupTimerEnd;
+    cfg.arg = this;
+    RE_OK_CHECK(esp_timer_create(&cfg, &_timer), return false);
+  };
+  return true;
+}
+
+void rLoadGroup::timerArm()
+{
+  // Find the earliest deadline of all loads
+  bool found = false;
+  int32_t delay = 0;
+  uint32_t now = loadGroupNowMs();
+  for (uint8_t i = 0; i < _count; i++) {
+    re_load_group_item_t* item = &_items[i];
+    if (item->timer_active) {
+      int32_t left = (int32_t)(item->deadline_off - now);
+      if (!found || (left < delay)) delay = left;
+      found = true;
+    };
+    if (item->cycle_active) {
+      int32_t left = (int32_t)(item->deadline_cycle - now);
+      if (!found || (left < delay)) delay = left;
+      found = true;
+    };
+  };
+
+  // Restart the timer
+  if (found && timerCreate()) {
+    if (esp_timer_is_active(_timer)) {
+      esp_timer_stop(_timer);
+    };
+    if (delay < 1) delay = 1;
+    RE_OK_CHECK(esp_timer_start_once(_timer, (uint64_t)delay * 1000), return);
+  } else if (_timer && esp_timer_is_active(_timer)) {
+    esp_timer_stop(_timer);
+  };
+}
+
+void rLoadGroup::timerProcess()
+{
+  lock();
+  uint32_t now = loadGroupNowMs();
+  for (uint8_t i = 0; i < _count; i++) {
+    re_load_group_item_t* item = &_items[i];
+    if (item->timer_active && ((int32_t)(item->deadline_off - now) <= 0)) {
+      item->timer_active = 0;
+      loadSetState(i, false, false, true);
+    };
+    if (item->cycle_active && ((int32_t)(item->deadline_cycle - now) <= 0)) {
+      if (!cycleToggle(i)) {
+        // Retry on the next cycle
+        uint64_t duration = loadCycleDuration(*_cycle_interval, _cycle_type);
+        item->deadline_cycle = now + (uint32_t)(duration / 1000);
+      };
+    };
+  };
+  timerArm();
+  unlock();
+}
+
+bool rLoadGroup::loadSetTimer(uint8_t index, uint32_t duration_ms)
+{
+  LOAD_GROUP_CHECK_INDEX(index, false);
+  lock();
+  re_load_group_item_t* item = &_items[index];
+  item->deadline_off = loadGroupNowMs() + duration_ms;
+  item->timer_active = 1;
+  bool ret = item->state || loadSetState(index, true, false, true);
+  if (!ret) {
+    item->timer_active = 0;
+  };
+  timerArm();
+  unlock();
+  return ret;
+}
+
+bool rLoadGroup::timerIsActive(uint8_t index)
+{
+  LOAD_GROUP_CHECK_INDEX(index, false);
+  return _items[index].timer_active;
+}
+
+bool rLoadGroup::timerStop(uint8_t index)
+{
+  LOAD_GROUP_CHECK_INDEX(index, false);
+  lock();
+  _items[index].timer_active = 0;
+  timerArm();
+  unlock();
+  return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Get data -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+bool rLoadGroup::getState(uint8_t index)
+{
+  LOAD_GROUP_CHECK_INDEX(index, false);
+  return _items[index].state;
+}
+
+uint8_t rLoadGroup::getPin(uint8_t index)
+{
+  LOAD_GROUP_CHECK_INDEX(index, 0);
+  return _items[index].pin;
+}
+
+time_t rLoadGroup::getLastOn(uint8_t index)
+{
+  LOAD_GROUP_CHECK_INDEX(index, 0);
+  return (time_t)_items[index].last_on;
+}
+
+time_t rLoadGroup::getLastOff(uint8_t index)
+{
+  LOAD_GROUP_CHECK_INDEX(index, 0);
+  return (time_t)_items[index].last_off;
+}
+
+re_load_counters_t rLoadGroup::getCounters(uint8_t index)
+{
+  re_load_counters_t ret;
+  LOAD_GROUP_CHECK_INDEX(index, ret);
+  lock();
+  ret = _items[index].counters;
+  unlock();
+  return ret;
+}
+
+uint32_t rLoadGroup::getCurrentDuration(uint8_t index, uint32_t mono_now)
+{
+  re_load_group_item_t* item = &_items[index];
+  if (item->state && (mono_now > item->mono_last)) {
+    return mono_now - item->mono_last;
+  };
+  return 0;
+}
+
+re_load_durations_t rLoadGroup::getDurations(uint8_t index)
+{
+  re_load_durations_t ret;
+  LOAD_GROUP_CHECK_INDEX(index, ret);
+  lock();
+  loadDurationsLive(&_items[index].durations, _items[index].state, 
+    getCurrentDuration(index, (uint32_t)(esp_timer_get_time() / 1000000)), &ret);
+  unlock();
+  return ret;
+}
+
+uint16_t rLoadGroup::getDurationsAll(re_load_durations_t* buf, uint16_t size)
+{
+  // All loads of the group are calculated at the same moment
+  uint16_t count = size < _count ? size : _count;
+  lock();
+  uint32_t now = (uint32_t)(esp_timer_get_time() / 1000000);
+  for (uint16_t i = 0; i < count; i++) {
+    loadDurationsLive(&_items[i].durations, _items[i].state, getCurrentDuration(i, now), &buf[i]);
+  };
+  unlock();
+  return count;
+}
+
+char* rLoadGroup::getJSON(uint8_t index)
+{
+  LOAD_GROUP_CHECK_INDEX(index, nullptr);
+  lock();
+  re_load_group_item_t* item = &_items[index];
+  char* ret = loadStatusJSON(item->state, item->cycle_active ? item->cycle_count : -1,
+    (time_t)item->last_on, (time_t)item->last_off, &item->counters, &item->durations, 
+    getCurrentDuration(index, (uint32_t)(esp_timer_get_time() / 1000000)));
+  unlock();
+  return ret;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- MQTT ---------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+void rLoadGroup::mqttSetCallback(cb_load_group_publish_t cb_publish)
+{
+  _mqtt_publish = cb_publish;
+}
+
+char* rLoadGroup::mqttTopicGet(uint8_t index)
+{
+  LOAD_GROUP_CHECK_INDEX(index, nullptr);
+  lock();
+  char* ret = loadTopicMake(_mqtt_prefix, nullptr, index);
+  unlock();
+  return ret;
+}
+
+bool rLoadGroup::mqttTopicSet(char* topic_prefix)
+{
+  lock();
+  if (_mqtt_prefix) free(_mqtt_prefix);
+  _mqtt_prefix = topic_prefix;
+  unlock();
+  return (topic_prefix != nullptr);
+}
+
+bool rLoadGroup::mqttTopicCreate(bool primary, bool local, const char* topic1, const char* topic2, const char* topic3)
+{
+  return mqttTopicSet(mqttGetTopicDevice(primary, local, topic1, topic2, topic3));
+}
+
+void rLoadGroup::mqttTopicFree()
+{
+  lock();
+  if (_mqtt_prefix) free(_mqtt_prefix);
+  _mqtt_prefix = nullptr;
+  unlock();
+}
+
+bool rLoadGroup::mqttPublish(uint8_t index)
+{
+  bool ret = false;
+  lock();
+  if ((_mqtt_prefix) && (_mqtt_publish)) {
+    char* topic = mqttTopicGet(index);
+    if (topic) {
+      ret = _mqtt_publish(this, index, topic, getJSON(index), true, true);
+    };
+  };
+  unlock();
+  return ret;
+}
+
+bool rLoadGroup::mqttPublishAll()
+{
+  bool ret = true;
+  for (uint8_t i = 0; i < _count; i++) {
+    ret = mqttPublish(i) && ret;
+  };
+  return ret;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------ Reading and saving counters from flash memory ------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+bool rLoadGroup::nvsSpace(uint8_t index, char* buf, size_t size)
+{
+  if (_nvs_prefix) {
+    // loadCountersNvsStore() appends ".cnt" / ".dur", the result must still fit into the NVS namespace limit
+    int len = snprintf(buf, size, "%s%d", _nvs_prefix, index);
+    return (len > 0) && ((size_t)len < size) && (len <= LOAD_NVS_SPACE_MAX - LOAD_NVS_SUFFIX_LEN);
+  };
+  return false;
+}
+
+void rLoadGroup::countersReset()
+{
+  lock();
+  for (uint8_t i = 0; i < _count; i++) {
+    memset((void*)&_items[i].counters, 0, sizeof(re_load_counters_t));
+    memset((void*)&_items[i].durations, 0, sizeof(re_load_durations_t));
+  };
+  unlock();
+}
+
+void rLoadGroup::countersNvsRestore()
+{
+  // Namespace for NVS is limited to 15 characters, including the ".cnt" / ".dur" suffixes
+  char nvs_space[16];
+  lock();
+  for (uint8_t i = 0; i < _count; i++) {
+    if (nvsSpace(i, nvs_space, sizeof(nvs_space))) {
+      loadCountersNvsRestore(nvs_space, _period_start, &_items[i].counters, &_items[i].durations, nullptr);
+    };
+  };
+  unlock();
+}
+
+void rLoadGroup::countersNvsStore()
+{
+  char nvs_space[16];
+  for (uint8_t i = 0; i < _count; i++) {
+    if (nvsSpace(i, nvs_space, sizeof(nvs_space))) {
+      // The flash write is done on a copy, outside the lock
+      lock();
+      re_load_counters_t counters = _items[i].counters;
+      re_load_durations_t durations = _items[i].durations;
+      unlock();
+      loadCountersNvsStore(nvs_space, &counters, &durations, nullptr);
+    };
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------- Event handlers ----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+void rLoadGroup::countersTimeEventHandler(int32_t event_id, void* event_data)
+{
+  lock();
+  if (event_id == RE_TIME_SNTP_SYNC_OK) {
+    timestampsRepair();
+  } else {
+    for (uint8_t i = 0; i < _count; i++) {
+      loadCountersTimeEvent(&_items[i].counters, &_items[i].durations, _period_start, event_id, event_data);
+    };
+  };
+  unlock();
+}
+
+void rLoadGroup::timestampsRepair()
+{
+  // Switching that happened before the time synchronization is back-attributed by the monotonic clock
+  for (uint8_t i = 0; i < _count; i++) {
+    re_load_group_item_t* item = &_items[i];
+    if (item->mono_last > 0) {
+      uint32_t last = (uint32_t)loadMonoToTime((int64_t)item->mono_last * 1000000);
+      if (item->state) {
+        if (item->last_on <= LOAD_TIME_VALID) item->last_on = last;
+      } else if (item->last_off <= LOAD_TIME_VALID) {
+        item->last_off = last;
+        if ((item->last_on > 0) && (item->last_on <= LOAD_TIME_VALID) && (last > item->durations.durLast)) {
+          item->last_on = last - item->durations.durLast;
+        };
+      };
+    };
+  };
+}
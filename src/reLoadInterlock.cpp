@@ -0,0 +1,249 @@
+#include "reLoadInterlock.h"
+
+#if CONFIG_LOADCTRL_INTERLOCK_ENABLED
+
+#include <string.h>
+#include "reEsp32.h"
+#include "rLog.h"
+
+static const char* logTAG = "LOAD";
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------- rLoadInterlock ---------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+rLoadInterlock::rLoadInterlock(uint8_t max_loads, uint32_t dead_time_ms)
+{
+  portMUX_INITIALIZE(&_lock);
+  _count = 0;
+  _max_loads = 0;
+  _loads = (rLoadController**)calloc(max_loads, sizeof(rLoadController*));
+  if (_loads) {
+    _max_loads = max_loads;
+  } else {
+    rlog_e(logTAG, "Failed to allocate memory for %d loads", max_loads);
+  };
+  _owner = nullptr;
+  _pending = nullptr;
+  _pending_publish = false;
+  _dead_time = (uint64_t)dead_time_ms * 1000;
+  _released_at = 0;
+  _rejected = 0;
+  _timer = nullptr;
+}
+
+rLoadInterlock::~rLoadInterlock()
+{
+  if (_timer != nullptr) {
+    if (esp_timer_is_active(_timer)) {
+      esp_timer_stop(_timer);
+    };
+    esp_timer_delete(_timer);
+    _timer = nullptr;
+  };
+  for (uint8_t i = 0; i < _count; i++) {
+    _loads[i]->setInterlock(nullptr);
+  };
+  if (_loads) free(_loads);
+  _loads = nullptr;
+  _count = 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------------- Loads -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+bool rLoadInterlock::loadAdd(rLoadController* ctrl)
+{
+  if (ctrl && (_count < _max_loads) && !isMember(ctrl)) {
+    portENTER_CRITICAL(&_lock);
+    _loads[_count] = ctrl;
+    _count++;
+    // The load may already be on
+    if (ctrl->getState() && (_owner == nullptr)) {
+      _owner = ctrl;
+    };
+    portEXIT_CRITICAL(&_lock);
+    ctrl->setInterlock(this);
+    return true;
+  };
+  return false;
+}
+
+void rLoadInterlock::loadRemove(rLoadController* ctrl)
+{
+  portENTER_CRITICAL(&_lock);
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_loads[i] == ctrl) {
+      for (uint8_t j = i; j < _count - 1; j++) {
+        _loads[j] = _loads[j + 1];
+      };
+      _count--;
+      break;
+    };
+  };
+  if (_owner == ctrl) _owner = nullptr;
+  if (_pending == ctrl) _pending = nullptr;
+  portEXIT_CRITICAL(&_lock);
+  ctrl->setInterlock(nullptr);
+}
+
+bool rLoadInterlock::isMember(rLoadController* ctrl)
+{
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_loads[i] == ctrl) {
+      return true;
+    };
+  };
+  return false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Parameters -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+void rLoadInterlock::setDeadTime(uint32_t dead_time_ms)
+{
+  _dead_time = (uint64_t)dead_time_ms * 1000;
+  timerArm();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- Requests ------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+re_load_reject_t rLoadInterlock::requestOn(rLoadController* ctrl, bool publish)
+{
+  re_load_reject_t ret = LOAD_REJECT_NONE;
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&_lock);
+  if (_owner == nullptr) {
+    if ((_dead_time > 0) && (_released_at > 0) && ((uint64_t)(now - _released_at) < _dead_time)) {
+      // The switch-on will be performed by the timer at the end of the dead time, the latest request wins
+      _pending = ctrl;
+      _pending_publish = publish;
+      ret = LOAD_REJECT_DEADTIME;
+    } else {
+      _owner = ctrl;
+      if (_pending == ctrl) _pending = nullptr;
+    };
+  } else if (_owner != ctrl) {
+    _rejected++;
+    ret = LOAD_REJECT_INTERLOCK;
+  };
+  portEXIT_CRITICAL(&_lock);
+
+  if (ret == LOAD_REJECT_DEADTIME) {
+    rlog_d(logTAG, "Interlock: switch-on of GPIO %d is delayed by dead time", ctrl->getPin());
+    timerArm();
+  } else if (ret == LOAD_REJECT_INTERLOCK) {
+    rlog_w(logTAG, "Interlock: switch-on of GPIO %d is rejected, GPIO %d is on", ctrl->getPin(), _owner ? _owner->getPin() : 0xFF);
+  };
+  return ret;
+}
+
+void rLoadInterlock::release(rLoadController* ctrl, bool was_on)
+{
+  portENTER_CRITICAL(&_lock);
+  if (_pending == ctrl) {
+    _pending = nullptr;
+  };
+  if (_owner == ctrl) {
+    _owner = nullptr;
+    // The dead time is counted only after the load was actually on
+    if (was_on) {
+      _released_at = esp_timer_get_time();
+    };
+  };
+  portEXIT_CRITICAL(&_lock);
+  timerArm();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Timer --------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void loadInterlockTimerEnd(void* arg)
+{
+  if (arg) {
+    rLoadInterlock* interlock = (rLoadInterlock*)arg;
+    interlock->timerProcess();
+  };
+}
+
+void rLoadInterlock::timerArm()
+{
+  bool start = false;
+  uint64_t delay = 1000;
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&_lock);
+  if (_pending && (_owner == nullptr)) {
+    start = true;
+    if ((_released_at > 0) && ((uint64_t)(now - _released_at) < _dead_time)) {
+      delay = _dead_time - (uint64_t)(now - _released_at);
+    };
+  };
+  portEXIT_CRITICAL(&_lock);
+
+  if (_timer == nullptr) {
+    esp_timer_create_args_t cfg;
+    memset(&cfg, 0, sizeof(esp_timer_create_args_t));
+    cfg.name = "load_interlock";
+    cfg.callback = loadInterlockTimerEnd;
+    cfg.arg = this;
+    RE_OK_CHECK(esp_timer_create(&cfg, &_timer), return);
+  };
+  if (esp_timer_is_active(_timer)) {
+    esp_timer_stop(_timer);
+  };
+  if (start) {
+    RE_OK_CHECK(esp_timer_start_once(_timer, delay), return);
+  };
+}
+
+void rLoadInterlock::timerProcess()
+{
+  rLoadController* ctrl = nullptr;
+  bool publish = false;
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&_lock);
+  if (_pending && (_owner == nullptr) && ((_released_at == 0) || ((uint64_t)(now - _released_at) >= _dead_time))) {
+    ctrl = _pending;
+    publish = _pending_publish;
+    _owner = ctrl;
+    _pending = nullptr;
+  };
+  portEXIT_CRITICAL(&_lock);
+
+  // Switching is performed outside the critical section, the claim is released by the controller on failure
+  if (ctrl) {
+    rlog_d(logTAG, "Interlock: delayed switch-on of GPIO %d", ctrl->getPin());
+    #if CONFIG_LOADCTRL_LISTENERS_ENABLED
+      ctrl->_source = LOAD_SOURCE_INTERLOCK;
+    #endif // CONFIG_LOADCTRL_LISTENERS_ENABLED
+    ctrl->loadSetState(true, false, publish);
+  } else {
+    timerArm();
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Get data -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+rLoadController* rLoadInterlock::getOwner()
+{
+  return _owner;
+}
+
+bool rLoadInterlock::isPending(rLoadController* ctrl)
+{
+  return (ctrl != nullptr) && (_pending == ctrl);
+}
+
+uint32_t rLoadInterlock::getRejected()
+{
+  return _rejected;
+}
+
+#endif // CONFIG_LOADCTRL_INTERLOCK_ENABLED
@@ -0,0 +1,346 @@
+#include "reLoadPower.h"
+
+#if CONFIG_LOADCTRL_POWER_ENABLED
+
+#include <string.h>
+#include "reEsp32.h"
+#include "rLog.h"
+#include "rStrings.h"
+
+static const char* logTAG = "LOAD";
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------- rLoadPowerBudget --------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+rLoadPowerBudget::rLoadPowerBudget(uint8_t max_loads, uint32_t max_power, uint32_t stagger_ms)
+{
+  portMUX_INITIALIZE(&_lock);
+  _count = 0;
+  _max_loads = 0;
+  _items = (re_load_power_item_t*)calloc(max_loads, sizeof(re_load_power_item_t));
+  if (_items) {
+    _max_loads = max_loads;
+  } else {
+    rlog_e(logTAG, "Failed to allocate memory for %d loads", max_loads);
+  };
+  _max_power = max_power;
+  _stagger = (uint64_t)stagger_ms * 1000;
+  _used = 0;
+  _last_start = 0;
+  _timer = nullptr;
+  memset((void*)&_metrics, 0, sizeof(re_load_power_metrics_t));
+}
+
+rLoadPowerBudget::~rLoadPowerBudget()
+{
+  if (_timer != nullptr) {
+    if (esp_timer_is_active(_timer)) {
+      esp_timer_stop(_timer);
+    };
+    esp_timer_delete(_timer);
+    _timer = nullptr;
+  };
+  for (uint8_t i = 0; i < _count; i++) {
+    _items[i].ctrl->setPowerBudget(nullptr);
+  };
+  if (_items) free(_items);
+  _items = nullptr;
+  _count = 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------------- Loads -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+bool rLoadPowerBudget::loadAdd(rLoadController* ctrl, uint32_t power, uint8_t priority)
+{
+  if (ctrl && (_count < _max_loads) && (itemFind(ctrl) == nullptr)) {
+    portENTER_CRITICAL(&_lock);
+    re_load_power_item_t* item = &_items[_count];
+    memset((void*)item, 0, sizeof(re_load_power_item_t));
+    item->ctrl = ctrl;
+    item->power = power;
+    item->priority = priority;
+    // The load may already be on
+    item->on = ctrl->getState();
+    if (item->on) _used += power;
+    _count++;
+    portEXIT_CRITICAL(&_lock);
+    ctrl->setPowerBudget(this);
+    return true;
+  };
+  return false;
+}
+
+void rLoadPowerBudget::loadRemove(rLoadController* ctrl)
+{
+  portENTER_CRITICAL(&_lock);
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_items[i].ctrl == ctrl) {
+      if (_items[i].on) _used -= _items[i].power;
+      if (_items[i].queued) _metrics.queueDepth--;
+      for (uint8_t j = i; j < _count - 1; j++) {
+        _items[j] = _items[j + 1];
+      };
+      _count--;
+      break;
+    };
+  };
+  portEXIT_CRITICAL(&_lock);
+  ctrl->setPowerBudget(nullptr);
+}
+
+re_load_power_item_t* rLoadPowerBudget::itemFind(rLoadController* ctrl)
+{
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_items[i].ctrl == ctrl) {
+      return &_items[i];
+    };
+  };
+  return nullptr;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Parameters -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+void rLoadPowerBudget::setMaxPower(uint32_t max_power)
+{
+  _max_power = max_power;
+  timerArm();
+}
+
+void rLoadPowerBudget::setStagger(uint32_t stagger_ms)
+{
+  _stagger = (uint64_t)stagger_ms * 1000;
+  timerArm();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- Requests ------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Must be called inside the critical section
+bool rLoadPowerBudget::canStart(re_load_power_item_t* item, int64_t now)
+{
+  // Minimum interval between switch-ons
+  if ((_last_start > 0) && ((uint64_t)(now - _last_start) < _stagger)) {
+    return false;
+  };
+  // Total power; a load that exceeds the limit on its own can only be switched on alone
+  return (_max_power == 0) || (_used == 0) || (_used + item->power <= _max_power);
+}
+
+// Must be called inside the critical section
+re_load_power_item_t* rLoadPowerBudget::queueFirst()
+{
+  re_load_power_item_t* first = nullptr;
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_items[i].queued) {
+      if ((first == nullptr)
+       || (_items[i].priority > first->priority)
+       || ((_items[i].priority == first->priority) && (_items[i].queued_at < first->queued_at))) {
+        first = &_items[i];
+      };
+    };
+  };
+  return first;
+}
+
+bool rLoadPowerBudget::requestOn(rLoadController* ctrl, bool publish)
+{
+  bool ret = true;
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&_lock);
+  re_load_power_item_t* item = itemFind(ctrl);
+  if (item && !item->on) {
+    if (item->queued) {
+      // Repeated request, waiting in the queue
+      item->publish = item->publish || publish;
+      ret = false;
+    } else {
+      _metrics.requests++;
+      // Requests with the same or higher priority that are already waiting are served first
+      re_load_power_item_t* first = queueFirst();
+      if (((first == nullptr) || (first->priority < item->priority)) && canStart(item, now)) {
+        item->on = true;
+        _used += item->power;
+        _last_start = now;
+      } else {
+        item->queued = true;
+        item->queued_at = now;
+        item->publish = publish;
+        _metrics.delayed++;
+        _metrics.queueDepth++;
+        if (_metrics.queueDepth > _metrics.queueDepthMax) {
+          _metrics.queueDepthMax = _metrics.queueDepth;
+        };
+        ret = false;
+      };
+    };
+  };
+  portEXIT_CRITICAL(&_lock);
+  if (!ret) {
+    rlog_d(logTAG, "Power budget: switch-on request is queued (%d in queue)", _metrics.queueDepth);
+    timerArm();
+  };
+  return ret;
+}
+
+void rLoadPowerBudget::requestCancel(rLoadController* ctrl)
+{
+  portENTER_CRITICAL(&_lock);
+  re_load_power_item_t* item = itemFind(ctrl);
+  if (item && item->queued) {
+    item->queued = false;
+    _metrics.queueDepth--;
+    _metrics.cancelled++;
+  };
+  portEXIT_CRITICAL(&_lock);
+}
+
+void rLoadPowerBudget::release(rLoadController* ctrl)
+{
+  bool released = false;
+  portENTER_CRITICAL(&_lock);
+  re_load_power_item_t* item = itemFind(ctrl);
+  if (item && item->on) {
+    item->on = false;
+    _used -= item->power;
+    released = true;
+  };
+  portEXIT_CRITICAL(&_lock);
+  if (released) {
+    timerArm();
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Timer --------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void loadPowerTimerEnd(void* arg)
+{
+  if (arg) {
+    rLoadPowerBudget* power = (rLoadPowerBudget*)arg;
+    power->timerProcess();
+  };
+}
+
+void rLoadPowerBudget::timerArm()
+{
+  // Calculate the delay until the first request in the queue can be served
+  bool start = false;
+  uint64_t delay = 1000;
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&_lock);
+  re_load_power_item_t* first = queueFirst();
+  if (first) {
+    if ((_max_power == 0) || (_used == 0) || (_used + first->power <= _max_power)) {
+      start = true;
+      if ((_last_start > 0) && ((uint64_t)(now - _last_start) < _stagger)) {
+        delay = _stagger - (uint64_t)(now - _last_start);
+      };
+    };
+    // Otherwise the queue is waiting for release of power
+  };
+  portEXIT_CRITICAL(&_lock);
+
+  if (_timer == nullptr) {
+    esp_timer_create_args_t cfg;
+    memset(&cfg, 0, sizeof(esp_timer_create_args_t));
+    cfg.name = "load_power";
+    cfg.callback = loadPowerTimerEnd;
+    cfg.arg = this;
+    RE_OK_CHECK(esp_timer_create(&cfg, &_timer), return);
+  };
+  if (esp_timer_is_active(_timer)) {
+    esp_timer_stop(_timer);
+  };
+  if (start) {
+    RE_OK_CHECK(esp_timer_start_once(_timer, delay), return);
+  };
+}
+
+void rLoadPowerBudget::timerProcess()
+{
+  rLoadController* ctrl = nullptr;
+  do {
+    ctrl = nullptr;
+    bool publish = false;
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&_lock);
+    re_load_power_item_t* first = queueFirst();
+    if (first && canStart(first, now)) {
+      first->queued = false;
+      first->on = true;
+      _used += first->power;
+      _last_start = now;
+      _metrics.queueDepth--;
+      _metrics.waitCount++;
+      _metrics.waitLast = (uint32_t)((now - first->queued_at) / 1000);
+      _metrics.waitSum += _metrics.waitLast;
+      if (_metrics.waitLast > _metrics.waitMax) {
+        _metrics.waitMax = _metrics.waitLast;
+      };
+      ctrl = first->ctrl;
+      publish = first->publish;
+    };
+    portEXIT_CRITICAL(&_lock);
+
+    // Switching is performed outside the critical section, the reserved power is released by the controller on failure
+    if (ctrl) {
+      rlog_d(logTAG, "Power budget: delayed switch-on after %d ms", _metrics.waitLast);
+      ctrl->_power_granted = true;
+      #if CONFIG_LOADCTRL_LISTENERS_ENABLED
+        ctrl->_source = LOAD_SOURCE_POWER;
+      #endif // CONFIG_LOADCTRL_LISTENERS_ENABLED
+      ctrl->loadSetState(true, false, publish);
+    };
+  } while (ctrl);
+  timerArm();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Get data -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+uint32_t rLoadPowerBudget::getPowerUsed()
+{
+  return _used;
+}
+
+uint8_t rLoadPowerBudget::getQueueDepth()
+{
+  return _metrics.queueDepth;
+}
+
+bool rLoadPowerBudget::isQueued(rLoadController* ctrl)
+{
+  bool ret = false;
+  portENTER_CRITICAL(&_lock);
+  re_load_power_item_t* item = itemFind(ctrl);
+  ret = item && item->queued;
+  portEXIT_CRITICAL(&_lock);
+  return ret;
+}
+
+re_load_power_metrics_t rLoadPowerBudget::getMetrics()
+{
+  re_load_power_metrics_t ret;
+  portENTER_CRITICAL(&_lock);
+  ret = _metrics;
+  portEXIT_CRITICAL(&_lock);
+  return ret;
+}
+
+char* rLoadPowerBudget::getJSON()
+{
+  re_load_power_metrics_t metrics = getMetrics();
+  uint32_t waitAvg = metrics.waitCount > 0 ? (uint32_t)(metrics.waitSum / metrics.waitCount) : 0;
+  return malloc_stringf("{\"" CONFIG_LOADCTRL_POWER_USED "\":%d,\"" CONFIG_LOADCTRL_POWER_LIMIT "\":%d,\"" CONFIG_LOADCTRL_POWER_QUEUE "\":%d,\"" CONFIG_LOADCTRL_POWER_QUEUE_MAX "\":%d,\"" CONFIG_LOADCTRL_POWER_REQUESTS "\":%d,\"" CONFIG_LOADCTRL_POWER_DELAYED "\":%d,\"" CONFIG_LOADCTRL_POWER_WAIT_AVG "\":%d,\"" CONFIG_LOADCTRL_POWER_WAIT_MAX "\":%d}",
+    _used, _max_power, metrics.queueDepth, metrics.queueDepthMax, metrics.requests, metrics.delayed, waitAvg, metrics.waitMax);
+}
+
+#endif // CONFIG_LOADCTRL_POWER_ENABLED
@@ -0,0 +1,443 @@
+#include "reLoadReplay.h"
+
+#if CONFIG_LOADCTRL_REPLAY_ENABLED
+
+#include <string.h>
+#include "reEvents.h"
+#include "reNvs.h"
+#include "reEsp32.h"
+#include "rLog.h"
+#include "rStrings.h"
+
+static const char* logTAG = "LOAD";
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------- Virtual clock ----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static uint32_t _replayTime = 0;                // Wall-clock time of the replay
+static uint32_t _replayBoot = 0;                // Wall-clock time of the last simulated boot
+
+static int64_t loadReplayClockMono()
+{
+  // As on a real device, the monotonic clock never reads zero after boot
+  return ((int64_t)(_replayTime - _replayBoot) + 1) * 1000000;
+}
+
+static time_t loadReplayClockTime()
+{
+  return (time_t)_replayTime;
+}
+
+static uint32_t loadReplayNextMidnight(uint32_t time)
+{
+  time_t t = (time_t)time;
+  struct tm tm;
+  localtime_r(&t, &tm);
+  tm.tm_hour = 0;
+  tm.tm_min = 0;
+  tm.tm_sec = 0;
+  tm.tm_mday++;
+  tm.tm_isdst = -1;
+  return (uint32_t)mktime(&tm);
+}
+
+void rLoadReplay::clockReset(uint32_t time)
+{
+  _replayTime = time;
+  _replayBoot = time;
+  _midnight = loadReplayNextMidnight(time);
+}
+
+void rLoadReplay::clockAdvance(uint32_t time)
+{
+  // Events of the virtual clock are sent in order of time: checkpoints of the loads that are on
+  // and the same events that reEvents sends at the beginning of the day, week, month and year (local time)
+  while (true) {
+    uint32_t next = _midnight;
+    #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+      for (uint8_t i = 0; i < _count; i++) {
+        if ((_items[i].checkpoint_at > 0) && (_items[i].checkpoint_at < next)) {
+          next = _items[i].checkpoint_at;
+        };
+      };
+    #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+    if (next > time) break;
+    _replayTime = next;
+
+    #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+      for (uint8_t i = 0; i < _count; i++) {
+        if (_items[i].checkpoint_at == next) {
+          _items[i].ctrl->checkpointTimerEnd();
+          _items[i].checkpoint_at += _checkpoint;
+          _stats.checkpoints++;
+        };
+      };
+    #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+
+    if (_midnight == next) {
+      time_t t = (time_t)_midnight;
+      struct tm tm;
+      localtime_r(&t, &tm);
+      int mday = tm.tm_mday;
+      for (uint8_t i = 0; i < _count; i++) {
+        rLoadController* ctrl = _items[i].ctrl;
+        ctrl->countersTimeEventHandler(RE_TIME_START_OF_DAY, &mday);
+        if (tm.tm_wday == 1) {
+          ctrl->countersTimeEventHandler(RE_TIME_START_OF_WEEK, &mday);
+        };
+        if (tm.tm_mday == 1) {
+          ctrl->countersTimeEventHandler(RE_TIME_START_OF_MONTH, &mday);
+        };
+        if (tm.tm_yday == 0) {
+          ctrl->countersTimeEventHandler(RE_TIME_START_OF_YEAR, &mday);
+        };
+      };
+      _stats.rollovers++;
+      _midnight = loadReplayNextMidnight(_midnight);
+    };
+  };
+  _replayTime = time;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------- Simulated GPIO ---------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Loads of the active replay, the pin of the controller is the index of the load
+static re_load_replay_item_t* _replayItems = nullptr;
+static uint8_t _replayCount = 0;
+
+static bool loadReplayGpioInit(rLoadController *ctrl, uint8_t pin, uint8_t level_on)
+{
+  if (pin < _replayCount) {
+    _replayItems[pin].level = !level_on;
+  };
+  return true;
+}
+
+static bool loadReplayGpioChange(rLoadController *ctrl, uint8_t pin, uint8_t physical_level)
+{
+  if (pin < _replayCount) {
+    _replayItems[pin].level = physical_level;
+  };
+  return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- NVS -----------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void loadReplayNvsEraseSpace(const char* nvs_space)
+{
+  nvs_handle_t nvs_handle;
+  if (nvsOpen(nvs_space, NVS_READWRITE, &nvs_handle)) {
+    RE_ERROR_LOG(nvs_erase_all(nvs_handle));
+    RE_ERROR_LOG(nvs_commit(nvs_handle));
+    nvs_close(nvs_handle);
+  };
+}
+
+static void loadReplayNvsErase(const char* nvs_space)
+{
+  // Base namespace (days, slots, checkpoint, wear) and namespaces of counters and durations
+  loadReplayNvsEraseSpace(nvs_space);
+  char* nmsp_cnt = malloc_stringf("%s.cnt", nvs_space);
+  if (nmsp_cnt) {
+    loadReplayNvsEraseSpace(nmsp_cnt);
+    free(nmsp_cnt);
+  };
+  char* nmsp_dur = malloc_stringf("%s.dur", nvs_space);
+  if (nmsp_dur) {
+    loadReplayNvsEraseSpace(nmsp_dur);
+    free(nmsp_dur);
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ rLoadReplay ----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+rLoadReplay::rLoadReplay(uint8_t loads, uint8_t* period_start, const char* nvs_prefix, uint32_t checkpoint_s)
+{
+  _count = 0;
+  _items = nullptr;
+  _period_start = period_start;
+  _checkpoint = checkpoint_s;
+  memset((void*)&_stats, 0, sizeof(re_load_replay_stats_t));
+  if (_replayItems) {
+    rlog_e(logTAG, "Replay: another replay is already running");
+    return;
+  };
+  // Two hex digits of the index and the suffix of the counters namespace must fit into the namespace
+  if (!nvs_prefix || (strlen(nvs_prefix) + 2 > LOAD_NVS_SPACE_MAX - LOAD_NVS_SUFFIX_LEN)) {
+    rlog_e(logTAG, "Replay: NVS prefix is too long");
+    return;
+  };
+  _items = (re_load_replay_item_t*)calloc(loads, sizeof(re_load_replay_item_t));
+  if (_items) {
+    _count = loads;
+    for (uint8_t i = 0; i < _count; i++) {
+      _items[i].nvs_space = malloc_stringf("%s%02x", nvs_prefix, i);
+      if (!_items[i].nvs_space) {
+        rlog_e(logTAG, "Failed to allocate memory for %d loads", loads);
+        for (uint8_t j = 0; j < i; j++) {
+          free(_items[j].nvs_space);
+        };
+        free(_items);
+        _items = nullptr;
+        _count = 0;
+        return;
+      };
+    };
+  } else {
+    rlog_e(logTAG, "Failed to allocate memory for %d loads", loads);
+    return;
+  };
+  _replayItems = _items;
+  _replayCount = _count;
+  loadClockSet(loadReplayClockMono, loadReplayClockTime);
+  reset(0);
+}
+
+rLoadReplay::~rLoadReplay()
+{
+  if (_items) {
+    loadsFree();
+    for (uint8_t i = 0; i < _count; i++) {
+      if (_items[i].nvs_space) free(_items[i].nvs_space);
+    };
+    free(_items);
+    loadClockSet(nullptr, nullptr);
+    _replayItems = nullptr;
+    _replayCount = 0;
+  };
+  _items = nullptr;
+  _count = 0;
+}
+
+bool rLoadReplay::loadsCreate()
+{
+  // The same order as at the start of the device: counters are restored from NVS, then the output is initialized
+  for (uint8_t i = 0; i < _count; i++) {
+    rLoadController* ctrl = new rLoadIoExpController(i, 1, false, _items[i].nvs_space, loadReplayGpioInit, loadReplayGpioChange);
+    if (!ctrl) {
+      rlog_e(logTAG, "Replay: failed to create controller for load %d", i);
+      loadsFree();
+      return false;
+    };
+    _items[i].ctrl = ctrl;
+    _items[i].checkpoint_at = 0;
+    ctrl->setPeriodStartDay(_period_start);
+    #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+      ctrl->checkpointSetInterval(_checkpoint);
+    #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+    ctrl->countersNvsRestore();
+    // The output is already off, so loadInit() reports no change: the result is not an error
+    ctrl->loadInit(false);
+  };
+  return true;
+}
+
+void rLoadReplay::loadsFree()
+{
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_items[i].ctrl) {
+      delete _items[i].ctrl;
+      _items[i].ctrl = nullptr;
+    };
+    _items[i].checkpoint_at = 0;
+  };
+}
+
+bool rLoadReplay::reset(uint32_t start_time)
+{
+  if (!_items) return false;
+  loadsFree();
+  for (uint8_t i = 0; i < _count; i++) {
+    loadReplayNvsErase(_items[i].nvs_space);
+  };
+  memset((void*)&_stats, 0, sizeof(re_load_replay_stats_t));
+  clockReset(start_time);
+  return loadsCreate();
+}
+
+bool rLoadReplay::seedLegacy(uint8_t load, uint32_t days, re_load_counters_t* counters, re_load_durations_t* durations)
+{
+  if ((load >= _count) || !counters || !durations) return false;
+  const char* nvs_space = _items[load].nvs_space;
+  // Keys of the current format (slots, 64-bit totals) must not hide the legacy data
+  loadReplayNvsErase(nvs_space);
+
+  bool ret = false;
+  nvs_handle_t nvs_handle;
+  if (nvsOpen(nvs_space, NVS_READWRITE, &nvs_handle)) {
+    RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_DAYS, days));
+    ret = true;
+    RE_OK_CHECK(nvs_commit(nvs_handle), ret = false);
+    nvs_close(nvs_handle);
+  };
+
+  char* nmsp_cnt = malloc_stringf("%s.cnt", nvs_space);
+  if (nmsp_cnt) {
+    if (nvsOpen(nmsp_cnt, NVS_READWRITE, &nvs_handle)) {
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_TOTAL, (uint32_t)counters->cntTotal));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_TODAY, counters->cntToday));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_YESTERDAY, counters->cntYesterday));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_CURR, counters->cntWeekCurr));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_PREV, counters->cntWeekPrev));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_CURR, counters->cntMonthCurr));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_PREV, counters->cntMonthPrev));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_CURR, counters->cntPeriodCurr));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_PREV, counters->cntPeriodPrev));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_CURR, counters->cntYearCurr));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_PREV, counters->cntYearPrev));
+      RE_OK_CHECK(nvs_commit(nvs_handle), ret = false);
+      nvs_close(nvs_handle);
+    } else {
+      ret = false;
+    };
+    free(nmsp_cnt);
+  } else {
+    ret = false;
+  };
+
+  char* nmsp_dur = malloc_stringf("%s.dur", nvs_space);
+  if (nmsp_dur) {
+    if (nvsOpen(nmsp_dur, NVS_READWRITE, &nvs_handle)) {
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_LAST, durations->durLast));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_TOTAL, (uint32_t)durations->durTotal));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_TODAY, durations->durToday));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_YESTERDAY, durations->durYesterday));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_CURR, durations->durWeekCurr));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_WEEK_PREV, durations->durWeekPrev));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_CURR, durations->durMonthCurr));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_MONTH_PREV, durations->durMonthPrev));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_CURR, durations->durPeriodCurr));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_PERIOD_PREV, durations->durPeriodPrev));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_CURR, durations->durYearCurr));
+      RE_ERROR_LOG(nvs_set_u32(nvs_handle, CONFIG_LOADCTRL_YEAR_PREV, durations->durYearPrev));
+      RE_OK_CHECK(nvs_commit(nvs_handle), ret = false);
+      nvs_close(nvs_handle);
+    } else {
+      ret = false;
+    };
+    free(nmsp_dur);
+  } else {
+    ret = false;
+  };
+  return ret;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- Events --------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+bool rLoadReplay::processEvent(const re_load_replay_event_t* event)
+{
+  if ((event->load >= _count) || !_items[event->load].ctrl || (event->time < _replayTime)) {
+    rlog_e(logTAG, "Replay: invalid event #%d (load %d, time %d)", _stats.events, event->load, event->time);
+    return false;
+  };
+
+  re_load_replay_item_t* item = &_items[event->load];
+  switch (event->type) {
+    case LOAD_REPLAY_ON:
+      clockAdvance(event->time);
+      if (!item->ctrl->getState()) {
+        item->ctrl->loadSetState(true, false, false);
+        #if CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+          if ((_checkpoint > 0) && item->ctrl->getState()) {
+            item->checkpoint_at = _replayTime + _checkpoint;
+          };
+        #endif // CONFIG_LOADCTRL_CHECKPOINT_ENABLED
+      };
+      break;
+
+    case LOAD_REPLAY_OFF:
+      clockAdvance(event->time);
+      item->ctrl->loadSetState(false, false, false);
+      item->checkpoint_at = 0;
+      break;
+
+    case LOAD_REPLAY_STORE:
+      clockAdvance(event->time);
+      item->ctrl->countersNvsStore();
+      break;
+
+    case LOAD_REPLAY_REBOOT:
+      // The device was off: the virtual clock sent nothing, controllers are created again and restored from NVS
+      for (uint8_t i = 0; i < _count; i++) {
+        if (_items[i].ctrl && _items[i].ctrl->getState()) _stats.lost++;
+      };
+      loadsFree();
+      clockReset(event->time);
+      _stats.reboots++;
+      if (!loadsCreate()) return false;
+      break;
+
+    default:
+      return false;
+  };
+  _stats.events++;
+  return true;
+}
+
+bool rLoadReplay::process(const re_load_replay_event_t* events, uint32_t count)
+{
+  if (!_items) return false;
+  bool ret = true;
+  int64_t time_start = esp_timer_get_time();
+  for (uint32_t i = 0; i < count; i++) {
+    if (!processEvent(&events[i])) {
+      ret = false;
+      break;
+    };
+  };
+  _stats.time += (uint64_t)(esp_timer_get_time() - time_start);
+  return ret;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Get data -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+re_load_counters_t rLoadReplay::getCounters(uint8_t load)
+{
+  re_load_counters_t ret = {};
+  if ((load < _count) && _items[load].ctrl) {
+    ret = _items[load].ctrl->getCounters();
+  };
+  return ret;
+}
+
+re_load_durations_t rLoadReplay::getDurations(uint8_t load)
+{
+  re_load_durations_t ret = {};
+  if ((load < _count) && _items[load].ctrl) {
+    ret = _items[load].ctrl->getDurations();
+  };
+  return ret;
+}
+
+re_load_replay_stats_t rLoadReplay::getStats()
+{
+  return _stats;
+}
+
+char* rLoadReplay::getJSON(uint8_t load)
+{
+  if ((load < _count) && _items[load].ctrl) {
+    return _items[load].ctrl->getJSON();
+  };
+  return nullptr;
+}
+
+char* rLoadReplay::getStatsJSON()
+{
+  uint32_t rate = _stats.time > 0 ? (uint32_t)((uint64_t)_stats.events * 1000000 / _stats.time) : 0;
+  return malloc_stringf("{\"events\":%d,\"rollovers\":%d,\"checkpoints\":%d,\"reboots\":%d,\"lost\":%d,\"time_us\":%d,\"events_per_sec\":%d}",
+    _stats.events, _stats.rollovers, _stats.checkpoints, _stats.reboots, _stats.lost, (uint32_t)_stats.time, rate);
+}
+
+#endif // CONFIG_LOADCTRL_REPLAY_ENABLED
@@ -0,0 +1,448 @@
+#include "reLoadSchedule.h"
+#include <string.h>
+#include "reNvs.h"
+#include "reEvents.h"
+#include "reEsp32.h"
+#include "rLog.h"
+
+static const char* logTAG = "LOAD";
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------- rLoadScheduler ---------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+rLoadScheduler::rLoadScheduler(uint8_t max_loads, uint8_t max_programs)
+{
+  _loads_count = 0;
+  _loads_max = 0;
+  _loads = (rLoadController**)calloc(max_loads, sizeof(rLoadController*));
+  if (_loads) {
+    _loads_max = max_loads;
+  };
+
+  _programs_count = 0;
+  _programs_max = 0;
+  _programs = (re_load_program_t*)calloc(max_programs, sizeof(re_load_program_t));
+  _next = (time_t*)calloc(max_programs, sizeof(time_t));
+  _active = (uint8_t*)calloc(max_programs, sizeof(uint8_t));
+  if (_programs && _next && _active) {
+    _programs_max = max_programs;
+  } else {
+    rlog_e(logTAG, "Failed to allocate memory for %d programs", max_programs);
+  };
+
+  _started = false;
+  _timer = nullptr;
+  _lock = xSemaphoreCreateRecursiveMutex();
+}
+
+rLoadScheduler::~rLoadScheduler()
+{
+  stop();
+  lock();
+  if (_timer != nullptr) {
+    esp_timer_delete(_timer);
+    _timer = nullptr;
+  };
+  unlock();
+  if (_loads) free(_loads);
+  _loads = nullptr;
+  if (_programs) free(_programs);
+  _programs = nullptr;
+  if (_next) free(_next);
+  _next = nullptr;
+  if (_active) free(_active);
+  _active = nullptr;
+  if (_lock) vSemaphoreDelete(_lock);
+  _lock = nullptr;
+}
+
+void rLoadScheduler::lock()
+{
+  if (_lock) xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+}
+
+void rLoadScheduler::unlock()
+{
+  if (_lock) xSemaphoreGiveRecursive(_lock);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------------- Loads -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+int16_t rLoadScheduler::loadAdd(rLoadController* ctrl)
+{
+  int16_t ret = -1;
+  lock();
+  if (ctrl && (_loads_count < _loads_max)) {
+    _loads[_loads_count] = ctrl;
+    _loads_count++;
+    ret = _loads_count - 1;
+  };
+  unlock();
+  return ret;
+}
+
+rLoadController* rLoadScheduler::loadGet(uint8_t load)
+{
+  rLoadController* ret = nullptr;
+  lock();
+  if (load < _loads_count) {
+    ret = _loads[load];
+  };
+  unlock();
+  return ret;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- Programs ------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+bool rLoadScheduler::programValid(const re_load_program_t* prg)
+{
+  return (prg->load < _loads_max) && ((prg->days & ~LOAD_SCHEDULE_EVERYDAY) == 0)
+      && (prg->start < 1440) && (prg->duration > 0) && (prg->duration <= 1440);
+}
+
+int16_t rLoadScheduler::programAdd(uint8_t load, uint8_t days, uint16_t start, uint16_t duration)
+{
+  int16_t ret = -1;
+  lock();
+  re_load_program_t prg;
+  prg.load = load;
+  prg.days = days & LOAD_SCHEDULE_EVERYDAY;
+  prg.start = start;
+  prg.duration = duration;
+  if ((_programs_count < _programs_max) && programValid(&prg)) {
+    _programs[_programs_count] = prg;
+    _next[_programs_count] = 0;
+    _active[_programs_count] = 0;
+    _programs_count++;
+    if (_started) update();
+    ret = _programs_count - 1;
+  };
+  unlock();
+  return ret;
+}
+
+bool rLoadScheduler::programDelete(uint8_t index)
+{
+  bool ret = false;
+  lock();
+  if (index < _programs_count) {
+    uint8_t load = _programs[index].load;
+    for (uint8_t i = index; i < _programs_count - 1; i++) {
+      _programs[i] = _programs[i + 1];
+      _next[i] = _next[i + 1];
+      _active[i] = _active[i + 1];
+    };
+    _programs_count--;
+    if (_started) {
+      loadApply(load);
+      update();
+    };
+    ret = true;
+  };
+  unlock();
+  return ret;
+}
+
+void rLoadScheduler::programsClear()
+{
+  lock();
+  _programs_count = 0;
+  if (_timer && esp_timer_is_active(_timer)) {
+    esp_timer_stop(_timer);
+  };
+  unlock();
+}
+
+uint8_t rLoadScheduler::programsCount()
+{
+  return _programs_count;
+}
+
+re_load_program_t* rLoadScheduler::programGet(uint8_t index)
+{
+  // The program is returned by pointer, it must not be read while another task changes the programs
+  re_load_program_t* ret = nullptr;
+  lock();
+  if (index < _programs_count) {
+    ret = &_programs[index];
+  };
+  unlock();
+  return ret;
+}
+
+// Local time of the specified day (relative to base) and minute, taking into account the transition to summer time
+static time_t loadScheduleTime(struct tm* base, int8_t day_offset, uint16_t minutes)
+{
+  struct tm tmTrans = *base;
+  tmTrans.tm_mday += day_offset;
+  tmTrans.tm_hour = minutes / 60;
+  tmTrans.tm_min = minutes % 60;
+  tmTrans.tm_sec = 0;
+  tmTrans.tm_isdst = -1;
+  return mktime(&tmTrans);
+}
+
+bool rLoadScheduler::programCalc(uint8_t index, time_t now)
+{
+  re_load_program_t* prg = &_programs[index];
+  _active[index] = 0;
+  _next[index] = 0;
+  if ((prg->days & LOAD_SCHEDULE_EVERYDAY) && (prg->duration > 0)) {
+    struct tm tmNow;
+    localtime_r(&now, &tmNow);
+    // Yesterday's window may still be open after midnight, the next one is no further than a week away
+    for (int8_t d = -1; d <= 7; d++) {
+      uint8_t wday = (tmNow.tm_wday + 7 + d) % 7;
+      if (prg->days & (1 << wday)) {
+        time_t time_on = loadScheduleTime(&tmNow, d, prg->start);
+        time_t time_off = time_on + (time_t)prg->duration * 60;
+        if (now < time_on) {
+          _next[index] = time_on;
+          return true;
+        };
+        if (now < time_off) {
+          _active[index] = 1;
+          _next[index] = time_off;
+          return true;
+        };
+      };
+    };
+  };
+  return false;
+}
+
+bool rLoadScheduler::loadApply(uint8_t load)
+{
+  rLoadController* ctrl = loadGet(load);
+  if (ctrl) {
+    bool state = false;
+    for (uint8_t i = 0; i < _programs_count; i++) {
+      if ((_programs[i].load == load) && _active[i]) {
+        state = true;
+        break;
+      };
+    };
+    if (ctrl->getState() != state) {
+      rlog_i(logTAG, "Schedule: load %d is switched %s", load, state ? "ON" : "OFF");
+      return ctrl->loadSetState(state, false, true);
+    };
+    return true;
+  };
+  return false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Timer --------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void loadSchedulerTimerEnd(void* arg)
+{
+  if (arg) {
+    rLoadScheduler* sched = (rLoadScheduler*)arg;
+    sched->timerProcess();
+  };
+}
+
+bool rLoadScheduler::timerArm(time_t now)
+{
+  if (_timer == nullptr) {
+    esp_timer_create_args_t cfg;
+    memset(&cfg, 0, sizeof(esp_timer_create_args_t));
+    cfg.name = "load_schedule";
+    cfg.callback = loadSchedulerTimerEnd;
+    cfg.arg = this;
+    RE_OK_CHECK(esp_timer_create(&cfg, &_timer), return false);
+  };
+  if (esp_timer_is_active(_timer)) {
+    esp_timer_stop(_timer);
+  };
+
+  // Nearest transition of all programs
+  time_t next = 0;
+  for (uint8_t i = 0; i < _programs_count; i++) {
+    if ((_next[i] > 0) && ((next == 0) || (_next[i] < next))) {
+      next = _next[i];
+    };
+  };
+  if (next > 0) {
+    uint64_t delay = (next > now) ? (uint64_t)(next - now) * 1000000 : 1000;
+    RE_OK_CHECK(esp_timer_start_once(_timer, delay), return false);
+    rlog_d(logTAG, "Schedule: next transition in %d s", (int)(delay / 1000000));
+  };
+  return true;
+}
+
+void rLoadScheduler::timerProcess()
+{
+  lock();
+  time_t now = time(nullptr);
+  if (now > LOAD_TIME_VALID) {
+    // Recalculate only programs whose transition has come
+    for (uint8_t i = 0; i < _programs_count; i++) {
+      if ((_next[i] > 0) && (_next[i] <= now)) {
+        programCalc(i, now);
+        loadApply(_programs[i].load);
+      };
+    };
+    timerArm(now);
+  };
+  unlock();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- Control -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+bool rLoadScheduler::start()
+{
+  lock();
+  _started = true;
+  bool ret = calculate(true);
+  unlock();
+  return ret;
+}
+
+void rLoadScheduler::stop()
+{
+  lock();
+  _started = false;
+  if (_timer && esp_timer_is_active(_timer)) {
+    esp_timer_stop(_timer);
+  };
+  unlock();
+}
+
+bool rLoadScheduler::update()
+{
+  return calculate(false);
+}
+
+bool rLoadScheduler::calculate(bool apply_all)
+{
+  bool ret = false;
+  lock();
+  time_t now = time(nullptr);
+  if (_started && (now > LOAD_TIME_VALID)) {
+    for (uint8_t i = 0; i < _programs_count; i++) {
+      uint8_t active = _active[i];
+      programCalc(i, now);
+      if (!apply_all && (active != _active[i])) {
+        loadApply(_programs[i].load);
+      };
+    };
+    if (apply_all) {
+      // Bring all loads to the state of their programs
+      for (uint8_t i = 0; i < _loads_count; i++) {
+        loadApply(i);
+      };
+    };
+    ret = timerArm(now);
+  };
+  unlock();
+  return ret;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------- Saving programs --------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+bool rLoadScheduler::nvsStore(const char* nvs_space)
+{
+  if (nvs_space == nullptr) return false;
+
+  // The programs are copied under the lock and written without it
+  lock();
+  uint8_t count = _programs_count;
+  re_load_program_t* programs = nullptr;
+  if (count > 0) {
+    programs = (re_load_program_t*)malloc(count * sizeof(re_load_program_t));
+    if (programs) {
+      memcpy(programs, _programs, count * sizeof(re_load_program_t));
+    };
+  };
+  unlock();
+  if ((count > 0) && (programs == nullptr)) {
+    rlog_e(logTAG, "Failed to allocate memory for %d programs", count);
+    return false;
+  };
+
+  bool ret = false;
+  nvs_handle_t nvs_handle;
+  if (nvsOpen(nvs_space, NVS_READWRITE, &nvs_handle)) {
+    esp_err_t err = ESP_OK;
+    if (count > 0) {
+      err = nvs_set_blob(nvs_handle, CONFIG_LOADCTRL_SCHEDULE_KEY, programs, count * sizeof(re_load_program_t));
+    } else {
+      err = nvs_erase_key(nvs_handle, CONFIG_LOADCTRL_SCHEDULE_KEY);
+      if (err == ESP_ERR_NVS_NOT_FOUND) err = ESP_OK;
+    };
+    if (err == ESP_OK) {
+      err = nvs_commit(nvs_handle);
+    };
+    ret = (err == ESP_OK);
+    if (!ret) {
+      rlog_e(logTAG, "Failed to store schedule to NVS: #%d %s", err, esp_err_to_name(err));
+    };
+    nvs_close(nvs_handle);
+  };
+  if (programs) free(programs);
+  return ret;
+}
+
+bool rLoadScheduler::nvsRestore(const char* nvs_space)
+{
+  // The blob is read into a buffer, the table is replaced only with programs that pass the same checks as programAdd()
+  re_load_program_t* programs = nullptr;
+  size_t size = 0;
+  nvs_handle_t nvs_handle;
+  if (nvs_space && nvsOpen(nvs_space, NVS_READONLY, &nvs_handle)) {
+    if ((nvs_get_blob(nvs_handle, CONFIG_LOADCTRL_SCHEDULE_KEY, nullptr, &size) == ESP_OK) && (size > 0)
+     && (size % sizeof(re_load_program_t) == 0) && (size / sizeof(re_load_program_t) <= _programs_max)) {
+      programs = (re_load_program_t*)malloc(size);
+      if (programs && (nvs_get_blob(nvs_handle, CONFIG_LOADCTRL_SCHEDULE_KEY, programs, &size) != ESP_OK)) {
+        free(programs);
+        programs = nullptr;
+      };
+    };
+    nvs_close(nvs_handle);
+  };
+  if (programs == nullptr) return false;
+
+  lock();
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < size / sizeof(re_load_program_t); i++) {
+    if (programValid(&programs[i])) {
+      _programs[count] = programs[i];
+      _next[count] = 0;
+      _active[count] = 0;
+      count++;
+    } else {
+      rlog_w(logTAG, "Schedule: saved program #%d is invalid and is ignored (load %d, days 0x%02X, start %d, duration %d)",
+        i, programs[i].load, programs[i].days, programs[i].start, programs[i].duration);
+    };
+  };
+  _programs_count = count;
+  if (_started) {
+    calculate(true);
+  };
+  unlock();
+  free(programs);
+  return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------- Event handlers ----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+void rLoadScheduler::timeEventHandler(int32_t event_id, void* event_data)
+{
+  // The system clock has been set or corrected: the armed deadline is no longer valid
+  if (event_id == RE_TIME_SNTP_SYNC_OK) {
+    update();
+  };
+}